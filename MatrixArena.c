@@ -0,0 +1,529 @@
+/**
+ * @file    MatrixArena.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "MatrixThreads.h"
+#include "MatrixArena.h"
+
+//every MatrixAlloc() block starts with a copy of the allocator it came
+//from, padded to MATRIX_ALIGN so that the caller's part stays aligned
+#define HEADER_SIZE MATRIX_ALIGN
+
+#define ROUND_UP(size) (((size) + MATRIX_ALIGN - 1) & ~(size_t)(MATRIX_ALIGN - 1))
+
+static void *DefaultAlloc(void *ctx, size_t size, size_t align)
+{
+    void *ptr;
+    (void)ctx;
+    return posix_memalign(&ptr, align, size) == 0 ? ptr : NULL;
+}
+
+static void DefaultFree(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+static pthread_mutex_t allocator_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct MatrixAllocator current = {DefaultAlloc, DefaultFree, NULL};
+static atomic_ullong num_allocs, num_frees, num_bytes;
+
+/**
+ * MatrixSetAllocator installs the allocator used from now on.  Memory is
+ * always returned to the allocator it came from, so it can be changed at
+ * any time.
+ *
+ * @param: allocator, the allocator (copied), or NULL for the default
+ */
+void MatrixSetAllocator(const struct MatrixAllocator *allocator)
+{
+    static const struct MatrixAllocator fallback = {DefaultAlloc, DefaultFree,
+            NULL};
+
+    pthread_mutex_lock(&allocator_lock);
+    current = allocator != NULL ? *allocator : fallback;
+    pthread_mutex_unlock(&allocator_lock);
+}
+
+/**
+ * MatrixAlloc / MatrixFree take and return memory through the current
+ * allocator.
+ *
+ * @param: size, the number of bytes
+ *
+ * @return: a MATRIX_ALIGN-aligned pointer, or NULL if the allocator failed
+ */
+void *MatrixAlloc(size_t size)
+{
+    struct MatrixAllocator a;
+    char *base;
+
+    pthread_mutex_lock(&allocator_lock);
+    a = current;
+    pthread_mutex_unlock(&allocator_lock);
+
+    base = a.alloc(a.ctx, HEADER_SIZE + size, MATRIX_ALIGN);
+    if(base == NULL) {
+        return NULL;
+    }
+    memcpy(base, &a, sizeof(a));
+    atomic_fetch_add(&num_allocs, 1);
+    atomic_fetch_add(&num_bytes, HEADER_SIZE + size);
+    return base + HEADER_SIZE;
+}
+
+void MatrixFree(void *ptr)
+{
+    struct MatrixAllocator a;
+    char *base;
+
+    if(ptr == NULL) {
+        return;
+    }
+    base = (char *)ptr - HEADER_SIZE;
+    memcpy(&a, base, sizeof(a));
+    a.free(a.ctx, base);
+    atomic_fetch_add(&num_frees, 1);
+}
+
+/**
+ * MatrixAllocGetStats copies the counters into stats.
+ *
+ * @param: stats, pointer to the struct to fill
+ */
+void MatrixAllocGetStats(struct MatrixAllocStats *stats)
+{
+    stats->allocs = atomic_load(&num_allocs);
+    stats->frees = atomic_load(&num_frees);
+    stats->bytes = atomic_load(&num_bytes);
+}
+
+/**
+ * MatrixAllocResetStats sets every counter back to zero.
+ */
+void MatrixAllocResetStats(void)
+{
+    atomic_store(&num_allocs, 0);
+    atomic_store(&num_frees, 0);
+    atomic_store(&num_bytes, 0);
+}
+
+/*******************************************************************************
+ * NUMA placement
+ ******************************************************************************/
+
+//from <numaif.h>, which is not part of the C library
+#define MPOL_PREFERRED 1
+#define MPOL_MF_MOVE (1 << 1)
+#define MPOL_F_NODE (1 << 0)
+#define MPOL_F_ADDR (1 << 1)
+
+struct PlaceJob {
+    char *base;
+    int count, planes;
+    size_t elem_size;
+    int bind;
+};
+
+//prefers `node` for the whole pages of [begin, end); pages shared with a
+//neighbouring range are left to whichever thread touches them first
+static void BindRange(char *begin, char *end, int node)
+{
+#ifdef SYS_mbind
+    unsigned long mask[MATRIX_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t first, last;
+
+    if(page <= 0 || node < 0 || node >= MATRIX_MAX_NODES) {
+        return;
+    }
+    first = ((uintptr_t)begin + page - 1) & ~(uintptr_t)(page - 1);
+    last = (uintptr_t)end & ~(uintptr_t)(page - 1);
+    if(first >= last) {
+        return;
+    }
+    mask[node / (8 * sizeof(unsigned long))] |=
+            1UL << (node % (8 * sizeof(unsigned long)));
+    //refused under some sandboxes; first touch still places the pages
+    syscall(SYS_mbind, first, last - first, MPOL_PREFERRED, mask,
+            MATRIX_MAX_NODES + 1, MPOL_MF_MOVE);
+#else
+    (void)begin;
+    (void)end;
+    (void)node;
+#endif
+}
+
+static void PlaceRange(void *arg, int begin, int end)
+{
+    struct PlaceJob *job = arg;
+    int node = job->bind ? MatrixCurrentNode() : -1;
+
+    for(int p = 0; p < job->planes; p++) {
+        char *plane = job->base + (size_t)p * job->count * job->elem_size;
+        char *from = plane + (size_t)begin * job->elem_size;
+        size_t bytes = (size_t)(end - begin) * job->elem_size;
+        if(node >= 0) {
+            BindRange(from, from + bytes, node);
+        }
+        memset(from, 0, bytes);
+    }
+}
+
+/**
+ * MatrixAllocPlaced allocates a batch of `count` items in `planes` planes
+ * of count * elem_size bytes each (a MatrixBatch.h SoA batch has one plane
+ * per element), zero-filled by the workers of a MatrixParallelFor() on
+ * `threads` threads.  Each worker fills items [begin, end) of every plane,
+ * so on a NUMA machine those pages land on its node and a kernel run later
+ * on the same thread count finds its chunk in local memory.  Where the
+ * system allows it the pages are also bound to that node (preferred, not
+ * required), which keeps them there if they were touched before.
+ *
+ * @param: count, the number of items
+ * @param: planes, the number of planes
+ * @param: elem_size, the bytes of one item in one plane
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: a MATRIX_ALIGN-aligned pointer to free with MatrixFree(), or
+ *          NULL if the allocator failed
+ */
+void *MatrixAllocPlaced(int count, int planes, size_t elem_size, int threads)
+{
+    struct PlaceJob job;
+
+    job.base = MatrixAlloc((size_t)count * planes * elem_size);
+    if(job.base == NULL) {
+        return NULL;
+    }
+    job.count = count;
+    job.planes = planes;
+    job.elem_size = elem_size;
+    //binding is only worth a system call when there is a choice of node
+    job.bind = MatrixNumaNodes() > 1 &&
+            MatrixThreadsGetAffinity() != MATRIX_AFFINITY_NONE;
+    MatrixParallelFor(count, threads, PlaceRange, &job);
+    return job.base;
+}
+
+/**
+ * MatrixNodeOfAddress tells which NUMA node holds the page at ptr.  The
+ * page must have been touched.
+ *
+ * @param: ptr, an address
+ *
+ * @return: the node's number, or -1 if it cannot be told
+ */
+int MatrixNodeOfAddress(const void *ptr)
+{
+    if(MatrixNumaNodes() == 1) {
+        return MatrixCurrentNode();
+    }
+#ifdef SYS_get_mempolicy
+    int node;
+    if(syscall(SYS_get_mempolicy, &node, NULL, 0UL, ptr,
+            MPOL_F_NODE | MPOL_F_ADDR) == 0) {
+        return node;
+    }
+#endif
+    return -1;
+}
+
+/*******************************************************************************
+ * Scratch arena
+ ******************************************************************************/
+
+struct Block {
+    struct Block *prev;     //older block of the arena, or next spare
+    size_t size;            //usable bytes after the header
+    int node;               //NUMA node of the thread that created it
+};
+
+//the usable part of a block starts one alignment unit in
+#define BLOCK_DATA(block) ((char *)(block) + MATRIX_ALIGN)
+
+struct Arena {
+    struct Block *top;      //block being bumped, NULL before the first use
+    size_t used;            //bytes of top handed out
+    struct Block *spare;    //released blocks kept for reuse
+    int registered;         //whether thread exit will hand the blocks on
+};
+
+static _Thread_local struct Arena arena;
+
+//blocks of exited threads, waiting for another thread to need them
+static pthread_mutex_t orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct Block *orphans;
+static pthread_key_t exit_key;
+static pthread_once_t exit_once = PTHREAD_ONCE_INIT;
+
+static void OrphanBlocks(void *arg)
+{
+    struct Arena *a = arg;
+    struct Block *chains[2] = {a->top, a->spare};
+
+    pthread_mutex_lock(&orphan_lock);
+    for(int c = 0; c < 2; c++) {
+        while(chains[c] != NULL) {
+            struct Block *b = chains[c];
+            chains[c] = b->prev;
+            b->prev = orphans;
+            orphans = b;
+        }
+    }
+    pthread_mutex_unlock(&orphan_lock);
+    a->top = NULL;
+    a->spare = NULL;
+}
+
+static void CreateExitKey(void)
+{
+    pthread_key_create(&exit_key, OrphanBlocks);
+}
+
+//unlinks the smallest block of *list with at least `need` usable bytes, so
+//that small requests leave the big blocks for the big ones; with node >= 0,
+//only blocks created on that node are considered
+static struct Block *Unlink(struct Block **list, size_t need, int node)
+{
+    struct Block **best = NULL, *b;
+
+    for(struct Block **link = list; *link != NULL; link = &(*link)->prev) {
+        if((*link)->size >= need && (node < 0 || (*link)->node == node) &&
+                (best == NULL ||
+                (*link)->size < (*best)->size)) {
+            best = link;
+        }
+    }
+    if(best == NULL) {
+        return NULL;
+    }
+    b = *best;
+    *best = b->prev;
+    return b;
+}
+
+static struct Block *TakeBlock(size_t need)
+{
+    struct Block *b = Unlink(&arena.spare, need, -1);
+
+    if(b == NULL) {
+        //another node's block is still better than a new allocation
+        int node = MatrixNumaNodes() > 1 ? MatrixCurrentNode() : -1;
+        pthread_mutex_lock(&orphan_lock);
+        if(node >= 0) {
+            b = Unlink(&orphans, need, node);
+        }
+        if(b == NULL) {
+            b = Unlink(&orphans, need, -1);
+        }
+        pthread_mutex_unlock(&orphan_lock);
+    }
+    if(b == NULL) {
+        size_t size = need > MATRIX_ARENA_BLOCK ? need : MATRIX_ARENA_BLOCK;
+        b = MatrixAlloc(MATRIX_ALIGN + size);
+        if(b == NULL) {
+            return NULL;
+        }
+        b->size = size;
+        b->node = MatrixCurrentNode();
+    }
+    if(!arena.registered) {
+        pthread_once(&exit_once, CreateExitKey);
+        pthread_setspecific(exit_key, &arena);
+        arena.registered = 1;
+    }
+    return b;
+}
+
+/**
+ * MatrixArenaMark records the current position of the calling thread's
+ * arena.
+ *
+ * @return: the position, to be passed to MatrixArenaRelease()
+ */
+MatrixArenaPos MatrixArenaMark(void)
+{
+    MatrixArenaPos pos = {arena.top, arena.used};
+    return pos;
+}
+
+/**
+ * MatrixArenaAlloc takes scratch memory from the calling thread's arena.
+ *
+ * @param: size, the number of bytes
+ *
+ * @return: a MATRIX_ALIGN-aligned pointer, valid until the arena is
+ *          released past it, or NULL if memory ran out
+ */
+void *MatrixArenaAlloc(size_t size)
+{
+    char *ptr;
+
+    //a zero-byte request still gets its own address
+    size = size > 0 ? ROUND_UP(size) : MATRIX_ALIGN;
+    if(arena.top == NULL || arena.top->size - arena.used < size) {
+        struct Block *b = TakeBlock(size);
+        if(b == NULL) {
+            return NULL;
+        }
+        b->prev = arena.top;
+        arena.top = b;
+        arena.used = 0;
+    }
+    ptr = BLOCK_DATA(arena.top) + arena.used;
+    arena.used += size;
+    return ptr;
+}
+
+/**
+ * MatrixArenaRelease frees everything allocated on the calling thread since
+ * pos was marked.  Marks nest: releasing an outer mark also releases every
+ * inner one.
+ *
+ * @param: pos, a position from MatrixArenaMark() on this thread
+ */
+void MatrixArenaRelease(MatrixArenaPos pos)
+{
+    while(arena.top != pos.block) {
+        struct Block *b = arena.top;
+        arena.top = b->prev;
+        b->prev = arena.spare;
+        arena.spare = b;
+    }
+    arena.used = pos.used;
+}
+
+/**
+ * MatrixArenaTrim returns the calling thread's unused arena blocks, and
+ * those left behind by exited threads, to the allocator.
+ */
+void MatrixArenaTrim(void)
+{
+    struct Block *list;
+
+    pthread_mutex_lock(&orphan_lock);
+    list = orphans;
+    orphans = NULL;
+    pthread_mutex_unlock(&orphan_lock);
+
+    struct Block *chains[2] = {arena.spare, list};
+    for(int c = 0; c < 2; c++) {
+        while(chains[c] != NULL) {
+            struct Block *b = chains[c];
+            chains[c] = b->prev;
+            MatrixFree(b);
+        }
+    }
+    arena.spare = NULL;
+}
+
+/*******************************************************************************
+ * Pools
+ ******************************************************************************/
+
+struct MatrixPool {
+    pthread_mutex_t lock;
+    size_t block_size;      //rounded up to MATRIX_ALIGN
+    int per_slab;
+    void *free_list;        //each free block starts with the next one
+    void *slabs;            //each slab starts with the next one
+};
+
+/**
+ * MatrixPoolCreate creates an empty pool.
+ *
+ * @param: block_size, the size of every block in bytes
+ *
+ * @return: the pool, or NULL if memory ran out
+ */
+MatrixPool *MatrixPoolCreate(size_t block_size)
+{
+    MatrixPool *pool = MatrixAlloc(sizeof(*pool));
+
+    if(pool == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->block_size = block_size > 0 ? ROUND_UP(block_size) : MATRIX_ALIGN;
+    //slabs of about one arena block, but never less than one block
+    pool->per_slab = pool->block_size < MATRIX_ARENA_BLOCK ?
+            (int)(MATRIX_ARENA_BLOCK / pool->block_size) : 1;
+    pool->free_list = NULL;
+    pool->slabs = NULL;
+    return pool;
+}
+
+/**
+ * MatrixPoolGet takes a block from the pool, growing it if it is empty.
+ *
+ * @param: pool, the pool
+ *
+ * @return: a MATRIX_ALIGN-aligned block, or NULL if memory ran out
+ */
+void *MatrixPoolGet(MatrixPool *pool)
+{
+    void *block;
+
+    pthread_mutex_lock(&pool->lock);
+    if(pool->free_list == NULL) {
+        char *slab = MatrixAlloc(MATRIX_ALIGN +
+                (size_t)pool->per_slab * pool->block_size);
+        if(slab == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        *(void **)slab = pool->slabs;
+        pool->slabs = slab;
+        for(int i = pool->per_slab - 1; i >= 0; i--) {
+            void **b = (void **)(slab + MATRIX_ALIGN + i * pool->block_size);
+            *b = pool->free_list;
+            pool->free_list = b;
+        }
+    }
+    block = pool->free_list;
+    pool->free_list = *(void **)block;
+    pthread_mutex_unlock(&pool->lock);
+    return block;
+}
+
+/**
+ * MatrixPoolPut gives a block from MatrixPoolGet() back to its pool.
+ *
+ * @param: pool, the pool
+ * @param: block, the block
+ */
+void MatrixPoolPut(MatrixPool *pool, void *block)
+{
+    pthread_mutex_lock(&pool->lock);
+    *(void **)block = pool->free_list;
+    pool->free_list = block;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * MatrixPoolDestroy frees a pool and all of its blocks, handed out or not.
+ *
+ * @param: pool, the pool, or NULL
+ */
+void MatrixPoolDestroy(MatrixPool *pool)
+{
+    if(pool == NULL) {
+        return;
+    }
+    while(pool->slabs != NULL) {
+        void *slab = pool->slabs;
+        pool->slabs = *(void **)slab;
+        MatrixFree(slab);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    MatrixFree(pool);
+}
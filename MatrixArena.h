@@ -0,0 +1,207 @@
+#ifndef MATRIX_ARENA_H
+#define MATRIX_ARENA_H
+
+/**
+ * @file    MatrixArena.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements the library's memory management.  There are three
+ * layers:
+ *
+ *  - The allocator: every byte the library takes from the system goes
+ *    through MatrixAlloc() / MatrixFree(), which call a pluggable
+ *    struct MatrixAllocator (posix_memalign() and free() by default) and
+ *    count each call.
+ *  - The scratch arena: one bump allocator per thread for temporaries.  A
+ *    function takes a mark, allocates what it needs and releases back to
+ *    the mark before returning.  Released blocks are kept for reuse, so
+ *    once the arena has grown to a workload's peak, repeating that workload
+ *    performs no heap allocations at all (check MatrixAllocGetStats()).
+ *    When a thread exits its blocks are handed to the next thread that
+ *    needs one.
+ *  - Pools: free lists of fixed-size blocks, e.g. one n x n matrix each,
+ *    for buffers that outlive a single call.
+ *
+ * Large batches that several threads will stream through can be allocated
+ * with MatrixAllocPlaced(), which places each thread's share of the batch
+ * on that thread's NUMA node (see MatrixThreads.h).  Arena blocks remember
+ * the node they were created on, and a thread taking over the blocks of an
+ * exited one prefers those of its own node.
+ *
+ * Every pointer handed out is aligned to MATRIX_ALIGN bytes.
+ */
+
+#include <stddef.h>
+
+/**
+ * MATRIX_ALIGN is the alignment of every allocation (one cache line, and
+ * enough for any SIMD load).  MATRIX_ARENA_BLOCK is the size of an arena
+ * block; larger requests get a block of their own.
+ */
+#define MATRIX_ALIGN 64
+#define MATRIX_ARENA_BLOCK (1 << 20)
+
+/**
+ * A user allocator.  alloc returns `size` bytes aligned to `align` (a power
+ * of two), or NULL; free releases a pointer alloc returned.  ctx is passed
+ * to both.
+ */
+struct MatrixAllocator {
+    void *(*alloc)(void *ctx, size_t size, size_t align);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+};
+
+/**
+ * Counters since the program started (or the last reset).
+ */
+struct MatrixAllocStats {
+    unsigned long long allocs;    //successful calls into the allocator
+    unsigned long long frees;     //calls to its free
+    unsigned long long bytes;     //bytes requested by those allocs
+};
+
+/**
+ * MatrixSetAllocator installs the allocator used from now on.  Memory is
+ * always returned to the allocator it came from, so it can be changed at
+ * any time.
+ *
+ * @param: allocator, the allocator (copied), or NULL for the default
+ */
+void MatrixSetAllocator(const struct MatrixAllocator *allocator);
+
+/**
+ * MatrixAlloc / MatrixFree take and return memory through the current
+ * allocator.
+ *
+ * @param: size, the number of bytes
+ *
+ * @return: a MATRIX_ALIGN-aligned pointer, or NULL if the allocator failed
+ */
+void *MatrixAlloc(size_t size);
+void MatrixFree(void *ptr);
+
+/**
+ * MatrixAllocPlaced allocates a batch of `count` items in `planes` planes
+ * of count * elem_size bytes each (a MatrixBatch.h SoA batch has one plane
+ * per element), zero-filled by the workers of a MatrixParallelFor() on
+ * `threads` threads.  Each worker fills items [begin, end) of every plane,
+ * so on a NUMA machine those pages land on its node and a kernel run later
+ * on the same thread count finds its chunk in local memory.  Where the
+ * system allows it the pages are also bound to that node (preferred, not
+ * required), which keeps them there if they were touched before.
+ *
+ * @param: count, the number of items
+ * @param: planes, the number of planes
+ * @param: elem_size, the bytes of one item in one plane
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: a MATRIX_ALIGN-aligned pointer to free with MatrixFree(), or
+ *          NULL if the allocator failed
+ */
+void *MatrixAllocPlaced(int count, int planes, size_t elem_size, int threads);
+
+/**
+ * MatrixNodeOfAddress tells which NUMA node holds the page at ptr.  The
+ * page must have been touched.
+ *
+ * @param: ptr, an address
+ *
+ * @return: the node's number, or -1 if it cannot be told
+ */
+int MatrixNodeOfAddress(const void *ptr);
+
+/**
+ * MatrixAllocGetStats copies the counters into stats.
+ *
+ * @param: stats, pointer to the struct to fill
+ */
+void MatrixAllocGetStats(struct MatrixAllocStats *stats);
+
+/**
+ * MatrixAllocResetStats sets every counter back to zero.
+ */
+void MatrixAllocResetStats(void);
+
+/**
+ * A position in the calling thread's scratch arena.
+ */
+typedef struct {
+    void *block;
+    size_t used;
+} MatrixArenaPos;
+
+/**
+ * MatrixArenaMark records the current position of the calling thread's
+ * arena.
+ *
+ * @return: the position, to be passed to MatrixArenaRelease()
+ */
+MatrixArenaPos MatrixArenaMark(void);
+
+/**
+ * MatrixArenaAlloc takes scratch memory from the calling thread's arena.
+ *
+ * @param: size, the number of bytes
+ *
+ * @return: a MATRIX_ALIGN-aligned pointer, valid until the arena is
+ *          released past it, or NULL if memory ran out
+ */
+void *MatrixArenaAlloc(size_t size);
+
+/**
+ * MatrixArenaRelease frees everything allocated on the calling thread since
+ * pos was marked.  Marks nest: releasing an outer mark also releases every
+ * inner one.
+ *
+ * @param: pos, a position from MatrixArenaMark() on this thread
+ */
+void MatrixArenaRelease(MatrixArenaPos pos);
+
+/**
+ * MatrixArenaTrim returns the calling thread's unused arena blocks, and
+ * those left behind by exited threads, to the allocator.
+ */
+void MatrixArenaTrim(void);
+
+/**
+ * A pool of fixed-size blocks.  Get and Put are thread-safe.
+ */
+typedef struct MatrixPool MatrixPool;
+
+/**
+ * MatrixPoolCreate creates an empty pool.
+ *
+ * @param: block_size, the size of every block in bytes
+ *
+ * @return: the pool, or NULL if memory ran out
+ */
+MatrixPool *MatrixPoolCreate(size_t block_size);
+
+/**
+ * MatrixPoolGet takes a block from the pool, growing it if it is empty.
+ *
+ * @param: pool, the pool
+ *
+ * @return: a MATRIX_ALIGN-aligned block, or NULL if memory ran out
+ */
+void *MatrixPoolGet(MatrixPool *pool);
+
+/**
+ * MatrixPoolPut gives a block from MatrixPoolGet() back to its pool.
+ *
+ * @param: pool, the pool
+ * @param: block, the block
+ */
+void MatrixPoolPut(MatrixPool *pool, void *block);
+
+/**
+ * MatrixPoolDestroy frees a pool and all of its blocks, handed out or not.
+ *
+ * @param: pool, the pool, or NULL
+ */
+void MatrixPoolDestroy(MatrixPool *pool);
+
+#endif // MATRIX_ARENA_H
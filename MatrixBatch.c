@@ -0,0 +1,45 @@
+/**
+ * @file    MatrixBatch.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stddef.h>
+#include "MatrixBatch.h"
+
+/**
+ * MatrixBatchToSoA converts `count` row-major 3x3 matrices to SoA.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, an array of count 3x3 matrices
+ * @param: soa, 9 * count floats that are modified to hold the batch
+ */
+void MatrixBatchToSoA(int count, float mats[][3][3], float *soa)
+{
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            float *plane = MATRIX_SOA(soa, count, i, j);
+            for(int b = 0; b < count; b++) {
+                plane[b] = mats[b][i][j];
+            }
+        }
+    }
+}
+
+/**
+ * MatrixBatchFromSoA converts a SoA batch back to row-major 3x3 matrices.
+ *
+ * @param: count, the number of matrices
+ * @param: soa, 9 * count floats holding the batch
+ * @param: mats, an array of count 3x3 matrices that is modified
+ */
+void MatrixBatchFromSoA(int count, const float *soa, float mats[][3][3])
+{
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            const float *plane = MATRIX_SOA(soa, count, i, j);
+            for(int b = 0; b < count; b++) {
+                mats[b][i][j] = plane[b];
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MATRIX_BATCH_H
+#define MATRIX_BATCH_H
+
+/**
+ * @file    MatrixBatch.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file defines the structure-of-arrays (SoA) layout used by the batched
+ * 3x3 kernels.  A batch of `count` 3x3 matrices is stored as nine planes of
+ * `count` floats, one plane per element, so that
+ *
+ *   element (i, j) of matrix b  is  soa[(i * DIM + j) * count + b].
+ *
+ * In this layout the same element of consecutive matrices is contiguous, and
+ * a loop over b does identical arithmetic on neighbouring floats, which the
+ * compiler turns into SIMD code across matrices.  Vectors (a batch of 3-long
+ * vectors) use three planes the same way: component i of vector b is
+ * vec[i * count + b].
+ */
+
+#include <stddef.h>
+#include "MatrixMath.h"
+
+/**
+ * MATRIX_SOA points at the plane holding element (i, j) of every matrix.
+ */
+#define MATRIX_SOA(soa, count, i, j) ((soa) + ((i) * DIM + (j)) * (size_t)(count))
+
+/**
+ * MatrixBatchToSoA converts `count` row-major 3x3 matrices to SoA.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, an array of count 3x3 matrices
+ * @param: soa, 9 * count floats that are modified to hold the batch
+ */
+void MatrixBatchToSoA(int count, float mats[][3][3], float *soa);
+
+/**
+ * MatrixBatchFromSoA converts a SoA batch back to row-major 3x3 matrices.
+ *
+ * @param: count, the number of matrices
+ * @param: soa, 9 * count floats holding the batch
+ * @param: mats, an array of count 3x3 matrices that is modified
+ */
+void MatrixBatchFromSoA(int count, const float *soa, float mats[][3][3]);
+
+#endif // MATRIX_BATCH_H
@@ -0,0 +1,245 @@
+/**
+ * @file    MatrixBench.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "MatrixBench.h"
+
+static const char *counter_names[] = {"cycles", "instr", "L1-miss",
+        "LLC-miss", "br-miss", "vector"};
+
+static int use_counters;
+static int opened;                          //whether the fds were tried
+static int fds[MATRIX_BENCH_COUNTERS];      //-1 where unavailable
+
+/**
+ * MatrixBenchNow reads a monotonic clock.
+ *
+ * @return: the time in seconds since an arbitrary fixed point
+ */
+double MatrixBenchNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*******************************************************************************
+ * Counters
+ ******************************************************************************/
+
+//the raw config of the vector event, or 0 if this CPU has no known one
+static unsigned long long VectorEvent(void)
+{
+    const char *custom = getenv("MML_PERF_VECTOR_EVENT");
+
+    if(custom != NULL) {
+        return strtoull(custom, NULL, 0);
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, vendor[3];
+    if(__get_cpuid(0, &eax, &vendor[0], &vendor[2], &vendor[1]) &&
+            memcmp(vendor, "GenuineIntel", 12) == 0) {
+        //FP_ARITH_INST_RETIRED, every packed width (Skylake and later)
+        return 0xfcc7;
+    }
+#endif
+    return 0;
+}
+
+static int OpenCounter(int counter)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch(counter) {
+    case MATRIX_BENCH_CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case MATRIX_BENCH_INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case MATRIX_BENCH_L1_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D |
+                PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        break;
+    case MATRIX_BENCH_LLC_MISSES:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case MATRIX_BENCH_BRANCH_MISSES:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    default:
+        attr.type = PERF_TYPE_RAW;
+        attr.config = VectorEvent();
+        if(attr.config == 0) {
+            return -1;
+        }
+    }
+    //counted separately rather than as a group, so that six events never
+    //have to fit the PMU at once; the times let multiplexing be undone
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+            PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * MatrixBenchUseCounters turns counting on or off for later runs.
+ *
+ * @param: enable, nonzero to read the counters
+ *
+ * @return: a bitmask of the counters that can be read here (0 if none, or
+ *          if counting is off)
+ */
+int MatrixBenchUseCounters(int enable)
+{
+    int available = 0;
+
+    use_counters = enable;
+    if(!enable) {
+        return 0;
+    }
+    if(!opened) {
+        for(int c = 0; c < MATRIX_BENCH_COUNTERS; c++) {
+            fds[c] = OpenCounter(c);
+        }
+        opened = 1;
+    }
+    for(int c = 0; c < MATRIX_BENCH_COUNTERS; c++) {
+        available |= (fds[c] >= 0) << c;
+    }
+    return available;
+}
+
+static void StartCounters(void)
+{
+    for(int c = 0; use_counters && c < MATRIX_BENCH_COUNTERS; c++) {
+        if(fds[c] >= 0) {
+            ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void StopCounters(struct MatrixBenchResult *result)
+{
+    result->counted = 0;
+    for(int c = 0; c < MATRIX_BENCH_COUNTERS; c++) {
+        unsigned long long v[3];    //value, time enabled, time running
+        result->per_call[c] = 0;
+        if(!use_counters || fds[c] < 0) {
+            continue;
+        }
+        ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+        if(read(fds[c], v, sizeof(v)) != sizeof(v) || v[2] == 0) {
+            continue;
+        }
+        result->per_call[c] = (double)v[0] * v[1] / v[2] / result->calls;
+        result->counted |= 1 << c;
+    }
+}
+
+/**
+ * MatrixBenchRun times fn.  The first call is a warm-up; it only counts if
+ * it already took at least min_seconds, so very slow functions run once.
+ *
+ * @param: name, a label for the report
+ * @param: fn, the function to measure
+ * @param: arg, passed to fn
+ * @param: items, the units of work one call does
+ * @param: min_seconds, how long to keep calling fn
+ * @param: result, modified to hold the measurement
+ */
+void MatrixBenchRun(const char *name, MatrixBenchFn fn, void *arg, long items,
+        double min_seconds, struct MatrixBenchResult *result)
+{
+    double start, elapsed;
+    long calls = 1;
+
+    StartCounters();
+    start = MatrixBenchNow();
+    fn(arg);
+    elapsed = MatrixBenchNow() - start;
+    if(elapsed < min_seconds) {
+        calls = 0;
+        StartCounters();
+        start = MatrixBenchNow();
+        do {
+            fn(arg);
+            calls++;
+            elapsed = MatrixBenchNow() - start;
+        } while(elapsed < min_seconds);
+    }
+
+    result->name = name;
+    result->calls = calls;
+    result->items = items;
+    result->seconds = elapsed;
+    result->ns_per_call = elapsed * 1e9 / calls;
+    result->ns_per_item = result->ns_per_call / (items > 0 ? items : 1);
+    StopCounters(result);
+}
+
+/**
+ * MatrixBenchPrint prints one line for a measurement, followed by the
+ * counters per call and per item if they were read.  MatrixBenchHeader
+ * prints the matching column titles.
+ */
+void MatrixBenchHeader(void)
+{
+    printf("%-32s %10s %16s %14s\n", "benchmark", "calls", "ns/call",
+            "ns/item");
+}
+
+void MatrixBenchPrint(const struct MatrixBenchResult *result)
+{
+    printf("%-32s %10ld %16.1f %14.3f\n", result->name, result->calls,
+            result->ns_per_call, result->ns_per_item);
+    if(!use_counters || result->counted == 0) {
+        return;
+    }
+    for(int per_item = 0; per_item < 2; per_item++) {
+        double scale = per_item && result->items > 0 ? result->items : 1;
+        printf("  per %-5s", per_item ? "item" : "call");
+        for(int c = 0; c < MATRIX_BENCH_COUNTERS; c++) {
+            if(result->counted & (1 << c)) {
+                printf(" %s %.4g", counter_names[c],
+                        result->per_call[c] / scale);
+            } else {
+                printf(" %s n/a", counter_names[c]);
+            }
+            //IPC right after the two counts it comes from
+            if(c == MATRIX_BENCH_INSTRUCTIONS && per_item == 0) {
+                int both = 1 << MATRIX_BENCH_CYCLES |
+                        1 << MATRIX_BENCH_INSTRUCTIONS;
+                if((result->counted & both) == both) {
+                    printf(" IPC %.2f", result->per_call[c] /
+                            result->per_call[MATRIX_BENCH_CYCLES]);
+                } else {
+                    printf(" IPC n/a");
+                }
+            }
+        }
+        printf("\n");
+    }
+}
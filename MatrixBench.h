@@ -0,0 +1,92 @@
+#ifndef MATRIX_BENCH_H
+#define MATRIX_BENCH_H
+
+/**
+ * @file    MatrixBench.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements the timing harness behind mml_bench.  A measured
+ * function is called back to back until a minimum time has passed, and the
+ * time is reported per call and per item (matrix, element, ...) processed
+ * by a call.
+ *
+ * With counters enabled, the hardware performance counters of
+ * perf_event_open(2) are read over the same calls, so a slow kernel can be
+ * told apart as stalling (low IPC), missing the caches or mispredicting.
+ * The counters follow the threads a kernel starts, and are scaled if the
+ * kernel had to share them with other events.  Any counter that cannot be
+ * opened (no PMU in a VM or container, perf_event_paranoid, an unknown CPU
+ * for the vector event) is reported as n/a and the timing goes on as usual.
+ */
+
+/**
+ * A measured function: one call does `items` units of work on arg.
+ */
+typedef void (*MatrixBenchFn)(void *arg);
+
+/**
+ * The hardware counters.  MATRIX_BENCH_VECTOR counts retired floating-point
+ * SIMD instructions (FP_ARITH_INST_RETIRED on Intel); on other CPUs it needs
+ * MML_PERF_VECTOR_EVENT, a raw perf event config such as 0xfcc7.
+ */
+#define MATRIX_BENCH_CYCLES 0
+#define MATRIX_BENCH_INSTRUCTIONS 1
+#define MATRIX_BENCH_L1_MISSES 2
+#define MATRIX_BENCH_LLC_MISSES 3
+#define MATRIX_BENCH_BRANCH_MISSES 4
+#define MATRIX_BENCH_VECTOR 5
+#define MATRIX_BENCH_COUNTERS 6
+
+struct MatrixBenchResult {
+    const char *name;
+    long calls;
+    long items;             //per call
+    double seconds;         //total over all calls
+    double ns_per_call;
+    double ns_per_item;
+    int counted;            //bit c set if counter c was read
+    double per_call[MATRIX_BENCH_COUNTERS];
+};
+
+/**
+ * MatrixBenchNow reads a monotonic clock.
+ *
+ * @return: the time in seconds since an arbitrary fixed point
+ */
+double MatrixBenchNow(void);
+
+/**
+ * MatrixBenchUseCounters turns counting on or off for later runs.
+ *
+ * @param: enable, nonzero to read the counters
+ *
+ * @return: a bitmask of the counters that can be read here (0 if none, or
+ *          if counting is off)
+ */
+int MatrixBenchUseCounters(int enable);
+
+/**
+ * MatrixBenchRun times fn.  The first call is a warm-up; it only counts if
+ * it already took at least min_seconds, so very slow functions run once.
+ *
+ * @param: name, a label for the report
+ * @param: fn, the function to measure
+ * @param: arg, passed to fn
+ * @param: items, the units of work one call does
+ * @param: min_seconds, how long to keep calling fn
+ * @param: result, modified to hold the measurement
+ */
+void MatrixBenchRun(const char *name, MatrixBenchFn fn, void *arg, long items,
+        double min_seconds, struct MatrixBenchResult *result);
+
+/**
+ * MatrixBenchPrint prints one line for a measurement, followed by the
+ * counters per call and per item if they were read.  MatrixBenchHeader
+ * prints the matching column titles.
+ */
+void MatrixBenchHeader(void);
+void MatrixBenchPrint(const struct MatrixBenchResult *result);
+
+#endif // MATRIX_BENCH_H
@@ -0,0 +1,228 @@
+/**
+ * @file    MatrixCache.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "MatrixMath.h"
+#include "MatrixArena.h"
+#include "MatrixCache.h"
+
+#define CACHE_SHARDS 64
+#define CACHE_WAYS 8
+
+#define ENTRY_USED 0x1
+#define ENTRY_REFERENCED 0x2
+#define ENTRY_HAS_DET 0x4
+#define ENTRY_HAS_INVERSE 0x8
+#define ENTRY_SINGULAR 0x10
+
+struct Entry {
+    uint32_t key[DIM * DIM];
+    uint32_t flags;
+    float det;
+    float inverse[3][3];
+};
+
+struct Shard {
+    pthread_mutex_t lock;
+    struct Entry *entries; //num_sets * CACHE_WAYS
+    size_t num_sets;
+    unsigned char *hand; //CLOCK hand per set
+    unsigned long long hits, misses, evictions;
+};
+
+static struct Shard shards[CACHE_SHARDS];
+static size_t cache_capacity;
+
+//murmur3-style mix of the nine words, cheap enough for a 36-byte key
+static uint64_t HashKey(const uint32_t key[DIM * DIM])
+{
+    uint64_t h = 0x9E3779B97F4A7C15ULL;
+    for(int k = 0; k < DIM * DIM; k++) {
+        h ^= key[k];
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+int MatrixCacheInit(size_t capacity)
+{
+    size_t sets;
+
+    MatrixCacheFree();
+    if(capacity == 0) {
+        return 1;
+    }
+    sets = (capacity + CACHE_SHARDS * CACHE_WAYS - 1) /
+            (CACHE_SHARDS * CACHE_WAYS);
+    for(int s = 0; s < CACHE_SHARDS; s++) {
+        struct Shard *sh = &shards[s];
+        sh->entries = MatrixAlloc(sets * CACHE_WAYS * sizeof(*sh->entries));
+        sh->hand = MatrixAlloc(sets);
+        if(sh->entries == NULL || sh->hand == NULL) {
+            MatrixFree(sh->entries);
+            MatrixFree(sh->hand);
+            sh->entries = NULL;
+            sh->hand = NULL;
+            MatrixCacheFree();
+            return 0;
+        }
+        memset(sh->entries, 0, sets * CACHE_WAYS * sizeof(*sh->entries));
+        memset(sh->hand, 0, sets);
+        sh->num_sets = sets;
+        pthread_mutex_init(&sh->lock, NULL);
+    }
+    cache_capacity = sets * CACHE_WAYS * CACHE_SHARDS;
+    return 1;
+}
+
+void MatrixCacheFree(void)
+{
+    for(int s = 0; s < CACHE_SHARDS; s++) {
+        struct Shard *sh = &shards[s];
+        if(sh->entries != NULL) {
+            pthread_mutex_destroy(&sh->lock);
+        }
+        MatrixFree(sh->entries);
+        MatrixFree(sh->hand);
+        memset(sh, 0, sizeof(*sh));
+    }
+    cache_capacity = 0;
+}
+
+void MatrixCacheGetStats(struct MatrixCacheStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for(int s = 0; s < CACHE_SHARDS; s++) {
+        struct Shard *sh = &shards[s];
+        if(sh->entries == NULL) {
+            continue;
+        }
+        pthread_mutex_lock(&sh->lock);
+        stats->hits += sh->hits;
+        stats->misses += sh->misses;
+        stats->evictions += sh->evictions;
+        pthread_mutex_unlock(&sh->lock);
+    }
+    stats->capacity = cache_capacity;
+}
+
+/**
+ * Finds the entry for key, claiming a slot through CLOCK eviction if it is
+ * not present.  Called with the shard locked; a fresh entry has no cached
+ * values yet (neither ENTRY_HAS_DET nor ENTRY_HAS_INVERSE).
+ */
+static struct Entry *Lookup(struct Shard *sh, uint64_t hash,
+        const uint32_t key[DIM * DIM])
+{
+    size_t set = (hash >> 6) % sh->num_sets;
+    struct Entry *ways = &sh->entries[set * CACHE_WAYS];
+    struct Entry *victim;
+
+    for(int w = 0; w < CACHE_WAYS; w++) {
+        if((ways[w].flags & ENTRY_USED) &&
+                memcmp(ways[w].key, key, sizeof(ways[w].key)) == 0) {
+            ways[w].flags |= ENTRY_REFERENCED;
+            return &ways[w];
+        }
+    }
+
+    //sweep the hand, giving referenced entries a second chance
+    for(;;) {
+        victim = &ways[sh->hand[set]];
+        sh->hand[set] = (sh->hand[set] + 1) % CACHE_WAYS;
+        if(!(victim->flags & ENTRY_REFERENCED)) {
+            break;
+        }
+        victim->flags &= ~ENTRY_REFERENCED;
+    }
+    if(victim->flags & ENTRY_USED) {
+        sh->evictions++;
+    }
+    memcpy(victim->key, key, sizeof(victim->key));
+    victim->flags = ENTRY_USED | ENTRY_REFERENCED;
+    return victim;
+}
+
+void MatrixInverseCached(float mat[3][3], float result[3][3])
+{
+    uint32_t key[DIM * DIM];
+    uint64_t hash;
+    struct Shard *sh;
+    struct Entry *e;
+    float inverse[3][3];
+
+    if(cache_capacity == 0) {
+        MatrixInverse(mat, result);
+        return;
+    }
+    memcpy(key, mat, sizeof(key));
+    hash = HashKey(key);
+    sh = &shards[hash % CACHE_SHARDS];
+
+    pthread_mutex_lock(&sh->lock);
+    e = Lookup(sh, hash, key);
+    if(e->flags & ENTRY_HAS_INVERSE) {
+        sh->hits++;
+        if(!(e->flags & ENTRY_SINGULAR)) {
+            memcpy(result, e->inverse, sizeof(e->inverse));
+        }
+        pthread_mutex_unlock(&sh->lock);
+        return;
+    }
+    sh->misses++;
+    pthread_mutex_unlock(&sh->lock);
+
+    //the cofactor work runs unlocked; the slot may be stolen meanwhile
+    memset(inverse, 0, sizeof(inverse));
+    float det = MatrixDeterminant(mat);
+    if(det != 0) {
+        MatrixInverse(mat, inverse);
+        memcpy(result, inverse, sizeof(inverse));
+    }
+
+    pthread_mutex_lock(&sh->lock);
+    e = Lookup(sh, hash, key);
+    e->det = det;
+    memcpy(e->inverse, inverse, sizeof(inverse));
+    e->flags |= ENTRY_HAS_DET | ENTRY_HAS_INVERSE |
+            (det == 0 ? ENTRY_SINGULAR : 0);
+    pthread_mutex_unlock(&sh->lock);
+}
+
+float MatrixDeterminantCached(float mat[3][3])
+{
+    uint32_t key[DIM * DIM];
+    uint64_t hash;
+    struct Shard *sh;
+    struct Entry *e;
+    float det;
+
+    if(cache_capacity == 0) {
+        return MatrixDeterminant(mat);
+    }
+    memcpy(key, mat, sizeof(key));
+    hash = HashKey(key);
+    sh = &shards[hash % CACHE_SHARDS];
+
+    pthread_mutex_lock(&sh->lock);
+    e = Lookup(sh, hash, key);
+    if(e->flags & ENTRY_HAS_DET) {
+        sh->hits++;
+        det = e->det;
+    } else {
+        sh->misses++;
+        det = MatrixDeterminant(mat);
+        e->det = det;
+        e->flags |= ENTRY_HAS_DET;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return det;
+}
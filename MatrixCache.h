@@ -0,0 +1,81 @@
+#ifndef MATRIX_CACHE_H
+#define MATRIX_CACHE_H
+
+/**
+ * @file    MatrixCache.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements an optional, bounded memoization cache in front of
+ * MatrixInverse() and MatrixDeterminant() for workloads that keep inverting
+ * the same matrices.
+ *
+ * Entries are keyed by the exact bit pattern of the 36-byte matrix, so a hit
+ * returns exactly what the uncached call would have.  The cache is split into
+ * independently locked shards, each a set-associative table with CLOCK
+ * eviction inside a set, so many threads can look up at once.
+ *
+ * MatrixCacheInit() and MatrixCacheFree() must not race with lookups.  While
+ * the cache is not initialized the cached functions simply forward to the
+ * uncached ones.
+ */
+
+#include <stddef.h>
+
+/**
+ * Hit/miss counters, summed over all shards.
+ */
+struct MatrixCacheStats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    size_t capacity;
+};
+
+/**
+ * MatrixCacheInit allocates the cache.
+ *
+ * @param: capacity, the maximum number of matrices held, rounded up to fill
+ *         whole sets.  0 disables the cache.
+ *
+ * @return: 1 on success, 0 if the allocation failed (cache left disabled)
+ *
+ * Calling it again replaces the cache and resets the counters.
+ */
+int MatrixCacheInit(size_t capacity);
+
+/**
+ * MatrixCacheFree releases the cache and disables it.
+ */
+void MatrixCacheFree(void);
+
+/**
+ * MatrixCacheGetStats copies the current counters into stats.
+ *
+ * @param: stats, pointer to the struct to fill
+ */
+void MatrixCacheGetStats(struct MatrixCacheStats *stats);
+
+/**
+ * MatrixInverseCached is MatrixInverse() behind the cache.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         inverse of mat
+ * @return: none
+ *
+ * Like MatrixInverse(), result is left untouched if mat is singular.
+ */
+void MatrixInverseCached(float mat[3][3], float result[3][3]);
+
+/**
+ * MatrixDeterminantCached is MatrixDeterminant() behind the cache.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ *
+ * @return: the determinant of mat
+ */
+float MatrixDeterminantCached(float mat[3][3]);
+
+#endif // MATRIX_CACHE_H
@@ -0,0 +1,374 @@
+/**
+ * @file    MatrixChain.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "MatrixN.h"
+#include "MatrixArena.h"
+#include "MatrixThreads.h"
+#include "MatrixChain.h"
+
+/**
+ * One multiplication in the plan.  A child is either another node (index
+ * >= 0) or matrix i of the chain (encoded as -(i + 1)).
+ */
+struct Node {
+    int left, right;
+    int rows, inner, cols;
+    size_t offset; //into scratch; the root writes to result instead
+    double flops;  //multiply-adds of the whole subtree
+};
+
+struct MatrixChainPlan {
+    int count;
+    int *dims;
+    struct Node *nodes;
+    int num_nodes;
+    int root;
+    size_t scratch;
+    double planned, left_to_right;
+    int cached;     //in the cache; otherwise freed by its last release
+    int users;      //MatrixChainPlanGet() calls not yet released
+    int referenced; //used since the CLOCK hand last passed it
+};
+
+struct Execution {
+    const MatrixChainPlan *plan;
+    const struct MatrixView *mats;
+    float *result;
+    float *scratch;
+};
+
+//the two independent operands of a heavy split
+struct Split {
+    const struct Execution *ex;
+    int child[2];
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static MatrixChainPlan *cache[MATRIX_CHAIN_CACHE_SIZE];
+static int cache_hand;
+
+//turns the split table into nodes, children first; returns the child code
+static int BuildNodes(MatrixChainPlan *plan, const int *split, int i, int j)
+{
+    int n = plan->count;
+    int k, left, right, index;
+    struct Node *node;
+
+    if(i == j) {
+        return -(i + 1);
+    }
+    k = split[i * n + j];
+    left = BuildNodes(plan, split, i, k);
+    right = BuildNodes(plan, split, k + 1, j);
+
+    index = plan->num_nodes++;
+    node = &plan->nodes[index];
+    node->left = left;
+    node->right = right;
+    node->rows = plan->dims[i];
+    node->inner = plan->dims[k + 1];
+    node->cols = plan->dims[j + 1];
+    node->flops = (double)node->rows * node->inner * node->cols;
+    if(left >= 0) {
+        node->flops += plan->nodes[left].flops;
+    }
+    if(right >= 0) {
+        node->flops += plan->nodes[right].flops;
+    }
+    node->offset = plan->scratch;
+    plan->scratch += (size_t)node->rows * node->cols;
+    return index;
+}
+
+static MatrixChainPlan *BuildPlan(int count, const int *dims)
+{
+    MatrixArenaPos pos = MatrixArenaMark();
+    MatrixChainPlan *plan = MatrixAlloc(sizeof(*plan));
+    double *cost = MatrixArenaAlloc((size_t)count * count * sizeof(double));
+    int *split = MatrixArenaAlloc((size_t)count * count * sizeof(int));
+
+    if(plan == NULL || cost == NULL || split == NULL) {
+        goto fail;
+    }
+    memset(plan, 0, sizeof(*plan));
+    memset(cost, 0, (size_t)count * count * sizeof(double));
+    plan->count = count;
+    plan->dims = MatrixAlloc((count + 1) * sizeof(int));
+    plan->nodes = MatrixAlloc((count > 1 ? count - 1 : 1) * sizeof(struct Node));
+    if(plan->dims == NULL || plan->nodes == NULL) {
+        goto fail;
+    }
+    memcpy(plan->dims, dims, (count + 1) * sizeof(int));
+
+    //cost[i][j] = cheapest product of matrices i..j, split after split[i][j]
+    for(int len = 2; len <= count; len++) {
+        for(int i = 0; i + len - 1 < count; i++) {
+            int j = i + len - 1;
+            cost[i * count + j] = -1;
+            for(int k = i; k < j; k++) {
+                double c = cost[i * count + k] + cost[(k + 1) * count + j] +
+                        (double)dims[i] * dims[k + 1] * dims[j + 1];
+                if(cost[i * count + j] < 0 || c < cost[i * count + j]) {
+                    cost[i * count + j] = c;
+                    split[i * count + j] = k;
+                }
+            }
+        }
+    }
+    plan->planned = cost[count - 1];
+    for(int k = 1; k < count; k++) {
+        plan->left_to_right += (double)dims[0] * dims[k] * dims[k + 1];
+    }
+
+    plan->root = BuildNodes(plan, split, 0, count - 1);
+    if(plan->root >= 0) {
+        //the root writes straight to result and needs no scratch
+        plan->scratch -= (size_t)plan->nodes[plan->root].rows *
+                plan->nodes[plan->root].cols;
+    }
+    MatrixArenaRelease(pos);
+    return plan;
+
+fail:
+    if(plan != NULL) {
+        MatrixFree(plan->dims);
+        MatrixFree(plan->nodes);
+    }
+    MatrixFree(plan);
+    MatrixArenaRelease(pos);
+    return NULL;
+}
+
+static void FreePlan(MatrixChainPlan *plan)
+{
+    MatrixFree(plan->dims);
+    MatrixFree(plan->nodes);
+    MatrixFree(plan);
+}
+
+//the cached plan for a shape, taken for one more user; under cache_lock
+static MatrixChainPlan *Lookup(int count, const int *dims)
+{
+    for(int c = 0; c < MATRIX_CHAIN_CACHE_SIZE; c++) {
+        MatrixChainPlan *plan = cache[c];
+        if(plan != NULL && plan->count == count &&
+                memcmp(plan->dims, dims, (count + 1) * sizeof(int)) == 0) {
+            plan->users++;
+            plan->referenced = 1;
+            return plan;
+        }
+    }
+    return NULL;
+}
+
+//puts a new plan in the cache, evicting through CLOCK once it is full; an
+//evicted plan still in use is freed by its last release; under cache_lock
+static void Insert(MatrixChainPlan *plan)
+{
+    MatrixChainPlan *victim;
+
+    //sweep the hand, giving referenced plans a second chance
+    for(;;) {
+        victim = cache[cache_hand];
+        if(victim == NULL || !victim->referenced) {
+            break;
+        }
+        victim->referenced = 0;
+        cache_hand = (cache_hand + 1) % MATRIX_CHAIN_CACHE_SIZE;
+    }
+    if(victim != NULL) {
+        victim->cached = 0;
+        if(victim->users == 0) {
+            FreePlan(victim);
+        }
+    }
+    plan->cached = 1;
+    plan->referenced = 1;
+    cache[cache_hand] = plan;
+    cache_hand = (cache_hand + 1) % MATRIX_CHAIN_CACHE_SIZE;
+}
+
+MatrixChainPlan *MatrixChainPlanGet(int count, const int *dims)
+{
+    MatrixChainPlan *plan, *found;
+
+    if(count < 1) {
+        return NULL;
+    }
+    pthread_mutex_lock(&cache_lock);
+    plan = Lookup(count, dims);
+    pthread_mutex_unlock(&cache_lock);
+    if(plan != NULL) {
+        return plan;
+    }
+
+    //the O(count^3) planning runs outside the lock so that it does not hold
+    //up callers of other shapes; if another thread planned the same shape
+    //meanwhile, its plan is used and this one dropped
+    plan = BuildPlan(count, dims);
+    if(plan == NULL) {
+        return NULL;
+    }
+    plan->users = 1;
+    pthread_mutex_lock(&cache_lock);
+    found = Lookup(count, dims);
+    if(found == NULL) {
+        Insert(plan);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    if(found != NULL) {
+        FreePlan(plan);
+        return found;
+    }
+    return plan;
+}
+
+void MatrixChainPlanRelease(MatrixChainPlan *plan)
+{
+    int last;
+
+    if(plan == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&cache_lock);
+    last = --plan->users == 0 && !plan->cached;
+    pthread_mutex_unlock(&cache_lock);
+    if(last) {
+        FreePlan(plan);
+    }
+}
+
+void MatrixChainCacheFree(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    for(int c = 0; c < MATRIX_CHAIN_CACHE_SIZE; c++) {
+        if(cache[c] != NULL) {
+            FreePlan(cache[c]);
+            cache[c] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+size_t MatrixChainScratchSize(const MatrixChainPlan *plan)
+{
+    return plan->scratch;
+}
+
+void MatrixChainCost(const MatrixChainPlan *plan, double *planned,
+        double *left_to_right)
+{
+    *planned = plan->planned;
+    *left_to_right = plan->left_to_right;
+}
+
+static void RunNode(const struct Execution *ex, int index);
+
+static void RunChildren(void *arg, int begin, int end)
+{
+    struct Split *split = arg;
+
+    for(int i = begin; i < end; i++) {
+        RunNode(split->ex, split->child[i]);
+    }
+}
+
+static const float *Operand(const struct Execution *ex, int child)
+{
+    if(child < 0) {
+        return ex->mats[-child - 1].data;
+    }
+    return ex->scratch + ex->plan->nodes[child].offset;
+}
+
+static int Heavy(const MatrixChainPlan *plan, int child)
+{
+    return child >= 0 &&
+            plan->nodes[child].flops >= MATRIX_CHAIN_PARALLEL_FLOPS;
+}
+
+//computes both operands (on two MatrixParallelFor() workers if both are
+//heavy) and then this node's product
+static void RunNode(const struct Execution *ex, int index)
+{
+    const struct Node *node = &ex->plan->nodes[index];
+    float *out = (index == ex->plan->root) ? ex->result :
+            ex->scratch + node->offset;
+
+    if(Heavy(ex->plan, node->left) && Heavy(ex->plan, node->right)) {
+        struct Split split = {ex, {node->left, node->right}};
+        MatrixParallelFor(2, 0, RunChildren, &split);
+    } else {
+        if(node->left >= 0) {
+            RunNode(ex, node->left);
+        }
+        if(node->right >= 0) {
+            RunNode(ex, node->right);
+        }
+    }
+    MatrixNMultiply(node->rows, node->inner, node->cols,
+            Operand(ex, node->left), Operand(ex, node->right), out);
+}
+
+int MatrixChainExecute(const MatrixChainPlan *plan,
+        const struct MatrixView *mats, float *result, float *scratch)
+{
+    struct Execution ex = {plan, mats, result, scratch};
+
+    for(int i = 0; i < plan->count; i++) {
+        if(mats[i].rows != plan->dims[i] || mats[i].cols != plan->dims[i + 1]) {
+            return 0;
+        }
+    }
+    if(plan->root < 0) {
+        memcpy(result, mats[0].data,
+                (size_t)mats[0].rows * mats[0].cols * sizeof(float));
+        return 1;
+    }
+    RunNode(&ex, plan->root);
+    return 1;
+}
+
+int MatrixChainMultiply(int count, const struct MatrixView *mats,
+        float *result)
+{
+    MatrixArenaPos pos = MatrixArenaMark();
+    MatrixChainPlan *plan;
+    float *scratch;
+    int *dims;
+    int ok = 0;
+
+    if(count < 1) {
+        return 0;
+    }
+    dims = MatrixArenaAlloc((count + 1) * sizeof(int));
+    if(dims == NULL) {
+        return 0;
+    }
+    for(int i = 0; i < count; i++) {
+        if(i > 0 && mats[i].rows != mats[i - 1].cols) {
+            MatrixArenaRelease(pos);
+            return 0;
+        }
+        dims[i] = mats[i].rows;
+    }
+    dims[count] = mats[count - 1].cols;
+
+    plan = MatrixChainPlanGet(count, dims);
+    if(plan == NULL) {
+        MatrixArenaRelease(pos);
+        return 0;
+    }
+    scratch = MatrixArenaAlloc(MatrixChainScratchSize(plan) * sizeof(float));
+    if(scratch != NULL) {
+        ok = MatrixChainExecute(plan, mats, result, scratch);
+    }
+    MatrixArenaRelease(pos);
+    MatrixChainPlanRelease(plan);
+    return ok;
+}
@@ -0,0 +1,120 @@
+#ifndef MATRIX_CHAIN_H
+#define MATRIX_CHAIN_H
+
+/**
+ * @file    MatrixChain.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements products of long chains of matrices with mixed
+ * shapes (3x3, 3xN, Nx3, NxN, ...).  Multiplying left to right can cost
+ * orders of magnitude more work than the best parenthesization, so the
+ * chain is first planned with the classic O(count^3) dynamic program over
+ * the dimensions and then executed as a tree of MatrixNMultiply() calls.
+ *
+ * Plans depend only on the shape of the chain and are cached, so a chain
+ * that repeats every frame pays for the dynamic program once.  Execution
+ * writes every intermediate product into one caller-provided scratch
+ * buffer, and the two halves of a large split run on separate threads
+ * since, by associativity, they do not depend on each other.
+ */
+
+#include <stddef.h>
+
+/**
+ * A read-only row-major matrix.  A float[3][3] `m` is the view
+ * {&m[0][0], 3, 3}.
+ */
+struct MatrixView {
+    const float *data;
+    int rows;
+    int cols;
+};
+
+/**
+ * Sub-products estimated at fewer multiply-adds than this run on the
+ * calling thread.
+ */
+#define MATRIX_CHAIN_PARALLEL_FLOPS (1 << 21)
+
+/**
+ * Number of distinct chain shapes whose plans are kept.  Once it is full,
+ * a new shape evicts a plan that has not been used recently (CLOCK).
+ */
+#define MATRIX_CHAIN_CACHE_SIZE 64
+
+typedef struct MatrixChainPlan MatrixChainPlan;
+
+/**
+ * MatrixChainPlanGet returns the plan for a chain of `count` matrices where
+ * matrix i is dims[i] x dims[i + 1].
+ *
+ * @param: count, the number of matrices in the chain
+ * @param: dims, count + 1 dimensions
+ *
+ * @return: the plan, or NULL if count < 1 or memory ran out
+ *
+ * Plans come from the cache when possible; release every plan with
+ * MatrixChainPlanRelease() once done with it.
+ */
+MatrixChainPlan *MatrixChainPlanGet(int count, const int *dims);
+
+/**
+ * MatrixChainPlanRelease gives back a plan from MatrixChainPlanGet().  A
+ * plan evicted from the cache while in use is freed by its last release.
+ */
+void MatrixChainPlanRelease(MatrixChainPlan *plan);
+
+/**
+ * MatrixChainScratchSize reports how many floats of scratch space
+ * MatrixChainExecute() needs for this plan.
+ */
+size_t MatrixChainScratchSize(const MatrixChainPlan *plan);
+
+/**
+ * MatrixChainCost reports the multiply-adds of the planned order and of
+ * plain left-to-right evaluation, for comparison.
+ */
+void MatrixChainCost(const MatrixChainPlan *plan, double *planned,
+        double *left_to_right);
+
+/**
+ * MatrixChainExecute multiplies a chain according to a plan and "returns"
+ * the product by modifying result.
+ *
+ * @param: plan, a plan for the shape of mats
+ * @param: mats, the count matrices of the chain, in order
+ * @param: result, pointer to a dims[0] x dims[count] matrix that is
+ *         modified to contain the product
+ * @param: scratch, MatrixChainScratchSize() floats of work space
+ *
+ * @return: 1 on success, 0 if the shapes of mats do not match the plan
+ *
+ * result must not overlap any of the mats or scratch.
+ */
+int MatrixChainExecute(const MatrixChainPlan *plan,
+        const struct MatrixView *mats, float *result, float *scratch);
+
+/**
+ * MatrixChainMultiply plans (through the cache) and executes a chain in one
+ * call, allocating its scratch space.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, the matrices of the chain, in order
+ * @param: result, pointer to a matrix with the rows of mats[0] and the
+ *         columns of mats[count - 1] that is modified to contain the product
+ *
+ * @return: 1 on success, 0 if the shapes do not chain or memory ran out
+ */
+int MatrixChainMultiply(int count, const struct MatrixView *mats,
+        float *result);
+
+/**
+ * MatrixChainCacheFree drops every cached plan.  It must not race with
+ * other MatrixChain calls, and plans obtained earlier must already have
+ * been released.
+ */
+void MatrixChainCacheFree(void);
+
+#endif // MATRIX_CHAIN_H
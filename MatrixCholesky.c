@@ -0,0 +1,355 @@
+/**
+ * @file    MatrixCholesky.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <string.h>
+#include <math.h>
+#include "MatrixMath.h"
+#include "MatrixBatch.h"
+#include "MatrixThreads.h"
+#include "MatrixCholesky.h"
+
+//block size of the NxN factorization, and the size below which it is serial
+#define CHOLESKY_BLOCK 64
+#define CHOLESKY_PARALLEL_N 256
+
+/**
+ * MatrixCholesky factors a 3x3 SPD matrix and "returns" L by modifying the
+ * second argument.
+ *
+ * @param: mat, a pointer to a 3x3 SPD matrix
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain L
+ *
+ * @return: 1 on success, 0 if mat is not positive definite (result then
+ *          holds no meaningful values)
+ *
+ * mat is not modified by this function.
+ */
+int MatrixCholesky(float mat[3][3], float result[3][3])
+{
+    float L[3][3] = {{0}};
+
+    for(int j = 0; j < DIM; j++) {
+        float d = mat[j][j];
+        for(int p = 0; p < j; p++) {
+            d -= L[j][p] * L[j][p];
+        }
+        if(!(d > 0)) {
+            return 0;
+        }
+        L[j][j] = sqrtf(d);
+        for(int i = j + 1; i < DIM; i++) {
+            float s = mat[i][j];
+            for(int p = 0; p < j; p++) {
+                s -= L[i][p] * L[j][p];
+            }
+            L[i][j] = s / L[j][j];
+        }
+    }
+    memcpy(result, L, sizeof(L));
+    return 1;
+}
+
+/**
+ * MatrixCholeskySolve solves mat x = b given L from MatrixCholesky().
+ *
+ * @param: L, a pointer to the 3x3 Cholesky factor
+ * @param: b, the right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ *
+ * @return: none
+ */
+void MatrixCholeskySolve(float L[3][3], float b[3], float x[3])
+{
+    float y0, y1, y2;
+
+    //forward substitution with L, then back substitution with L^T
+    y0 = b[0] / L[0][0];
+    y1 = (b[1] - L[1][0] * y0) / L[1][1];
+    y2 = (b[2] - L[2][0] * y0 - L[2][1] * y1) / L[2][2];
+
+    x[2] = y2 / L[2][2];
+    x[1] = (y1 - L[2][1] * x[2]) / L[1][1];
+    x[0] = (y0 - L[1][0] * x[1] - L[2][0] * x[2]) / L[0][0];
+}
+
+/**
+ * MatrixCholeskyInverse calculates mat^-1 = L^-T L^-1 given L from
+ * MatrixCholesky(), and "returns" it by modifying the second argument.
+ *
+ * @param: L, a pointer to the 3x3 Cholesky factor
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         (symmetric) inverse
+ *
+ * @return: none
+ */
+void MatrixCholeskyInverse(float L[3][3], float result[3][3])
+{
+    float M[3][3] = {{0}}; //L^-1, also lower triangular
+
+    M[0][0] = 1 / L[0][0];
+    M[1][1] = 1 / L[1][1];
+    M[2][2] = 1 / L[2][2];
+    M[1][0] = -L[1][0] * M[0][0] * M[1][1];
+    M[2][1] = -L[2][1] * M[1][1] * M[2][2];
+    M[2][0] = -(L[2][0] * M[0][0] + L[2][1] * M[1][0]) * M[2][2];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = i; j < DIM; j++) {
+            float s = 0;
+            for(int k = j; k < DIM; k++) {
+                s += M[k][i] * M[k][j];
+            }
+            result[i][j] = s;
+            result[j][i] = s;
+        }
+    }
+}
+
+/**
+ * MatrixCholeskyBatch factors `count` SPD matrices in SoA layout.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch to factor
+ * @param: L, 9 * count floats that are modified to hold the SoA factors
+ * @param: ok, count flags, each set to 1 if its matrix is positive definite
+ *         and to 0 otherwise (may be NULL)
+ *
+ * @return: the number of matrices that are not positive definite
+ */
+int MatrixCholeskyBatch(int count, const float *mats, float *L,
+        unsigned char *ok)
+{
+    const float *a00 = MATRIX_SOA(mats, count, 0, 0);
+    const float *a10 = MATRIX_SOA(mats, count, 1, 0);
+    const float *a11 = MATRIX_SOA(mats, count, 1, 1);
+    const float *a20 = MATRIX_SOA(mats, count, 2, 0);
+    const float *a21 = MATRIX_SOA(mats, count, 2, 1);
+    const float *a22 = MATRIX_SOA(mats, count, 2, 2);
+    float *l00 = MATRIX_SOA(L, count, 0, 0);
+    float *l01 = MATRIX_SOA(L, count, 0, 1);
+    float *l02 = MATRIX_SOA(L, count, 0, 2);
+    float *l10 = MATRIX_SOA(L, count, 1, 0);
+    float *l11 = MATRIX_SOA(L, count, 1, 1);
+    float *l12 = MATRIX_SOA(L, count, 1, 2);
+    float *l20 = MATRIX_SOA(L, count, 2, 0);
+    float *l21 = MATRIX_SOA(L, count, 2, 1);
+    float *l22 = MATRIX_SOA(L, count, 2, 2);
+    int failed = 0;
+
+    //branch-free so the loop vectorizes across matrices: a non-positive
+    //pivot is replaced by 1 to keep the lanes finite and recorded in the flag
+    for(int b = 0; b < count; b++) {
+        float d0 = a00[b];
+        int good = d0 > 0;
+        float r0 = sqrtf(good ? d0 : 1);
+        float x10 = a10[b] / r0;
+        float x20 = a20[b] / r0;
+
+        float d1 = a11[b] - x10 * x10;
+        good &= d1 > 0;
+        float r1 = sqrtf(d1 > 0 ? d1 : 1);
+        float x21 = (a21[b] - x20 * x10) / r1;
+
+        float d2 = a22[b] - x20 * x20 - x21 * x21;
+        good &= d2 > 0;
+        float r2 = sqrtf(d2 > 0 ? d2 : 1);
+
+        l00[b] = r0;
+        l10[b] = x10;
+        l11[b] = r1;
+        l20[b] = x20;
+        l21[b] = x21;
+        l22[b] = r2;
+        l01[b] = 0;
+        l02[b] = 0;
+        l12[b] = 0;
+        failed += !good;
+        if(ok != NULL) {
+            ok[b] = good;
+        }
+    }
+    return failed;
+}
+
+/**
+ * MatrixCholeskySolveBatch solves mat x = b for `count` systems in SoA
+ * layout given the factors from MatrixCholeskyBatch().
+ *
+ * @param: count, the number of systems
+ * @param: L, 9 * count floats, the SoA factors
+ * @param: b, 3 * count floats, the SoA right-hand sides
+ * @param: x, 3 * count floats that are modified to hold the solutions (may
+ *         be the same as b)
+ */
+void MatrixCholeskySolveBatch(int count, const float *L, const float *b,
+        float *x)
+{
+    const float *l00 = MATRIX_SOA(L, count, 0, 0);
+    const float *l10 = MATRIX_SOA(L, count, 1, 0);
+    const float *l11 = MATRIX_SOA(L, count, 1, 1);
+    const float *l20 = MATRIX_SOA(L, count, 2, 0);
+    const float *l21 = MATRIX_SOA(L, count, 2, 1);
+    const float *l22 = MATRIX_SOA(L, count, 2, 2);
+    const float *b0 = b, *b1 = b + count, *b2 = b + 2 * (size_t)count;
+    float *x0 = x, *x1 = x + count, *x2 = x + 2 * (size_t)count;
+
+    for(int k = 0; k < count; k++) {
+        float y0 = b0[k] / l00[k];
+        float y1 = (b1[k] - l10[k] * y0) / l11[k];
+        float y2 = (b2[k] - l20[k] * y0 - l21[k] * y1) / l22[k];
+
+        float z2 = y2 / l22[k];
+        float z1 = (y1 - l21[k] * z2) / l11[k];
+        float z0 = (y0 - l10[k] * z1 - l20[k] * z2) / l00[k];
+
+        x0[k] = z0;
+        x1[k] = z1;
+        x2[k] = z2;
+    }
+}
+
+//one step of the blocked factorization, shared by the parallel row loops
+struct BlockStep {
+    float *L;
+    int n;
+    int k0, kb; //the diagonal block is rows/columns [k0, k0 + kb)
+};
+
+//triangular solve of the panel rows below the diagonal block
+static void SolvePanelRows(void *arg, int begin, int end)
+{
+    struct BlockStep *s = arg;
+    int n = s->n;
+    int first = s->k0 + s->kb;
+
+    for(int i = first + begin; i < first + end; i++) {
+        float *row = s->L + (size_t)i * n;
+        for(int j = s->k0; j < s->k0 + s->kb; j++) {
+            const float *diag_row = s->L + (size_t)j * n;
+            float sum = row[j];
+            for(int p = s->k0; p < j; p++) {
+                sum -= row[p] * diag_row[p];
+            }
+            row[j] = sum / diag_row[j];
+        }
+    }
+}
+
+//subtracts the panel's contribution from the lower trailing submatrix
+static void UpdateTrailingRows(void *arg, int begin, int end)
+{
+    struct BlockStep *s = arg;
+    int n = s->n;
+    int first = s->k0 + s->kb;
+
+    for(int i = first + begin; i < first + end; i++) {
+        float *row_i = s->L + (size_t)i * n;
+        const float *panel_i = row_i + s->k0;
+        for(int j = first; j <= i; j++) {
+            const float *panel_j = s->L + (size_t)j * n + s->k0;
+            float sum = 0;
+            for(int p = 0; p < s->kb; p++) {
+                sum += panel_i[p] * panel_j[p];
+            }
+            row_i[j] -= sum;
+        }
+    }
+}
+
+/**
+ * MatrixNCholesky factors an n x n SPD matrix and "returns" L by modifying
+ * the third argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n SPD matrix
+ * @param: L, pointer to an n x n matrix that is modified to contain L (may
+ *         be the same as mat)
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: 1 on success, 0 if mat is not positive definite; L (and mat,
+ *          if the same) is then partially overwritten
+ */
+int MatrixNCholesky(int n, const float *mat, float *L, int threads)
+{
+    struct BlockStep step;
+
+    //keep the lower triangle, clear the upper one
+    for(int i = 0; i < n; i++) {
+        if(L != mat) {
+            memcpy(L + (size_t)i * n, mat + (size_t)i * n,
+                    (i + 1) * sizeof(float));
+        }
+        memset(L + (size_t)i * n + i + 1, 0, (n - i - 1) * sizeof(float));
+    }
+    if(n < CHOLESKY_PARALLEL_N) {
+        threads = 1;
+    }
+
+    step.L = L;
+    step.n = n;
+    for(int k0 = 0; k0 < n; k0 += CHOLESKY_BLOCK) {
+        int kb = (n - k0 < CHOLESKY_BLOCK) ? n - k0 : CHOLESKY_BLOCK;
+        int below = n - k0 - kb;
+
+        //unblocked factorization of the diagonal block
+        for(int j = k0; j < k0 + kb; j++) {
+            float *row_j = L + (size_t)j * n;
+            float d = row_j[j];
+            for(int p = k0; p < j; p++) {
+                d -= row_j[p] * row_j[p];
+            }
+            if(!(d > 0)) {
+                return 0;
+            }
+            row_j[j] = sqrtf(d);
+            for(int i = j + 1; i < k0 + kb; i++) {
+                float *row_i = L + (size_t)i * n;
+                float sum = row_i[j];
+                for(int p = k0; p < j; p++) {
+                    sum -= row_i[p] * row_j[p];
+                }
+                row_i[j] = sum / row_j[j];
+            }
+        }
+
+        step.k0 = k0;
+        step.kb = kb;
+        MatrixParallelFor(below, threads, SolvePanelRows, &step);
+        MatrixParallelFor(below, threads, UpdateTrailingRows, &step);
+    }
+    return 1;
+}
+
+/**
+ * MatrixNCholeskySolve solves mat x = b given L from MatrixNCholesky().
+ *
+ * @param: n, the dimension of the system
+ * @param: L, pointer to the n x n Cholesky factor
+ * @param: b, the n-long right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ */
+void MatrixNCholeskySolve(int n, const float *L, const float *b, float *x)
+{
+    if(x != b) {
+        memcpy(x, b, n * sizeof(float));
+    }
+    for(int i = 0; i < n; i++) {
+        const float *row = L + (size_t)i * n;
+        float sum = x[i];
+        for(int p = 0; p < i; p++) {
+            sum -= row[p] * x[p];
+        }
+        x[i] = sum / row[i];
+    }
+    //L^T is walked by columns of L, so subtract each solved x[i] from the
+    //rows above instead
+    for(int i = n - 1; i >= 0; i--) {
+        const float *row = L + (size_t)i * n;
+        x[i] /= row[i];
+        for(int p = 0; p < i; p++) {
+            x[p] -= row[p] * x[i];
+        }
+    }
+}
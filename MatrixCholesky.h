@@ -0,0 +1,112 @@
+#ifndef MATRIX_CHOLESKY_H
+#define MATRIX_CHOLESKY_H
+
+/**
+ * @file    MatrixCholesky.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements the Cholesky factorization mat = L L^T of symmetric
+ * positive-definite (SPD) matrices, such as covariances, and the triangular
+ * solves that go with it.  For SPD matrices this is cheaper and numerically
+ * better behaved than the cofactor inverse of MatrixInverse().
+ *
+ * Only the lower triangle of the input is read.  L is lower triangular; the
+ * strictly upper part of every output is zero.
+ *
+ * The batched 3x3 functions take MatrixBatch.h SoA batches and never stop
+ * early: a matrix that is not positive definite only clears its own flag.
+ * The NxN factorization is blocked and multithreaded.
+ */
+
+/**
+ * MatrixCholesky factors a 3x3 SPD matrix and "returns" L by modifying the
+ * second argument.
+ *
+ * @param: mat, a pointer to a 3x3 SPD matrix
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain L
+ *
+ * @return: 1 on success, 0 if mat is not positive definite (result then
+ *          holds no meaningful values)
+ *
+ * mat is not modified by this function.
+ */
+int MatrixCholesky(float mat[3][3], float result[3][3]);
+
+/**
+ * MatrixCholeskySolve solves mat x = b given L from MatrixCholesky().
+ *
+ * @param: L, a pointer to the 3x3 Cholesky factor
+ * @param: b, the right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ *
+ * @return: none
+ */
+void MatrixCholeskySolve(float L[3][3], float b[3], float x[3]);
+
+/**
+ * MatrixCholeskyInverse calculates mat^-1 = L^-T L^-1 given L from
+ * MatrixCholesky(), and "returns" it by modifying the second argument.
+ *
+ * @param: L, a pointer to the 3x3 Cholesky factor
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         (symmetric) inverse
+ *
+ * @return: none
+ */
+void MatrixCholeskyInverse(float L[3][3], float result[3][3]);
+
+/**
+ * MatrixCholeskyBatch factors `count` SPD matrices in SoA layout.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch to factor
+ * @param: L, 9 * count floats that are modified to hold the SoA factors
+ * @param: ok, count flags, each set to 1 if its matrix is positive definite
+ *         and to 0 otherwise (may be NULL)
+ *
+ * @return: the number of matrices that are not positive definite
+ */
+int MatrixCholeskyBatch(int count, const float *mats, float *L,
+        unsigned char *ok);
+
+/**
+ * MatrixCholeskySolveBatch solves mat x = b for `count` systems in SoA
+ * layout given the factors from MatrixCholeskyBatch().
+ *
+ * @param: count, the number of systems
+ * @param: L, 9 * count floats, the SoA factors
+ * @param: b, 3 * count floats, the SoA right-hand sides
+ * @param: x, 3 * count floats that are modified to hold the solutions (may
+ *         be the same as b)
+ */
+void MatrixCholeskySolveBatch(int count, const float *L, const float *b,
+        float *x);
+
+/**
+ * MatrixNCholesky factors an n x n SPD matrix and "returns" L by modifying
+ * the third argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n SPD matrix
+ * @param: L, pointer to an n x n matrix that is modified to contain L (may
+ *         be the same as mat)
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: 1 on success, 0 if mat is not positive definite; L (and mat,
+ *          if the same) is then partially overwritten
+ */
+int MatrixNCholesky(int n, const float *mat, float *L, int threads);
+
+/**
+ * MatrixNCholeskySolve solves mat x = b given L from MatrixNCholesky().
+ *
+ * @param: n, the dimension of the system
+ * @param: L, pointer to the n x n Cholesky factor
+ * @param: b, the n-long right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ */
+void MatrixNCholeskySolve(int n, const float *L, const float *b, float *x);
+
+#endif // MATRIX_CHOLESKY_H
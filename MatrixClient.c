@@ -0,0 +1,392 @@
+/**
+ * @file    MatrixClient.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "MatrixProtocol.h"
+#include "MatrixClient.h"
+
+struct MatrixClient {
+    int fd;
+    uint32_t next_id;
+    void *shm;
+    size_t shm_size;
+};
+
+//reads or writes exactly len bytes, retrying on short transfers
+static int WriteAll(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while(len > 0) {
+        ssize_t n = write(fd, p, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int ReadAll(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while(len > 0) {
+        ssize_t n = read(fd, p, len);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+//reads and throws away len bytes
+static int Discard(int fd, size_t len)
+{
+    char scratch[4096];
+
+    while(len > 0) {
+        size_t n = len < sizeof(scratch) ? len : sizeof(scratch);
+        if(ReadAll(fd, scratch, n) < 0) {
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+//sends the HELLO request that hands the shared buffer's descriptor over
+static int SendShm(MatrixClient *client, int memfd)
+{
+    struct MatrixRequestHeader req;
+    struct MatrixResponseHeader resp;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    memset(&req, 0, sizeof(req));
+    req.id = client->next_id++;
+    req.op = MML_OP_HELLO;
+    req.count = (uint32_t)client->shm_size;
+
+    iov.iov_base = &req;
+    iov.iov_len = sizeof(req);
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+    if(sendmsg(client->fd, &msg, 0) != sizeof(req)) {
+        return -1;
+    }
+    if(ReadAll(client->fd, &resp, sizeof(resp)) < 0) {
+        return -1;
+    }
+    return resp.status == MML_STATUS_OK ? 0 : -1;
+}
+
+MatrixClient *MatrixClientOpen(const char *path, size_t shm_size)
+{
+    struct sockaddr_un addr;
+    MatrixClient *client;
+
+    if(path == NULL) {
+        path = getenv("MML_SOCKET");
+    }
+    if(path == NULL) {
+        path = MML_SOCKET_PATH;
+    }
+    if(strlen(path) >= sizeof(addr.sun_path) || shm_size > UINT32_MAX) {
+        return NULL;
+    }
+
+    client = calloc(1, sizeof(*client));
+    if(client == NULL) {
+        return NULL;
+    }
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(client->fd < 0) {
+        free(client);
+        return NULL;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if(connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        MatrixClientClose(client);
+        return NULL;
+    }
+
+    //a missing shared buffer only costs copies, so failures here are not fatal
+    if(shm_size > 0) {
+        int memfd = memfd_create("mml-client", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        //the daemon only maps a buffer that cannot shrink under it
+        if(memfd >= 0 && ftruncate(memfd, shm_size) == 0 &&
+                fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) == 0) {
+            void *p = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    memfd, 0);
+            if(p != MAP_FAILED) {
+                client->shm = p;
+                client->shm_size = shm_size;
+                if(SendShm(client, memfd) < 0) {
+                    munmap(p, shm_size);
+                    client->shm = NULL;
+                    client->shm_size = 0;
+                }
+            }
+        }
+        if(memfd >= 0) {
+            close(memfd);
+        }
+    }
+    return client;
+}
+
+void MatrixClientClose(MatrixClient *client)
+{
+    if(client == NULL) {
+        return;
+    }
+    if(client->shm != NULL) {
+        munmap(client->shm, client->shm_size);
+    }
+    close(client->fd);
+    free(client);
+}
+
+void *MatrixClientShmBuffer(MatrixClient *client, size_t *size)
+{
+    if(size != NULL) {
+        *size = client->shm_size;
+    }
+    return client->shm;
+}
+
+//sends one request and waits for its response, reading out_len payload bytes
+static int Transact(MatrixClient *client, struct MatrixRequestHeader *req,
+        const void *in, void *out, size_t out_len)
+{
+    struct MatrixResponseHeader resp;
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t sent, total;
+
+    req->id = client->next_id++;
+
+    //header and payload leave in one syscall so the daemon sees them together
+    iov[0].iov_base = req;
+    iov[0].iov_len = sizeof(*req);
+    iov[1].iov_base = (void *)in;
+    iov[1].iov_len = req->length;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = req->length > 0 ? 2 : 1;
+    total = sizeof(*req) + req->length;
+    do {
+        sent = sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+    } while(sent < 0 && errno == EINTR);
+    if(sent < 0) {
+        return -1;
+    }
+    if(sent < total) {
+        //finish whatever the kernel did not take in one go
+        if(sent < (ssize_t)sizeof(*req)) {
+            if(WriteAll(client->fd, (char *)req + sent,
+                    sizeof(*req) - sent) < 0) {
+                return -1;
+            }
+            sent = sizeof(*req);
+        }
+        if(WriteAll(client->fd, (const char *)in + (sent - sizeof(*req)),
+                total - sent) < 0) {
+            return -1;
+        }
+    }
+
+    if(ReadAll(client->fd, &resp, sizeof(resp)) < 0) {
+        return -1;
+    }
+    if(resp.id != req->id) {
+        //the stream is out of step with the requests; nothing after this
+        //could be trusted
+        shutdown(client->fd, SHUT_RDWR);
+        return -1;
+    }
+    if(resp.status != MML_STATUS_OK || resp.length != out_len) {
+        //a payload left unread would be taken for the next response header
+        Discard(client->fd, resp.length);
+        return -1;
+    }
+    if(out_len > 0 && ReadAll(client->fd, out, out_len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int MatrixClientBatchShm(MatrixClient *client, int op, float x, int i, int j,
+        int count, size_t in_offset, size_t out_offset)
+{
+    struct MatrixRequestHeader req;
+    size_t in_size, out_size;
+
+    if(client->shm == NULL || count < 0 || count > MML_MAX_ITEMS ||
+            !MatrixProtocolItemSize(op, &in_size, &out_size)) {
+        return -1;
+    }
+    if(in_offset + count * in_size > client->shm_size ||
+            out_offset + count * out_size > client->shm_size ||
+            in_offset % sizeof(float) != 0 || out_offset % sizeof(float) != 0) {
+        return -1;
+    }
+    memset(&req, 0, sizeof(req));
+    req.op = op;
+    req.flags = MML_FLAG_SHM;
+    req.count = count;
+    req.scalar = x;
+    req.row = i;
+    req.col = j;
+    req.shm_in = (uint32_t)in_offset;
+    req.shm_out = (uint32_t)out_offset;
+    return Transact(client, &req, NULL, NULL, 0);
+}
+
+int MatrixClientBatch(MatrixClient *client, int op, float x, int i, int j,
+        int count, const void *in, void *out)
+{
+    struct MatrixRequestHeader req;
+    size_t in_size, out_size, in_len, out_len;
+
+    if(count < 0 || count > MML_MAX_ITEMS ||
+            !MatrixProtocolItemSize(op, &in_size, &out_size)) {
+        return -1;
+    }
+    in_len = count * in_size;
+    out_len = count * out_size;
+
+    if(in_len >= MML_SHM_THRESHOLD && in_len + out_len <= client->shm_size) {
+        memcpy(client->shm, in, in_len);
+        if(MatrixClientBatchShm(client, op, x, i, j, count, 0, in_len) < 0) {
+            return -1;
+        }
+        memcpy(out, (char *)client->shm + in_len, out_len);
+        return 0;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.op = op;
+    req.length = (uint32_t)in_len;
+    req.count = count;
+    req.scalar = x;
+    req.row = i;
+    req.col = j;
+    return Transact(client, &req, in, out, out_len);
+}
+
+int MatrixClientEquals(MatrixClient *client, float mat1[3][3],
+        float mat2[3][3], int *equal)
+{
+    float in[2][3][3];
+    int32_t out;
+
+    memcpy(in[0], mat1, sizeof(in[0]));
+    memcpy(in[1], mat2, sizeof(in[1]));
+    if(MatrixClientBatch(client, MML_OP_EQUALS, 0, 0, 0, 1, in, &out) < 0) {
+        return -1;
+    }
+    *equal = out;
+    return 0;
+}
+
+int MatrixClientAdd(MatrixClient *client, float mat1[3][3], float mat2[3][3],
+        float result[3][3])
+{
+    float in[2][3][3];
+
+    memcpy(in[0], mat1, sizeof(in[0]));
+    memcpy(in[1], mat2, sizeof(in[1]));
+    return MatrixClientBatch(client, MML_OP_ADD, 0, 0, 0, 1, in, result);
+}
+
+int MatrixClientMultiply(MatrixClient *client, float mat1[3][3],
+        float mat2[3][3], float result[3][3])
+{
+    float in[2][3][3];
+
+    memcpy(in[0], mat1, sizeof(in[0]));
+    memcpy(in[1], mat2, sizeof(in[1]));
+    return MatrixClientBatch(client, MML_OP_MULTIPLY, 0, 0, 0, 1, in, result);
+}
+
+int MatrixClientScalarAdd(MatrixClient *client, float x, float mat[3][3],
+        float result[3][3])
+{
+    return MatrixClientBatch(client, MML_OP_SCALAR_ADD, x, 0, 0, 1, mat,
+            result);
+}
+
+int MatrixClientScalarMultiply(MatrixClient *client, float x, float mat[3][3],
+        float result[3][3])
+{
+    return MatrixClientBatch(client, MML_OP_SCALAR_MULTIPLY, x, 0, 0, 1, mat,
+            result);
+}
+
+int MatrixClientTrace(MatrixClient *client, float mat[3][3], float *trace)
+{
+    return MatrixClientBatch(client, MML_OP_TRACE, 0, 0, 0, 1, mat, trace);
+}
+
+int MatrixClientTranspose(MatrixClient *client, float mat[3][3],
+        float result[3][3])
+{
+    return MatrixClientBatch(client, MML_OP_TRANSPOSE, 0, 0, 0, 1, mat,
+            result);
+}
+
+int MatrixClientSubmatrix(MatrixClient *client, int i, int j, float mat[3][3],
+        float result[2][2])
+{
+    if(i < 0 || i >= 3 || j < 0 || j >= 3) {
+        return -1;
+    }
+    return MatrixClientBatch(client, MML_OP_SUBMATRIX, 0, i, j, 1, mat,
+            result);
+}
+
+int MatrixClientDeterminant(MatrixClient *client, float mat[3][3], float *det)
+{
+    return MatrixClientBatch(client, MML_OP_DETERMINANT, 0, 0, 0, 1, mat, det);
+}
+
+int MatrixClientInverse(MatrixClient *client, float mat[3][3],
+        float result[3][3])
+{
+    return MatrixClientBatch(client, MML_OP_INVERSE, 0, 0, 0, 1, mat, result);
+}
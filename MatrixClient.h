@@ -0,0 +1,114 @@
+#ifndef MATRIX_CLIENT_H
+#define MATRIX_CLIENT_H
+
+/**
+ * @file    MatrixClient.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * Client side of the mml_daemon protocol (see MatrixProtocol.h).  Instead of
+ * running MatrixMath.h in-process, every call is shipped to a daemon shared
+ * by all processes on the host, which batches the work of many clients
+ * together so the host is not oversubscribed.
+ *
+ * A MatrixClient is a single connection and is not thread-safe; open one per
+ * thread.  Every function returns 0 on success and -1 on failure (daemon
+ * unreachable, connection lost, or request rejected).
+ */
+
+#include <stddef.h>
+
+typedef struct MatrixClient MatrixClient;
+
+/**
+ * MatrixClientOpen connects to the daemon.
+ *
+ * @param: path, socket path, or NULL for $MML_SOCKET or MML_SOCKET_PATH
+ * @param: shm_size, bytes of shared memory to attach for large batches, or 0
+ *         to send every payload through the socket
+ *
+ * @return: a new client, or NULL if the daemon could not be reached
+ */
+MatrixClient *MatrixClientOpen(const char *path, size_t shm_size);
+
+/**
+ * MatrixClientClose disconnects and frees the client.
+ *
+ * @param: client, a client returned by MatrixClientOpen (may be NULL)
+ */
+void MatrixClientClose(MatrixClient *client);
+
+/**
+ * MatrixClientShmBuffer exposes the shared buffer so callers can build large
+ * batches in place and use MatrixClientBatchShm without any copy.
+ *
+ * @param: client, an open client
+ * @param: size, set to the size of the buffer in bytes (may be NULL)
+ *
+ * @return: the start of the buffer, or NULL if none is attached
+ */
+void *MatrixClientShmBuffer(MatrixClient *client, size_t *size);
+
+/**
+ * MatrixClientBatch runs `count` independent calls of one operation.
+ *
+ * @param: client, an open client
+ * @param: op, an MML_OP_* code from MatrixProtocol.h
+ * @param: x, the scalar of MML_OP_SCALAR_ADD / MML_OP_SCALAR_MULTIPLY
+ * @param: i, j, the row and column of MML_OP_SUBMATRIX
+ * @param: count, number of items
+ * @param: in, `count` packed input items (see MatrixProtocolItemSize())
+ * @param: out, room for `count` packed output items
+ *
+ * @return: 0 on success, -1 on failure
+ *
+ * Payloads of at least MML_SHM_THRESHOLD bytes go through the shared buffer
+ * when it is large enough to hold both inputs and outputs.
+ */
+int MatrixClientBatch(MatrixClient *client, int op, float x, int i, int j,
+        int count, const void *in, void *out);
+
+/**
+ * MatrixClientBatchShm is MatrixClientBatch with inputs and outputs that
+ * already live in the shared buffer.
+ *
+ * @param: in_offset, byte offset of the input items in the shared buffer, a
+ *         multiple of sizeof(float)
+ * @param: out_offset, byte offset of the output items in the shared buffer,
+ *         a multiple of sizeof(float)
+ *
+ * @return: 0 on success, -1 on failure
+ */
+int MatrixClientBatchShm(MatrixClient *client, int op, float x, int i, int j,
+        int count, size_t in_offset, size_t out_offset);
+
+/*******************************************************************************
+ * Remote equivalents of the MatrixMath.h functions
+ ******************************************************************************/
+int MatrixClientEquals(MatrixClient *client, float mat1[3][3],
+        float mat2[3][3], int *equal);
+int MatrixClientAdd(MatrixClient *client, float mat1[3][3], float mat2[3][3],
+        float result[3][3]);
+int MatrixClientMultiply(MatrixClient *client, float mat1[3][3],
+        float mat2[3][3], float result[3][3]);
+int MatrixClientScalarAdd(MatrixClient *client, float x, float mat[3][3],
+        float result[3][3]);
+int MatrixClientScalarMultiply(MatrixClient *client, float x, float mat[3][3],
+        float result[3][3]);
+int MatrixClientTrace(MatrixClient *client, float mat[3][3], float *trace);
+int MatrixClientTranspose(MatrixClient *client, float mat[3][3],
+        float result[3][3]);
+int MatrixClientSubmatrix(MatrixClient *client, int i, int j, float mat[3][3],
+        float result[2][2]);
+int MatrixClientDeterminant(MatrixClient *client, float mat[3][3],
+        float *det);
+
+/**
+ * Unlike MatrixInverse, which leaves result untouched for a singular matrix,
+ * MatrixClientInverse fills result with zeros in that case.
+ */
+int MatrixClientInverse(MatrixClient *client, float mat[3][3],
+        float result[3][3]);
+
+#endif // MATRIX_CLIENT_H
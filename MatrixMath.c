@@ -8,7 +8,7 @@
 #include <math.h>
 #include "MatrixMath.h"
 
-void MatrixPrint(float mat[3][3])
+MATRIX_MATH_API void MatrixPrint(float mat[3][3])
 {
     printf(" _____________________________\n");
     for(int i = 0;i < DIM; i++) {
@@ -32,7 +32,7 @@ void MatrixPrint(float mat[3][3])
  *
  * Neither mat1 nor mat2 is modified by this function.
  */
-int MatrixEquals(float mat1[3][3], float mat2[3][3])
+MATRIX_MATH_API int MatrixEquals(float mat1[3][3], float mat2[3][3])
 {
      for(int i = 0; i < DIM; i++) {
         for(int j = 0; j < DIM; j++) {
@@ -58,7 +58,8 @@ int MatrixEquals(float mat1[3][3], float mat2[3][3])
  * mat1 and mat2 are not modified by this function. result is modified by this
  * function.
  */
-void MatrixAdd(float mat1[3][3], float mat2[3][3], float result[3][3])
+MATRIX_MATH_API void MatrixAdd(float mat1[3][3], float mat2[3][3],
+        float result[3][3])
 {
     for(int i = 0;i < DIM; i++) {
         for(int j = 0; j < DIM; j++) {
@@ -81,16 +82,20 @@ void MatrixAdd(float mat1[3][3], float mat2[3][3], float result[3][3])
  * mat1 and mat2 are not modified by this function.  result is modified by 
  * this function.
  */
-void MatrixMultiply(float A[3][3], float B[3][3], float res[3][3]) 
+MATRIX_MATH_API void MatrixMultiply(float A[3][3], float B[3][3],
+        float res[3][3])
 {
     for(int i = 0;i < DIM; i++) {
         for(int j = 0; j < DIM; j++) {
-            res[i][j] = 0.0; //making sure there's no funny business
+            float sum = 0.0; //making sure there's no funny business
             //A shares index i with res, B shares index j
             //k will iterate over the columns of A and rows of B
             for(int k = 0; k < DIM; k++) {
-                res[i][j] += A[i][k] * B[k][j];
+                sum += A[i][k] * B[k][j];
             }
+            //accumulating in a local keeps res out of the inner loop, where
+            //it might alias A or B and force a store per step
+            res[i][j] = sum;
         }
     }
 }
@@ -114,7 +119,8 @@ void MatrixMultiply(float A[3][3], float B[3][3], float res[3][3])
  * x and mat are not modified by this function.  result is modified by this 
  * function.
  */
-void MatrixScalarAdd(float x, float mat[3][3], float result[3][3])
+MATRIX_MATH_API void MatrixScalarAdd(float x, float mat[3][3],
+        float result[3][3])
 {
     for(int i = 0;i < DIM; i++) {
         for(int j = 0; j < DIM; j++) {
@@ -137,7 +143,8 @@ void MatrixScalarAdd(float x, float mat[3][3], float result[3][3])
  * x and mat are not modified by this function.  result is modified by this 
  * function.
  */
-void MatrixScalarMultiply(float x, float mat[3][3], float result[3][3])
+MATRIX_MATH_API void MatrixScalarMultiply(float x, float mat[3][3],
+        float result[3][3])
 {
     for(int i = 0;i < DIM; i++) {
         for(int j = 0; j < DIM; j++) {
@@ -158,7 +165,7 @@ void MatrixScalarMultiply(float x, float mat[3][3], float result[3][3])
  *
  * @return: the trace of mat
  */
-float MatrixTrace(float mat[3][3]) 
+MATRIX_MATH_API float MatrixTrace(float mat[3][3]) 
 {
     return mat[0][0] + mat[1][1] + mat[2][2];
 }
@@ -172,7 +179,7 @@ float MatrixTrace(float mat[3][3])
  *
  * mat is not modified by this function.  result is modified by this function.
  */
-void MatrixTranspose(float mat[3][3], float result[3][3]) 
+MATRIX_MATH_API void MatrixTranspose(float mat[3][3], float result[3][3]) 
 {
     for(int i = 0;i < DIM; i++) {
         for(int j = 0; j < DIM; j++) {
@@ -195,7 +202,8 @@ void MatrixTranspose(float mat[3][3], float result[3][3])
  * 
  * mat is not modified by this function.  Result is modified by this function.
  */
-void MatrixSubmatrix(int i, int j, float mat[3][3], float result[2][2])
+MATRIX_MATH_API void MatrixSubmatrix(int i, int j, float mat[3][3],
+        float result[2][2])
 {
     int row_2x2 = 0;
     for(int m = 0; m < DIM; m++) {
@@ -231,7 +239,7 @@ void MatrixSubmatrix(int i, int j, float mat[3][3], float result[2][2])
  *
  * mat is not modified by this function.
  * */
-float MatrixDeterminant2x2(float mat[2][2])
+MATRIX_MATH_API float MatrixDeterminant2x2(float mat[2][2])
 {
     return (mat[0][0]*mat[1][1]) - (mat[0][1]*mat[1][0]);
 }
@@ -246,7 +254,7 @@ float MatrixDeterminant2x2(float mat[2][2])
  *
  * mat is not modified by this function.
  * */
-float MatrixDeterminant(float mat[3][3]) 
+MATRIX_MATH_API float MatrixDeterminant(float mat[3][3]) 
 {   
     //submatrices
     float sub_i[2][2],sub_j[2][2],sub_k[2][2];
@@ -275,7 +283,7 @@ float MatrixDeterminant(float mat[3][3])
  *
  * mat is not modified by this function.  result is modified by this function.
  */
-void MatrixInverse(float mat[3][3], float result[3][3])
+MATRIX_MATH_API void MatrixInverse(float mat[3][3], float result[3][3])
 {
     float minor[3][3], minor_T[3][3], temp_mat[2][2], inv_det, det;
 
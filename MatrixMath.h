@@ -32,6 +32,18 @@
  */
 #define DIM 3
 
+/**
+ * MML_HEADER_ONLY, when defined before this header is included, turns every
+ * function below into a static inline definition in the including file, so
+ * that calls on 3x3 matrices are inlined and constant-folded instead of
+ * going through the library.  Code built either way can be linked together.
+ */
+#ifdef MML_HEADER_ONLY
+#define MATRIX_MATH_API static inline
+#else
+#define MATRIX_MATH_API
+#endif
+
 
 /*******************************************************************************
  * Matrix Display:
@@ -48,7 +60,7 @@
  * negative numbers.  It should be able to display at least FP_DELTA precision,
  * and should handle numbers as large as 999.0 or -999.0.
  */
-void MatrixPrint(float mat[3][3]);
+MATRIX_MATH_API void MatrixPrint(float mat[3][3]);
 
 
 /*******************************************************************************
@@ -67,7 +79,7 @@ void MatrixPrint(float mat[3][3]);
  *
  * Neither mat1 nor mat2 is modified by this function.
  */
-int MatrixEquals(float mat1[3][3], float mat2[3][3]);
+MATRIX_MATH_API int MatrixEquals(float mat1[3][3], float mat2[3][3]);
 
 /**
  * MatrixAdd performs an element-wise matrix addition operation on two 3x3 
@@ -83,7 +95,8 @@ int MatrixEquals(float mat1[3][3], float mat2[3][3]);
  * mat1 and mat2 are not modified by this function. result is modified by this
  * function.
  */
-void MatrixAdd(float mat1[3][3], float mat2[3][3], float result[3][3]);
+MATRIX_MATH_API void MatrixAdd(float mat1[3][3], float mat2[3][3],
+        float result[3][3]);
 
 /**
  * MatrixMultiply performs a matrix-matrix multiplication operation on two 3x3
@@ -99,7 +112,8 @@ void MatrixAdd(float mat1[3][3], float mat2[3][3], float result[3][3]);
  * mat1 and mat2 are not modified by this function.  result is modified by 
  * this function.
  */
-void MatrixMultiply(float mat1[3][3], float mat2[3][3], float result[3][3]);
+MATRIX_MATH_API void MatrixMultiply(float mat1[3][3], float mat2[3][3],
+        float result[3][3]);
 
 
 /*******************************************************************************
@@ -120,7 +134,8 @@ void MatrixMultiply(float mat1[3][3], float mat2[3][3], float result[3][3]);
  * x and mat are not modified by this function.  result is modified by this 
  * function.
  */
-void MatrixScalarAdd(float x, float mat[3][3], float result[3][3]);
+MATRIX_MATH_API void MatrixScalarAdd(float x, float mat[3][3],
+        float result[3][3]);
 
 /**
  * MatrixScalarAdd performs the multiplication of a matrix and a scalar.
@@ -136,7 +151,8 @@ void MatrixScalarAdd(float x, float mat[3][3], float result[3][3]);
  * x and mat are not modified by this function.  result is modified by this 
  * function.
  */
-void MatrixScalarMultiply(float x, float mat[3][3], float result[3][3]);
+MATRIX_MATH_API void MatrixScalarMultiply(float x, float mat[3][3],
+        float result[3][3]);
 
 
 /*******************************************************************************
@@ -150,7 +166,7 @@ void MatrixScalarMultiply(float x, float mat[3][3], float result[3][3]);
  *
  * @return: the trace of mat
  */
-float MatrixTrace(float mat[3][3]);
+MATRIX_MATH_API float MatrixTrace(float mat[3][3]);
 
 /**
  * MatrixTranspose calculates the transpose of a matrix and "returns" the
@@ -161,7 +177,7 @@ float MatrixTrace(float mat[3][3]);
  *
  * mat is not modified by this function.  result is modified by this function.
  */
-void MatrixTranspose(float mat[3][3], float result[3][3]);
+MATRIX_MATH_API void MatrixTranspose(float mat[3][3], float result[3][3]);
 
 /**
  * MatrixSubmatrix finds a submatrix of a 3x3 matrix that is 
@@ -177,7 +193,8 @@ void MatrixTranspose(float mat[3][3], float result[3][3]);
  * 
  * mat is not modified by this function.  Result is modified by this function.
  */
-void MatrixSubmatrix(int i, int j, float mat[3][3], float result[2][2]);
+MATRIX_MATH_API void MatrixSubmatrix(int i, int j, float mat[3][3],
+        float result[2][2]);
 
 /**
  * MatrixDeterminant calculates the determinant of a 3x3 matrix 
@@ -189,7 +206,7 @@ void MatrixSubmatrix(int i, int j, float mat[3][3], float result[2][2]);
  *
  * mat is not modified by this function.
  * */
-float MatrixDeterminant(float mat[3][3]);
+MATRIX_MATH_API float MatrixDeterminant(float mat[3][3]);
 
 
 /* MatrixInverse calculates the inverse of a matrix and
@@ -202,6 +219,10 @@ float MatrixDeterminant(float mat[3][3]);
  *
  * mat is not modified by this function.  result is modified by this function.
  */
-void MatrixInverse(float mat[3][3], float result[3][3]);
+MATRIX_MATH_API void MatrixInverse(float mat[3][3], float result[3][3]);
+
+#ifdef MML_HEADER_ONLY
+#include "MatrixMath.c"
+#endif
 
 #endif // MATRIX_MATH_H
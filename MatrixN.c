@@ -0,0 +1,493 @@
+/**
+ * @file    MatrixN.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+//SSE is part of x86-64; 32-bit builds only get it when the flags say so
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
+#include "MatrixArena.h"
+#include "MatrixTune.h"
+#include "MatrixN.h"
+
+//transposes are done in TILE x TILE register tiles; the recursion stops at
+//the leaf size, which should keep both the source and destination block in
+//L1 (MatrixNSetTransposeLeaf())
+#define TILE 8
+
+/**
+ * MatrixNMultiply performs a matrix-matrix multiplication of an m x k matrix
+ * by a k x n matrix and "returns" the result by modifying the last argument.
+ *
+ * @param: m, k, n, the dimensions of the factors
+ * @param: mat1, pointer to the left m x k factor
+ * @param: mat2, pointer to the right k x n factor
+ * @param: result, pointer to an m x n matrix that is modified to contain the
+ *         matrix product of mat1 and mat2
+ *
+ * @return: none
+ *
+ * mat1 and mat2 are not modified by this function.  result must not overlap
+ * either factor.
+ */
+void MatrixNMultiply(int m, int k, int n, const float *mat1, const float *mat2,
+        float *result)
+{
+    for(int i = 0; i < m; i++) {
+        float *row = result + (size_t)i * n;
+        for(int j = 0; j < n; j++) {
+            row[j] = 0.0;
+        }
+        //i-k-j order walks both mat2 and result along rows
+        for(int p = 0; p < k; p++) {
+            float a = mat1[(size_t)i * k + p];
+            const float *b = mat2 + (size_t)p * n;
+            for(int j = 0; j < n; j++) {
+                row[j] += a * b[j];
+            }
+        }
+    }
+}
+
+/**
+ * MatrixNInverse calculates the inverse of an n x n matrix by Gauss-Jordan
+ * elimination with partial pivoting and "returns" the result by modifying
+ * the last argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         inverse of mat
+ *
+ * @return: 1 on success, 0 if mat is singular (or memory ran out), in which
+ *          case result is left untouched
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixNInverse(int n, const float *mat, float *result)
+{
+    size_t nn = (size_t)n * n;
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *a = MatrixArenaAlloc(nn * sizeof(float));
+    int *perm = MatrixArenaAlloc(n * sizeof(int));
+
+    if(a == NULL || perm == NULL) {
+        MatrixArenaRelease(pos);
+        return 0;
+    }
+    memcpy(a, mat, nn * sizeof(float));
+
+    //in-place Gauss-Jordan: column c of a ends up holding column c of the
+    //inverse, with the row swaps undone as column swaps at the end
+    for(int c = 0; c < n; c++) {
+        int pivot = c;
+        for(int i = c + 1; i < n; i++) {
+            if(fabsf(a[(size_t)i * n + c]) > fabsf(a[(size_t)pivot * n + c])) {
+                pivot = i;
+            }
+        }
+        perm[c] = pivot;
+        if(a[(size_t)pivot * n + c] == 0) {
+            MatrixArenaRelease(pos);
+            return 0;
+        }
+        if(pivot != c) {
+            for(int j = 0; j < n; j++) {
+                float t = a[(size_t)c * n + j];
+                a[(size_t)c * n + j] = a[(size_t)pivot * n + j];
+                a[(size_t)pivot * n + j] = t;
+            }
+        }
+
+        float *prow = a + (size_t)c * n;
+        float inv_pivot = 1 / prow[c];
+        prow[c] = 1;
+        for(int j = 0; j < n; j++) {
+            prow[j] *= inv_pivot;
+        }
+        for(int i = 0; i < n; i++) {
+            float *row = a + (size_t)i * n;
+            float f = row[c];
+            if(i == c || f == 0) {
+                continue;
+            }
+            row[c] = 0;
+            for(int j = 0; j < n; j++) {
+                row[j] -= f * prow[j];
+            }
+        }
+    }
+    for(int c = n - 1; c >= 0; c--) {
+        if(perm[c] != c) {
+            for(int i = 0; i < n; i++) {
+                float t = a[(size_t)i * n + c];
+                a[(size_t)i * n + c] = a[(size_t)i * n + perm[c]];
+                a[(size_t)i * n + perm[c]] = t;
+            }
+        }
+    }
+
+    memcpy(result, a, nn * sizeof(float));
+    MatrixArenaRelease(pos);
+    return 1;
+}
+
+/*******************************************************************************
+ * Transposes
+ ******************************************************************************/
+
+//dst (8x8, stride ldd) = transpose of src (8x8, stride lds), one version
+//per instruction set; the AVX one is compiled for AVX whatever the build
+//flags and only called once the CPU is known to support it
+typedef void (*TileFn)(const float *src, int lds, float *dst, int ldd);
+
+static void Tile8Scalar(const float *src, int lds, float *dst, int ldd)
+{
+    for(int i = 0; i < TILE; i++) {
+        for(int j = 0; j < TILE; j++) {
+            dst[(size_t)j * ldd + i] = src[(size_t)i * lds + j];
+        }
+    }
+}
+
+#ifdef X86_KERNELS
+static void Tile8Sse(const float *src, int lds, float *dst, int ldd)
+{
+    //four 4x4 quadrants, each transposed in registers and stored mirrored
+    for(int p = 0; p < TILE; p += 4) {
+        for(int q = 0; q < TILE; q += 4) {
+            const float *s = src + (size_t)p * lds + q;
+            float *d = dst + (size_t)q * ldd + p;
+            __m128 r0 = _mm_loadu_ps(s);
+            __m128 r1 = _mm_loadu_ps(s + lds);
+            __m128 r2 = _mm_loadu_ps(s + 2 * (size_t)lds);
+            __m128 r3 = _mm_loadu_ps(s + 3 * (size_t)lds);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(d, r0);
+            _mm_storeu_ps(d + ldd, r1);
+            _mm_storeu_ps(d + 2 * (size_t)ldd, r2);
+            _mm_storeu_ps(d + 3 * (size_t)ldd, r3);
+        }
+    }
+}
+
+__attribute__((target("avx")))
+static void Tile8Avx(const float *src, int lds, float *dst, int ldd)
+{
+    __m256 r0 = _mm256_loadu_ps(src + 0 * (size_t)lds);
+    __m256 r1 = _mm256_loadu_ps(src + 1 * (size_t)lds);
+    __m256 r2 = _mm256_loadu_ps(src + 2 * (size_t)lds);
+    __m256 r3 = _mm256_loadu_ps(src + 3 * (size_t)lds);
+    __m256 r4 = _mm256_loadu_ps(src + 4 * (size_t)lds);
+    __m256 r5 = _mm256_loadu_ps(src + 5 * (size_t)lds);
+    __m256 r6 = _mm256_loadu_ps(src + 6 * (size_t)lds);
+    __m256 r7 = _mm256_loadu_ps(src + 7 * (size_t)lds);
+    //interleave pairs of rows, then pairs of pairs, then swap 128-bit halves
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    _mm256_storeu_ps(dst + 0 * (size_t)ldd, _mm256_permute2f128_ps(s0, s4, 0x20));
+    _mm256_storeu_ps(dst + 1 * (size_t)ldd, _mm256_permute2f128_ps(s1, s5, 0x20));
+    _mm256_storeu_ps(dst + 2 * (size_t)ldd, _mm256_permute2f128_ps(s2, s6, 0x20));
+    _mm256_storeu_ps(dst + 3 * (size_t)ldd, _mm256_permute2f128_ps(s3, s7, 0x20));
+    _mm256_storeu_ps(dst + 4 * (size_t)ldd, _mm256_permute2f128_ps(s0, s4, 0x31));
+    _mm256_storeu_ps(dst + 5 * (size_t)ldd, _mm256_permute2f128_ps(s1, s5, 0x31));
+    _mm256_storeu_ps(dst + 6 * (size_t)ldd, _mm256_permute2f128_ps(s2, s6, 0x31));
+    _mm256_storeu_ps(dst + 7 * (size_t)ldd, _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+
+static TileFn tile8 = Tile8Sse;
+static int tile_isa = MATRIX_ISA_SSE;
+#else
+static TileFn tile8 = Tile8Scalar;
+static int tile_isa = MATRIX_ISA_SCALAR;
+#endif
+
+static int transpose_leaf = MATRIX_TRANSPOSE_LEAF;
+
+/**
+ * MatrixNSupportsKernel tells whether the CPU can run a transpose kernel.
+ *
+ * @param: isa, MATRIX_ISA_SCALAR, MATRIX_ISA_SSE or MATRIX_ISA_AVX
+ *
+ * @return: 1 if it can, 0 if not
+ */
+int MatrixNSupportsKernel(int isa)
+{
+    switch(isa) {
+    case MATRIX_ISA_SCALAR:
+        return 1;
+#ifdef X86_KERNELS
+    case MATRIX_ISA_SSE:
+        return 1;
+    case MATRIX_ISA_AVX:
+        return __builtin_cpu_supports("avx");
+#endif
+    default:
+        return 0;
+    }
+}
+
+/**
+ * MatrixNSetTransposeKernel / MatrixNGetTransposeKernel select and read the
+ * instruction set the transpose tiles use.
+ *
+ * @param: isa, MATRIX_ISA_SCALAR, MATRIX_ISA_SSE or MATRIX_ISA_AVX
+ *
+ * @return: 1 on success, 0 if the CPU cannot run it (nothing changes)
+ */
+int MatrixNSetTransposeKernel(int isa)
+{
+    MatrixTuneInit();
+    if(!MatrixNSupportsKernel(isa)) {
+        return 0;
+    }
+#ifdef X86_KERNELS
+    tile8 = isa == MATRIX_ISA_AVX ? Tile8Avx :
+            isa == MATRIX_ISA_SSE ? Tile8Sse : Tile8Scalar;
+#endif
+    tile_isa = isa;
+    return 1;
+}
+
+int MatrixNGetTransposeKernel(void)
+{
+    MatrixTuneInit();
+    return tile_isa;
+}
+
+/**
+ * MatrixNSetTransposeLeaf / MatrixNGetTransposeLeaf set and read the block
+ * size at which the transposes stop recursing.
+ *
+ * @param: leaf, the size, rounded down to a multiple of 8 (at least 8)
+ */
+void MatrixNSetTransposeLeaf(int leaf)
+{
+    MatrixTuneInit();
+    transpose_leaf = leaf < TILE ? TILE : leaf & ~(TILE - 1);
+}
+
+int MatrixNGetTransposeLeaf(void)
+{
+    MatrixTuneInit();
+    return transpose_leaf;
+}
+
+//splits n at a multiple of TILE so that tiles never straddle the halves
+static int Half(int n)
+{
+    return (n / 2 + TILE - 1) & ~(TILE - 1);
+}
+
+static void TransposeLeaf(const float *src, int lds, float *dst, int ldd,
+        int rows, int cols)
+{
+    int full_rows = rows & ~(TILE - 1), full_cols = cols & ~(TILE - 1);
+
+    for(int i = 0; i < full_rows; i += TILE) {
+        for(int j = 0; j < full_cols; j += TILE) {
+            tile8(src + (size_t)i * lds + j, lds, dst + (size_t)j * ldd + i,
+                    ldd);
+        }
+    }
+    //the ragged right and bottom edges
+    for(int i = 0; i < rows; i++) {
+        for(int j = i < full_rows ? full_cols : 0; j < cols; j++) {
+            dst[(size_t)j * ldd + i] = src[(size_t)i * lds + j];
+        }
+    }
+}
+
+static void TransposeRecursive(const float *src, int lds, float *dst, int ldd,
+        int rows, int cols)
+{
+    if(rows <= transpose_leaf && cols <= transpose_leaf) {
+        TransposeLeaf(src, lds, dst, ldd, rows, cols);
+    } else if(rows >= cols) {
+        int mid = Half(rows);
+        TransposeRecursive(src, lds, dst, ldd, mid, cols);
+        TransposeRecursive(src + (size_t)mid * lds, lds, dst + mid, ldd,
+                rows - mid, cols);
+    } else {
+        int mid = Half(cols);
+        TransposeRecursive(src, lds, dst, ldd, rows, mid);
+        TransposeRecursive(src + mid, lds, dst + (size_t)mid * ldd, ldd,
+                rows, cols - mid);
+    }
+}
+
+/**
+ * MatrixNTranspose calculates the transpose of a rows x cols matrix and
+ * "returns" it by modifying the last argument.
+ *
+ * @param: rows, cols, the dimensions of mat
+ * @param: mat, pointer to a rows x cols matrix
+ * @param: result, pointer to a cols x rows matrix that is modified to contain
+ *         the transpose of mat
+ *
+ * @return: none
+ *
+ * The matrix is split recursively along its longer side, so every level of
+ * the memory hierarchy sees blocks that fit it without tuning, and the
+ * leaves are transposed as 8x8 tiles in SIMD registers.  result must not
+ * overlap mat.
+ */
+void MatrixNTranspose(int rows, int cols, const float *mat, float *result)
+{
+    MatrixTuneInit();
+    TransposeRecursive(mat, cols, result, rows, rows, cols);
+}
+
+//exchanges the tile at x with the transpose of the tile at y
+static void SwapTile(float *x, float *y, int ld)
+{
+    float tmp[TILE * TILE];
+
+    tile8(y, ld, tmp, TILE);
+    tile8(x, ld, y, ld);
+    for(int r = 0; r < TILE; r++) {
+        memcpy(x + (size_t)r * ld, tmp + r * TILE, TILE * sizeof(float));
+    }
+}
+
+//exchanges the rows x cols block at a with the transpose of the cols x rows
+//block at b (both in one matrix with stride ld)
+static void SwapLeaf(float *a, float *b, int ld, int rows, int cols)
+{
+    int full_rows = rows & ~(TILE - 1), full_cols = cols & ~(TILE - 1);
+
+    for(int i = 0; i < full_rows; i += TILE) {
+        for(int j = 0; j < full_cols; j += TILE) {
+            SwapTile(a + (size_t)i * ld + j, b + (size_t)j * ld + i, ld);
+        }
+    }
+    for(int i = 0; i < rows; i++) {
+        for(int j = i < full_rows ? full_cols : 0; j < cols; j++) {
+            float t = a[(size_t)i * ld + j];
+            a[(size_t)i * ld + j] = b[(size_t)j * ld + i];
+            b[(size_t)j * ld + i] = t;
+        }
+    }
+}
+
+static void SwapRecursive(float *a, float *b, int ld, int rows, int cols)
+{
+    if(rows <= transpose_leaf && cols <= transpose_leaf) {
+        SwapLeaf(a, b, ld, rows, cols);
+    } else if(rows >= cols) {
+        int mid = Half(rows);
+        SwapRecursive(a, b, ld, mid, cols);
+        SwapRecursive(a + (size_t)mid * ld, b + mid, ld, rows - mid, cols);
+    } else {
+        int mid = Half(cols);
+        SwapRecursive(a, b, ld, rows, mid);
+        SwapRecursive(a + mid, b + (size_t)mid * ld, ld, rows, cols - mid);
+    }
+}
+
+//transposes the n x n block on the diagonal at a
+static void InPlaceLeaf(float *a, int ld, int n)
+{
+    int full = n & ~(TILE - 1);
+    float tmp[TILE * TILE];
+
+    for(int i = 0; i < full; i += TILE) {
+        float *d = a + (size_t)i * ld + i;
+        tile8(d, ld, tmp, TILE);
+        for(int r = 0; r < TILE; r++) {
+            memcpy(d + (size_t)r * ld, tmp + r * TILE, TILE * sizeof(float));
+        }
+        for(int j = i + TILE; j < full; j += TILE) {
+            SwapTile(a + (size_t)i * ld + j, a + (size_t)j * ld + i, ld);
+        }
+    }
+    for(int i = 0; i < n; i++) {
+        for(int j = i < full ? full : i + 1; j < n; j++) {
+            float t = a[(size_t)i * ld + j];
+            a[(size_t)i * ld + j] = a[(size_t)j * ld + i];
+            a[(size_t)j * ld + i] = t;
+        }
+    }
+}
+
+static void InPlaceRecursive(float *a, int ld, int n)
+{
+    if(n <= transpose_leaf) {
+        InPlaceLeaf(a, ld, n);
+        return;
+    }
+    //transpose both diagonal blocks, then exchange the off-diagonal ones
+    int mid = Half(n);
+    InPlaceRecursive(a, ld, mid);
+    InPlaceRecursive(a + (size_t)mid * ld + mid, ld, n - mid);
+    SwapRecursive(a + mid, a + (size_t)mid * ld, ld, mid, n - mid);
+}
+
+/**
+ * MatrixNTransposeInPlace transposes a rows x cols matrix in its own
+ * storage, which then holds the cols x rows transpose.
+ *
+ * @param: rows, cols, the dimensions of mat
+ * @param: mat, pointer to the matrix, modified to contain its transpose
+ *
+ * @return: 1 on success, 0 if memory ran out (mat is then untouched)
+ *
+ * Square matrices swap tiles across the diagonal recursively and need no
+ * extra memory.  Other shapes follow the cycles of the permutation
+ * i * cols + j -> j * rows + i, using one bit per element to mark the
+ * elements already moved.
+ */
+int MatrixNTransposeInPlace(int rows, int cols, float *mat)
+{
+    MatrixTuneInit();
+    if(rows == cols) {
+        InPlaceRecursive(mat, cols, rows);
+        return 1;
+    }
+    if(rows <= 1 || cols <= 1) {
+        return 1;
+    }
+
+    //the first and last elements stay put; element k of the rest belongs
+    //at k * rows mod (total - 1)
+    size_t last = (size_t)rows * cols - 1;
+    MatrixArenaPos pos = MatrixArenaMark();
+    unsigned char *moved = MatrixArenaAlloc(last / 8 + 1);
+
+    if(moved == NULL) {
+        return 0;
+    }
+    memset(moved, 0, last / 8 + 1);
+    for(size_t start = 1; start < last; start++) {
+        if(moved[start >> 3] & (1 << (start & 7))) {
+            continue;
+        }
+        size_t k = start;
+        float carry = mat[start];
+        do {
+            size_t next = k * rows % last;
+            float t = mat[next];
+            mat[next] = carry;
+            carry = t;
+            moved[next >> 3] |= 1 << (next & 7);
+            k = next;
+        } while(k != start);
+    }
+    MatrixArenaRelease(pos);
+    return 1;
+}
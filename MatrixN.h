@@ -0,0 +1,129 @@
+#ifndef MATRIX_N_H
+#define MATRIX_N_H
+
+/**
+ * @file    MatrixN.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements the general-size counterparts of the MatrixMath.h
+ * functions.  Matrices are row-major arrays of floats with their dimensions
+ * passed alongside, so the rows x cols matrix M is stored as
+ * `float m[rows * cols]` with M(i, j) at `m[i * cols + j]`.
+ */
+
+/**
+ * MatrixNMultiply performs a matrix-matrix multiplication of an m x k matrix
+ * by a k x n matrix and "returns" the result by modifying the last argument.
+ *
+ * @param: m, k, n, the dimensions of the factors
+ * @param: mat1, pointer to the left m x k factor
+ * @param: mat2, pointer to the right k x n factor
+ * @param: result, pointer to an m x n matrix that is modified to contain the
+ *         matrix product of mat1 and mat2
+ *
+ * @return: none
+ *
+ * mat1 and mat2 are not modified by this function.  result must not overlap
+ * either factor.
+ */
+void MatrixNMultiply(int m, int k, int n, const float *mat1, const float *mat2,
+        float *result);
+
+/**
+ * MatrixNInverse calculates the inverse of an n x n matrix by Gauss-Jordan
+ * elimination with partial pivoting and "returns" the result by modifying
+ * the last argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         inverse of mat
+ *
+ * @return: 1 on success, 0 if mat is singular (or memory ran out), in which
+ *          case result is left untouched
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixNInverse(int n, const float *mat, float *result);
+
+/**
+ * MatrixNTranspose calculates the transpose of a rows x cols matrix and
+ * "returns" it by modifying the last argument.
+ *
+ * @param: rows, cols, the dimensions of mat
+ * @param: mat, pointer to a rows x cols matrix
+ * @param: result, pointer to a cols x rows matrix that is modified to contain
+ *         the transpose of mat
+ *
+ * @return: none
+ *
+ * The matrix is split recursively along its longer side, so every level of
+ * the memory hierarchy sees blocks that fit it without tuning, and the
+ * leaves are transposed as 8x8 tiles in SIMD registers.  result must not
+ * overlap mat.
+ */
+void MatrixNTranspose(int rows, int cols, const float *mat, float *result);
+
+/**
+ * MatrixNTransposeInPlace transposes a rows x cols matrix in its own
+ * storage, which then holds the cols x rows transpose.
+ *
+ * @param: rows, cols, the dimensions of mat
+ * @param: mat, pointer to the matrix, modified to contain its transpose
+ *
+ * @return: 1 on success, 0 if memory ran out (mat is then untouched)
+ *
+ * Square matrices swap tiles across the diagonal recursively and need no
+ * extra memory.  Other shapes follow the cycles of the permutation
+ * i * cols + j -> j * rows + i, using one bit per element to mark the
+ * elements already moved.
+ */
+int MatrixNTransposeInPlace(int rows, int cols, float *mat);
+
+/**
+ * MATRIX_TRANSPOSE_LEAF is the default size of the blocks the transposes
+ * stop recursing at.
+ */
+#define MATRIX_TRANSPOSE_LEAF 32
+
+/**
+ * Instruction sets of the transpose kernels.  The SSE kernel exists on x86
+ * only; the AVX one is built into every x86 library and used only if the
+ * CPU has AVX.
+ */
+#define MATRIX_ISA_SCALAR 0
+#define MATRIX_ISA_SSE 1
+#define MATRIX_ISA_AVX 2
+
+/**
+ * MatrixNSupportsKernel tells whether the CPU can run a transpose kernel.
+ *
+ * @param: isa, MATRIX_ISA_SCALAR, MATRIX_ISA_SSE or MATRIX_ISA_AVX
+ *
+ * @return: 1 if it can, 0 if not
+ */
+int MatrixNSupportsKernel(int isa);
+
+/**
+ * MatrixNSetTransposeKernel / MatrixNGetTransposeKernel select and read the
+ * instruction set the transpose tiles use.
+ *
+ * @param: isa, MATRIX_ISA_SCALAR, MATRIX_ISA_SSE or MATRIX_ISA_AVX
+ *
+ * @return: 1 on success, 0 if the CPU cannot run it (nothing changes)
+ */
+int MatrixNSetTransposeKernel(int isa);
+int MatrixNGetTransposeKernel(void);
+
+/**
+ * MatrixNSetTransposeLeaf / MatrixNGetTransposeLeaf set and read the block
+ * size at which the transposes stop recursing.
+ *
+ * @param: leaf, the size, rounded down to a multiple of 8 (at least 8)
+ */
+void MatrixNSetTransposeLeaf(int leaf);
+int MatrixNGetTransposeLeaf(void);
+
+#endif // MATRIX_N_H
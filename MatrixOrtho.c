@@ -0,0 +1,360 @@
+/**
+ * @file    MatrixOrtho.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "MatrixMath.h"
+#include "MatrixBatch.h"
+#include "MatrixArena.h"
+#include "MatrixOrtho.h"
+
+//matrices checked per pass of MatrixOrthonormalizeBatch(), sized for the stack
+#define ORTHO_CHUNK 256
+
+/**
+ * MatrixOrthoError measures how far a 3x3 matrix is from orthonormal.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ *
+ * @return: the largest absolute element of mat mat^T - I
+ */
+float MatrixOrthoError(float mat[3][3])
+{
+    float worst = 0;
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = i; j < DIM; j++) {
+            float dot = mat[i][0] * mat[j][0] + mat[i][1] * mat[j][1] +
+                    mat[i][2] * mat[j][2];
+            float e = fabsf(dot - (i == j ? 1 : 0));
+            if(e > worst) {
+                worst = e;
+            }
+        }
+    }
+    return worst;
+}
+
+/**
+ * MatrixOrthonormalize "returns" the rotation closest in the Gram-Schmidt
+ * sense to a 3x3 matrix by modifying the second argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix with linearly independent rows
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         re-orthonormalized matrix (may be the same as mat)
+ *
+ * @return: none
+ *
+ * The direction of row 0 is kept exactly; row 1 keeps its component
+ * orthogonal to row 0.
+ */
+void MatrixOrthonormalize(float mat[3][3], float result[3][3])
+{
+    float x[3], y[3], scale, dot;
+
+    scale = 1 / sqrtf(mat[0][0] * mat[0][0] + mat[0][1] * mat[0][1] +
+            mat[0][2] * mat[0][2]);
+    for(int k = 0; k < DIM; k++) {
+        x[k] = mat[0][k] * scale;
+    }
+
+    dot = x[0] * mat[1][0] + x[1] * mat[1][1] + x[2] * mat[1][2];
+    for(int k = 0; k < DIM; k++) {
+        y[k] = mat[1][k] - dot * x[k];
+    }
+    scale = 1 / sqrtf(y[0] * y[0] + y[1] * y[1] + y[2] * y[2]);
+    for(int k = 0; k < DIM; k++) {
+        y[k] *= scale;
+    }
+
+    //the third row is implied by the first two for a proper rotation
+    result[2][0] = x[1] * y[2] - x[2] * y[1];
+    result[2][1] = x[2] * y[0] - x[0] * y[2];
+    result[2][2] = x[0] * y[1] - x[1] * y[0];
+    memcpy(result[0], x, sizeof(x));
+    memcpy(result[1], y, sizeof(y));
+}
+
+//the error of matrices [0, len) of a batch given its element planes
+static void ErrorKernel(int len, float *const planes[3][3], float *errors)
+{
+    const float *m00 = planes[0][0], *m01 = planes[0][1], *m02 = planes[0][2];
+    const float *m10 = planes[1][0], *m11 = planes[1][1], *m12 = planes[1][2];
+    const float *m20 = planes[2][0], *m21 = planes[2][1], *m22 = planes[2][2];
+
+    for(int b = 0; b < len; b++) {
+        float d00 = m00[b] * m00[b] + m01[b] * m01[b] + m02[b] * m02[b] - 1;
+        float d11 = m10[b] * m10[b] + m11[b] * m11[b] + m12[b] * m12[b] - 1;
+        float d22 = m20[b] * m20[b] + m21[b] * m21[b] + m22[b] * m22[b] - 1;
+        float d01 = m00[b] * m10[b] + m01[b] * m11[b] + m02[b] * m12[b];
+        float d02 = m00[b] * m20[b] + m01[b] * m21[b] + m02[b] * m22[b];
+        float d12 = m10[b] * m20[b] + m11[b] * m21[b] + m12[b] * m22[b];
+
+        errors[b] = fmaxf(fmaxf(fmaxf(fabsf(d00), fabsf(d11)),
+                fmaxf(fabsf(d22), fabsf(d01))),
+                fmaxf(fabsf(d02), fabsf(d12)));
+    }
+}
+
+//MatrixOrthonormalize() of matrices [0, len) of a batch given its element
+//planes, in place; branch-free so the loop vectorizes across matrices (the
+//file is built without errno from sqrtf(), which would keep it scalar)
+static void RepairKernel(int len, float *const planes[3][3])
+{
+    float *m00 = planes[0][0], *m01 = planes[0][1], *m02 = planes[0][2];
+    float *m10 = planes[1][0], *m11 = planes[1][1], *m12 = planes[1][2];
+    float *m20 = planes[2][0], *m21 = planes[2][1], *m22 = planes[2][2];
+
+    for(int b = 0; b < len; b++) {
+        float scale = 1 / sqrtf(m00[b] * m00[b] + m01[b] * m01[b] +
+                m02[b] * m02[b]);
+        float x0 = m00[b] * scale, x1 = m01[b] * scale, x2 = m02[b] * scale;
+
+        float dot = x0 * m10[b] + x1 * m11[b] + x2 * m12[b];
+        float y0 = m10[b] - dot * x0;
+        float y1 = m11[b] - dot * x1;
+        float y2 = m12[b] - dot * x2;
+        scale = 1 / sqrtf(y0 * y0 + y1 * y1 + y2 * y2);
+        y0 *= scale;
+        y1 *= scale;
+        y2 *= scale;
+
+        m20[b] = x1 * y2 - x2 * y1;
+        m21[b] = x2 * y0 - x0 * y2;
+        m22[b] = x0 * y1 - x1 * y0;
+        m00[b] = x0;
+        m01[b] = x1;
+        m02[b] = x2;
+        m10[b] = y0;
+        m11[b] = y1;
+        m12[b] = y2;
+    }
+}
+
+/**
+ * MatrixOrthoErrorBatch is MatrixOrthoError() over a MatrixBatch.h SoA
+ * batch.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch
+ * @param: errors, count floats that are modified to hold the errors
+ */
+void MatrixOrthoErrorBatch(int count, const float *mats, float *errors)
+{
+    float *planes[3][3];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            planes[i][j] = (float *)MATRIX_SOA(mats, count, i, j);
+        }
+    }
+    ErrorKernel(count, planes, errors);
+}
+
+/**
+ * MatrixOrthonormalizeBatch re-orthonormalizes, in place, every matrix of a
+ * SoA batch whose MatrixOrthoError() exceeds threshold.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch, modified in place
+ * @param: threshold, the largest drift left alone
+ *
+ * @return: the number of matrices that were repaired
+ */
+int MatrixOrthonormalizeBatch(int count, float *mats, float threshold)
+{
+    float errors[ORTHO_CHUNK];
+    float work[DIM * DIM][ORTHO_CHUNK];
+    int flagged[ORTHO_CHUNK];
+    int repaired = 0;
+
+    //the vectorized check runs over every matrix; the drifted ones of a chunk
+    //are packed into a SoA of their own and repaired together
+    for(int start = 0; start < count; start += ORTHO_CHUNK) {
+        int len = (count - start < ORTHO_CHUNK) ? count - start : ORTHO_CHUNK;
+        float *planes[3][3], *packed[3][3];
+        int n = 0;
+
+        for(int i = 0; i < DIM; i++) {
+            for(int j = 0; j < DIM; j++) {
+                planes[i][j] = MATRIX_SOA(mats, count, i, j) + start;
+                packed[i][j] = work[i * DIM + j];
+            }
+        }
+        ErrorKernel(len, planes, errors);
+
+        for(int b = 0; b < len; b++) {
+            flagged[n] = b;
+            n += errors[b] > threshold;
+        }
+        if(n == 0) {
+            continue;
+        }
+        for(int i = 0; i < DIM; i++) {
+            for(int j = 0; j < DIM; j++) {
+                for(int k = 0; k < n; k++) {
+                    packed[i][j][k] = planes[i][j][flagged[k]];
+                }
+            }
+        }
+        RepairKernel(n, packed);
+        for(int i = 0; i < DIM; i++) {
+            for(int j = 0; j < DIM; j++) {
+                for(int k = 0; k < n; k++) {
+                    planes[i][j][flagged[k]] = packed[i][j][k];
+                }
+            }
+        }
+        repaired += n;
+    }
+    return repaired;
+}
+
+/**
+ * MatrixNQR calculates the Householder QR factorization mat = Q R of an
+ * n x n matrix.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: Q, pointer to an n x n matrix that is modified to contain the
+ *         orthogonal factor
+ * @param: R, pointer to an n x n matrix that is modified to contain the
+ *         upper triangular factor, with a non-negative diagonal
+ *
+ * @return: 1 on success, 0 if memory ran out
+ *
+ * mat is not modified by this function unless it is the same as R.
+ */
+int MatrixNQR(int n, const float *mat, float *Q, float *R)
+{
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *V = MatrixArenaAlloc(((size_t)n * n + n) * sizeof(float));
+    float *dots;
+
+    if(V == NULL) {
+        return 0;
+    }
+    dots = V + (size_t)n * n;
+    if(R != mat) {
+        memcpy(R, mat, (size_t)n * n * sizeof(float));
+    }
+
+    //reflector k zeroes column k below the diagonal; v_k is row k of V,
+    //holding entries k..n-1
+    for(int k = 0; k < n; k++) {
+        float *v = V + (size_t)k * n;
+        float norm = 0, vnorm = 0, alpha;
+
+        for(int i = k; i < n; i++) {
+            v[i] = R[(size_t)i * n + k];
+            norm += v[i] * v[i];
+        }
+        norm = sqrtf(norm);
+        alpha = (v[k] > 0) ? -norm : norm;
+        v[k] -= alpha;
+        for(int i = k; i < n; i++) {
+            vnorm += v[i] * v[i];
+        }
+        if(vnorm == 0) {
+            continue; //column already reduced
+        }
+        vnorm = 1 / sqrtf(vnorm);
+        for(int i = k; i < n; i++) {
+            v[i] *= vnorm;
+        }
+
+        //R[k:, k:] -= 2 v (v^T R[k:, k:]), accumulated row by row
+        for(int j = k; j < n; j++) {
+            dots[j] = 0;
+        }
+        for(int i = k; i < n; i++) {
+            const float *row = R + (size_t)i * n;
+            for(int j = k; j < n; j++) {
+                dots[j] += v[i] * row[j];
+            }
+        }
+        for(int i = k; i < n; i++) {
+            float *row = R + (size_t)i * n;
+            for(int j = k; j < n; j++) {
+                row[j] -= 2 * v[i] * dots[j];
+            }
+        }
+        for(int i = k + 1; i < n; i++) {
+            R[(size_t)i * n + k] = 0;
+        }
+    }
+
+    //Q = H_0 H_1 ... H_{n-1}, applied to the identity from the right end
+    memset(Q, 0, (size_t)n * n * sizeof(float));
+    for(int i = 0; i < n; i++) {
+        Q[(size_t)i * n + i] = 1;
+    }
+    for(int k = n - 1; k >= 0; k--) {
+        const float *v = V + (size_t)k * n;
+        float vv = 0;
+        for(int i = k; i < n; i++) {
+            vv += v[i] * v[i];
+        }
+        if(vv == 0) {
+            continue;
+        }
+        for(int j = 0; j < n; j++) {
+            dots[j] = 0;
+        }
+        for(int i = k; i < n; i++) {
+            const float *row = Q + (size_t)i * n;
+            for(int j = 0; j < n; j++) {
+                dots[j] += v[i] * row[j];
+            }
+        }
+        for(int i = k; i < n; i++) {
+            float *row = Q + (size_t)i * n;
+            for(int j = 0; j < n; j++) {
+                row[j] -= 2 * v[i] * dots[j];
+            }
+        }
+    }
+
+    //make diag(R) non-negative so Q matches Gram-Schmidt on the columns
+    for(int k = 0; k < n; k++) {
+        if(R[(size_t)k * n + k] < 0) {
+            for(int j = k; j < n; j++) {
+                R[(size_t)k * n + j] = -R[(size_t)k * n + j];
+            }
+            for(int i = 0; i < n; i++) {
+                Q[(size_t)i * n + k] = -Q[(size_t)i * n + k];
+            }
+        }
+    }
+    MatrixArenaRelease(pos);
+    return 1;
+}
+
+/**
+ * MatrixNOrthonormalize "returns" the Q factor of mat by modifying result,
+ * the NxN counterpart of MatrixOrthonormalize() applied to columns.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: result, pointer to an n x n matrix that is modified (may be the
+ *         same as mat)
+ *
+ * @return: 1 on success, 0 if memory ran out
+ */
+int MatrixNOrthonormalize(int n, const float *mat, float *result)
+{
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *R = MatrixArenaAlloc((size_t)n * n * sizeof(float));
+    int ok;
+
+    if(R == NULL) {
+        return 0;
+    }
+    memcpy(R, mat, (size_t)n * n * sizeof(float));
+    ok = MatrixNQR(n, R, result, R);
+    MatrixArenaRelease(pos);
+    return ok;
+}
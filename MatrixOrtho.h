@@ -0,0 +1,103 @@
+#ifndef MATRIX_ORTHO_H
+#define MATRIX_ORTHO_H
+
+/**
+ * @file    MatrixOrtho.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements orthonormality checks and repairs.  Rotation matrices
+ * built from long chains of float MatrixMultiply() calls slowly drift away
+ * from orthonormal; MatrixOrthoError() measures the drift cheaply so callers
+ * only pay for MatrixOrthonormalize() once it exceeds a threshold.
+ *
+ * The 3x3 repair is modified Gram-Schmidt on the first two rows with the
+ * third row rebuilt as their cross product, so the result is always a proper
+ * rotation (determinant +1).  The NxN repair is the Q factor of a Householder
+ * QR factorization.
+ */
+
+/**
+ * A reasonable default threshold for MatrixOrthonormalizeBatch(): well above
+ * float rounding of a freshly built rotation, well below visible skew.
+ */
+#define MATRIX_ORTHO_TOL 1e-5
+
+/**
+ * MatrixOrthoError measures how far a 3x3 matrix is from orthonormal.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ *
+ * @return: the largest absolute element of mat mat^T - I
+ */
+float MatrixOrthoError(float mat[3][3]);
+
+/**
+ * MatrixOrthonormalize "returns" the rotation closest in the Gram-Schmidt
+ * sense to a 3x3 matrix by modifying the second argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix with linearly independent rows
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         re-orthonormalized matrix (may be the same as mat)
+ *
+ * @return: none
+ *
+ * The direction of row 0 is kept exactly; row 1 keeps its component
+ * orthogonal to row 0.
+ */
+void MatrixOrthonormalize(float mat[3][3], float result[3][3]);
+
+/**
+ * MatrixOrthoErrorBatch is MatrixOrthoError() over a MatrixBatch.h SoA
+ * batch.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch
+ * @param: errors, count floats that are modified to hold the errors
+ */
+void MatrixOrthoErrorBatch(int count, const float *mats, float *errors);
+
+/**
+ * MatrixOrthonormalizeBatch re-orthonormalizes, in place, every matrix of a
+ * SoA batch whose MatrixOrthoError() exceeds threshold.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch, modified in place
+ * @param: threshold, the largest drift left alone
+ *
+ * @return: the number of matrices that were repaired
+ */
+int MatrixOrthonormalizeBatch(int count, float *mats, float threshold);
+
+/**
+ * MatrixNQR calculates the Householder QR factorization mat = Q R of an
+ * n x n matrix.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: Q, pointer to an n x n matrix that is modified to contain the
+ *         orthogonal factor
+ * @param: R, pointer to an n x n matrix that is modified to contain the
+ *         upper triangular factor, with a non-negative diagonal
+ *
+ * @return: 1 on success, 0 if memory ran out
+ *
+ * mat is not modified by this function unless it is the same as R.
+ */
+int MatrixNQR(int n, const float *mat, float *Q, float *R);
+
+/**
+ * MatrixNOrthonormalize "returns" the Q factor of mat by modifying result,
+ * the NxN counterpart of MatrixOrthonormalize() applied to columns.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: result, pointer to an n x n matrix that is modified (may be the
+ *         same as mat)
+ *
+ * @return: 1 on success, 0 if memory ran out
+ */
+int MatrixNOrthonormalize(int n, const float *mat, float *result);
+
+#endif // MATRIX_ORTHO_H
@@ -0,0 +1,589 @@
+/**
+ * @file    MatrixPipeline.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "MatrixArena.h"
+#include "MatrixPipeline.h"
+
+//the chunk size when L2 cannot be asked for
+#define DEFAULT_L2 (256 * 1024)
+#define MIN_CHUNK 64
+
+//chunk buffers in flight per stage of a concurrent run: one being worked
+//on, and one being filled by the stage before
+#define BUFFERS_PER_STAGE 2
+
+#define ROUND_UP(size) (((size) + MATRIX_ALIGN - 1) & ~(size_t)(MATRIX_ALIGN - 1))
+
+struct Stage {
+    const char *name;
+    MatrixSourceFn source;      //set for stage 0 only
+    MatrixStageFn fn;
+    void *arg;
+    float transform[3][3];      //for the built-in stages
+    float min_abs, max_abs;
+    int side;
+    struct MatrixStageStats stats;
+};
+
+//a chunk buffer of a concurrent run
+struct Slot {
+    float (*mats)[3][3];
+    int count;
+    int next;                   //the stage to run on it, 0 when it is free
+    int end;                    //the source had nothing left to put in it
+};
+
+struct Worker {
+    MatrixPipeline *p;
+    int s;
+};
+
+struct MatrixPipeline {
+    int chunk;
+    int stages;                 //stage[1 .. stages] are the added stages
+    struct Stage stage[MATRIX_PIPELINE_MAX_STAGES];
+    struct Stage output;
+
+    float (*in)[3][3];          //MatrixPipelineSetInput()
+    int in_count, in_pos;
+    float (*out)[3][3];         //MatrixPipelineSetOutput()
+    int out_capacity;
+    long long out_pos;
+
+    char *buffers;
+    size_t stride;              //bytes per chunk buffer
+    int num_buffers;
+
+    //the state of a concurrent run
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct Slot slots[BUFFERS_PER_STAGE * MATRIX_PIPELINE_MAX_STAGES];
+    int num_slots;
+    int total;                  //stages in this run, source and output included
+    int abort;
+};
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*******************************************************************************
+ * Built-in sources and stages
+ ******************************************************************************/
+
+static int InputSource(void *arg, float (*mats)[3][3], int max)
+{
+    MatrixPipeline *p = arg;
+    int count = p->in_count - p->in_pos < max ? p->in_count - p->in_pos : max;
+    const char *next = (const char *)(p->in + p->in_pos + count);
+    size_t ahead = (size_t)(p->in_count - p->in_pos - count < max ?
+            p->in_count - p->in_pos - count : max) * sizeof(*mats);
+
+    memcpy(mats, p->in + p->in_pos, count * sizeof(*mats));
+    p->in_pos += count;
+    //start reading the next chunk while the stages work on this one
+    for(size_t b = 0; b < ahead; b += MATRIX_ALIGN) {
+        __builtin_prefetch(next + b, 0, 2);
+    }
+    return count;
+}
+
+static int OutputStage(void *arg, float (*mats)[3][3], int count)
+{
+    MatrixPipeline *p = arg;
+
+    if(p->out_pos < p->out_capacity) {
+        long long room = p->out_capacity - p->out_pos;
+        memcpy(p->out + p->out_pos, mats,
+                (count < room ? count : room) * sizeof(*mats));
+    }
+    p->out_pos += count;
+    return count;
+}
+
+static int InverseStage(void *arg, float (*mats)[3][3], int count)
+{
+    int kept = 0;
+
+    (void)arg;
+    //MatrixInverse() leaves a singular matrix untouched, so it is tested
+    //first; the inverse only writes its result after reading all of mat
+    for(int i = 0; i < count; i++) {
+        if(MatrixDeterminant(mats[i]) != 0) {
+            MatrixInverse(mats[i], mats[kept++]);
+        }
+    }
+    return kept;
+}
+
+static int MultiplyStage(void *arg, float (*mats)[3][3], int count)
+{
+    struct Stage *stage = arg;
+    float result[3][3];
+
+    for(int i = 0; i < count; i++) {
+        if(stage->side == MATRIX_PIPELINE_LEFT) {
+            MatrixMultiply(stage->transform, mats[i], result);
+        } else {
+            MatrixMultiply(mats[i], stage->transform, result);
+        }
+        memcpy(mats[i], result, sizeof(result));
+    }
+    return count;
+}
+
+static int DeterminantFilterStage(void *arg, float (*mats)[3][3], int count)
+{
+    struct Stage *stage = arg;
+    int kept = 0;
+
+    for(int i = 0; i < count; i++) {
+        float det = fabsf(MatrixDeterminant(mats[i]));
+        //a NaN determinant fails both tests and is dropped
+        if(det >= stage->min_abs && det <= stage->max_abs) {
+            if(kept != i) {
+                memcpy(mats[kept], mats[i], sizeof(mats[i]));
+            }
+            kept++;
+        }
+    }
+    return kept;
+}
+
+/*******************************************************************************
+ * Building
+ ******************************************************************************/
+
+/**
+ * MatrixPipelineCreate creates a pipeline without a source or stages.
+ *
+ * @param: chunk, the matrices per chunk, or 0 for a quarter of L2
+ *
+ * @return: the pipeline, or NULL if memory ran out
+ */
+MatrixPipeline *MatrixPipelineCreate(int chunk)
+{
+    MatrixPipeline *p = MatrixAlloc(sizeof(*p));
+
+    if(p == NULL) {
+        return NULL;
+    }
+    memset(p, 0, sizeof(*p));
+    if(chunk <= 0) {
+        long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        //a quarter, so that the chunk being worked on and the next one
+        //being prefetched take half of L2 and leave room for the rest
+        chunk = (int)((l2 > 0 ? l2 : DEFAULT_L2) / 4 / sizeof(float[3][3]));
+        chunk = chunk > MIN_CHUNK ? chunk : MIN_CHUNK;
+    }
+    p->chunk = chunk;
+    p->stride = ROUND_UP((size_t)chunk * sizeof(float[3][3]));
+    p->output.name = "output";
+    p->output.fn = OutputStage;
+    p->output.arg = p;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->changed, NULL);
+    return p;
+}
+
+/**
+ * MatrixPipelineChunk gives the matrices per chunk.
+ *
+ * @param: p, the pipeline
+ *
+ * @return: the chunk size
+ */
+int MatrixPipelineChunk(const MatrixPipeline *p)
+{
+    return p->chunk;
+}
+
+/**
+ * MatrixPipelineSetInput / MatrixPipelineSetSource set where the matrices
+ * come from, replacing any earlier source.  An array is read from the start
+ * on every run.
+ *
+ * @param: p, the pipeline
+ * @param: mats, the input matrices, which must outlive the runs
+ * @param: count, the number of them
+ * @param: name, the stage name in the statistics
+ * @param: fn, the source
+ * @param: arg, passed to every call of fn
+ */
+void MatrixPipelineSetInput(MatrixPipeline *p, float (*mats)[3][3], int count)
+{
+    p->in = mats;
+    p->in_count = count > 0 ? count : 0;
+    MatrixPipelineSetSource(p, "input", InputSource, p);
+}
+
+void MatrixPipelineSetSource(MatrixPipeline *p, const char *name,
+        MatrixSourceFn fn, void *arg)
+{
+    p->stage[0].name = name;
+    p->stage[0].source = fn;
+    p->stage[0].arg = arg;
+}
+
+/**
+ * MatrixPipelineSetOutput makes the pipeline write what leaves its last
+ * stage to an array, in order, after every stage added.
+ *
+ * @param: p, the pipeline
+ * @param: mats, the output array, or NULL for none
+ * @param: capacity, its size in matrices; matrices past it are counted but
+ *         not written
+ */
+void MatrixPipelineSetOutput(MatrixPipeline *p, float (*mats)[3][3],
+        int capacity)
+{
+    p->out = mats;
+    p->out_capacity = capacity > 0 ? capacity : 0;
+}
+
+//the next free stage, or NULL; one place is kept for the output
+static struct Stage *NewStage(MatrixPipeline *p, const char *name,
+        MatrixStageFn fn)
+{
+    struct Stage *stage;
+
+    if(p->stages + 2 >= MATRIX_PIPELINE_MAX_STAGES) {
+        return NULL;
+    }
+    stage = &p->stage[++p->stages];
+    memset(stage, 0, sizeof(*stage));
+    stage->name = name;
+    stage->fn = fn;
+    stage->arg = stage;
+    return stage;
+}
+
+/**
+ * MatrixPipelineAddStage appends a callback stage.
+ *
+ * @param: p, the pipeline
+ * @param: name, the stage name in the statistics
+ * @param: fn, the stage
+ * @param: arg, passed to every call of fn
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddStage(MatrixPipeline *p, const char *name,
+        MatrixStageFn fn, void *arg)
+{
+    struct Stage *stage = NewStage(p, name, fn);
+
+    if(stage == NULL) {
+        return 0;
+    }
+    stage->arg = arg;
+    return 1;
+}
+
+/**
+ * MatrixPipelineAddInverse appends a stage that replaces every matrix by
+ * its MatrixInverse() and drops singular ones.
+ *
+ * @param: p, the pipeline
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddInverse(MatrixPipeline *p)
+{
+    return NewStage(p, "MatrixInverse", InverseStage) != NULL;
+}
+
+/**
+ * MatrixPipelineAddMultiply appends a stage that multiplies every matrix by
+ * a fixed transform with MatrixMultiply().
+ *
+ * @param: p, the pipeline
+ * @param: transform, the transform (copied)
+ * @param: side, MATRIX_PIPELINE_LEFT or MATRIX_PIPELINE_RIGHT
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddMultiply(MatrixPipeline *p, float transform[3][3],
+        int side)
+{
+    struct Stage *stage = NewStage(p, "MatrixMultiply", MultiplyStage);
+
+    if(stage == NULL) {
+        return 0;
+    }
+    memcpy(stage->transform, transform, sizeof(stage->transform));
+    stage->side = side;
+    return 1;
+}
+
+/**
+ * MatrixPipelineAddDeterminantFilter appends a stage that keeps the
+ * matrices whose MatrixDeterminant() has an absolute value in
+ * [min_abs, max_abs].
+ *
+ * @param: p, the pipeline
+ * @param: min_abs, the smallest |det| kept
+ * @param: max_abs, the largest |det| kept
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddDeterminantFilter(MatrixPipeline *p, float min_abs,
+        float max_abs)
+{
+    struct Stage *stage = NewStage(p, "MatrixDeterminant filter",
+            DeterminantFilterStage);
+
+    if(stage == NULL) {
+        return 0;
+    }
+    stage->min_abs = min_abs;
+    stage->max_abs = max_abs;
+    return 1;
+}
+
+/*******************************************************************************
+ * Running
+ ******************************************************************************/
+
+//stage s of this run: the output follows the added stages
+static struct Stage *RunStage(MatrixPipeline *p, int s)
+{
+    return s <= p->stages ? &p->stage[s] : &p->output;
+}
+
+//runs stage s on a chunk and returns what it kept; the source fills it
+static int Process(MatrixPipeline *p, int s, float (*mats)[3][3], int count)
+{
+    struct Stage *stage = RunStage(p, s);
+    double start = Now();
+
+    if(s == 0) {
+        count = stage->source(stage->arg, mats, p->chunk);
+        //a misbehaving source must not overrun the buffer
+        count = count < 0 ? 0 : count > p->chunk ? p->chunk : count;
+        if(count == 0) {
+            stage->stats.busy += Now() - start;
+            return 0;
+        }
+        stage->stats.items_in += count;
+    } else {
+        stage->stats.items_in += count;
+        count = stage->fn(stage->arg, mats, count);
+    }
+    stage->stats.busy += Now() - start;
+    stage->stats.chunks++;
+    stage->stats.items_out += count;
+    return count;
+}
+
+static void RunFused(MatrixPipeline *p)
+{
+    float (*mats)[3][3] = (float (*)[3][3])p->buffers;
+    int count;
+
+    while((count = Process(p, 0, mats, 0)) > 0) {
+        for(int s = 1; s < p->total && count > 0; s++) {
+            count = Process(p, s, mats, count);
+        }
+    }
+}
+
+//waits until slot is due for stage s; returns 0 if the run was abandoned
+static int WaitFor(MatrixPipeline *p, struct Slot *slot, int s)
+{
+    double start = Now();
+    int abort;
+
+    pthread_mutex_lock(&p->lock);
+    while(slot->next != s && !p->abort) {
+        pthread_cond_wait(&p->changed, &p->lock);
+    }
+    abort = p->abort;
+    pthread_mutex_unlock(&p->lock);
+    RunStage(p, s)->stats.wait += Now() - start;
+    return !abort;
+}
+
+//hands slot on from stage s to the next one, or back to the source
+static void HandOn(MatrixPipeline *p, struct Slot *slot, int s)
+{
+    pthread_mutex_lock(&p->lock);
+    slot->next = (s + 1) % p->total;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+//stage s takes the slots in turn, so chunks keep their order
+static void *StageThread(void *arg)
+{
+    struct Worker *w = arg;
+    MatrixPipeline *p = w->p;
+
+    for(int k = 0; ; k++) {
+        struct Slot *slot = &p->slots[k % p->num_slots];
+        int end;
+        if(!WaitFor(p, slot, w->s)) {
+            return NULL;
+        }
+        end = slot->end;
+        if(!end && slot->count > 0) {
+            slot->count = Process(p, w->s, slot->mats, slot->count);
+        }
+        HandOn(p, slot, w->s);
+        if(end) {
+            return NULL;
+        }
+    }
+}
+
+//returns 0, having run nothing, if the stage threads could not be started
+static int RunConcurrent(MatrixPipeline *p)
+{
+    struct Worker workers[MATRIX_PIPELINE_MAX_STAGES];
+    pthread_t ids[MATRIX_PIPELINE_MAX_STAGES];
+    int started;
+
+    p->num_slots = BUFFERS_PER_STAGE * p->total;
+    for(int k = 0; k < p->num_slots; k++) {
+        p->slots[k].mats = (float (*)[3][3])(p->buffers + k * p->stride);
+        p->slots[k].count = 0;
+        p->slots[k].next = 0;
+        p->slots[k].end = 0;
+    }
+    p->abort = 0;
+    for(started = 1; started < p->total; started++) {
+        workers[started] = (struct Worker){p, started};
+        if(pthread_create(&ids[started], NULL, StageThread,
+                &workers[started]) != 0) {
+            break;
+        }
+    }
+    if(started < p->total) {
+        pthread_mutex_lock(&p->lock);
+        p->abort = 1;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+    } else {
+        //the calling thread is the source
+        for(int k = 0; ; k++) {
+            struct Slot *slot = &p->slots[k % p->num_slots];
+            WaitFor(p, slot, 0);
+            slot->count = Process(p, 0, slot->mats, 0);
+            slot->end = slot->count == 0;
+            HandOn(p, slot, 0);
+            if(slot->end) {
+                break;
+            }
+        }
+    }
+    for(int s = 1; s < started; s++) {
+        pthread_join(ids[s], NULL);
+    }
+    return started == p->total;
+}
+
+/**
+ * MatrixPipelineRun streams the source through the stages until it ends.
+ * If the threads of a concurrent run cannot be started, it runs fused.
+ *
+ * @param: p, the pipeline
+ * @param: mode, MATRIX_PIPELINE_FUSED or MATRIX_PIPELINE_CONCURRENT
+ *
+ * @return: the number of matrices that left the last stage, or -1 if the
+ *          pipeline has no source or memory ran out
+ */
+long long MatrixPipelineRun(MatrixPipeline *p, int mode)
+{
+    int buffers;
+
+    if(p->stage[0].source == NULL) {
+        return -1;
+    }
+    p->total = p->stages + 1 + (p->out != NULL);
+    buffers = mode == MATRIX_PIPELINE_CONCURRENT && p->total > 1 ?
+            BUFFERS_PER_STAGE * p->total : 1;
+    //the buffers are kept for the next run
+    if(buffers > p->num_buffers) {
+        char *grown = MatrixAlloc(buffers * p->stride);
+        if(grown == NULL) {
+            return -1;
+        }
+        MatrixFree(p->buffers);
+        p->buffers = grown;
+        p->num_buffers = buffers;
+    }
+    for(int s = 0; s < p->total; s++) {
+        struct Stage *stage = RunStage(p, s);
+        memset(&stage->stats, 0, sizeof(stage->stats));
+    }
+    p->in_pos = 0;
+    p->out_pos = 0;
+
+    if(buffers == 1 || !RunConcurrent(p)) {
+        RunFused(p);
+    }
+    return RunStage(p, p->total - 1)->stats.items_out;
+}
+
+/**
+ * MatrixPipelineStages counts the stages, the source and output included.
+ *
+ * @param: p, the pipeline
+ *
+ * @return: the number of stages
+ */
+int MatrixPipelineStages(const MatrixPipeline *p)
+{
+    return p->stages + 1 + (p->out != NULL);
+}
+
+/**
+ * MatrixPipelineGetStats copies what stage s did during the last run.
+ *
+ * @param: p, the pipeline
+ * @param: s, the stage, 0 for the source
+ * @param: stats, pointer to the struct to fill
+ *
+ * @return: 1 on success, 0 if there is no stage s
+ */
+int MatrixPipelineGetStats(const MatrixPipeline *p, int s,
+        struct MatrixStageStats *stats)
+{
+    const struct Stage *stage;
+
+    if(s < 0 || s >= MatrixPipelineStages(p)) {
+        return 0;
+    }
+    stage = s <= p->stages ? &p->stage[s] : &p->output;
+    *stats = stage->stats;
+    stats->name = stage->name;
+    stats->items_per_second = stats->busy > 0 ? stats->items_in / stats->busy :
+            0;
+    return 1;
+}
+
+/**
+ * MatrixPipelineDestroy frees a pipeline.
+ *
+ * @param: p, the pipeline, or NULL
+ */
+void MatrixPipelineDestroy(MatrixPipeline *p)
+{
+    if(p == NULL) {
+        return;
+    }
+    MatrixFree(p->buffers);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->changed);
+    MatrixFree(p);
+}
@@ -0,0 +1,225 @@
+#ifndef MATRIX_PIPELINE_H
+#define MATRIX_PIPELINE_H
+
+/**
+ * @file    MatrixPipeline.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements streaming pipelines of 3x3 operations over datasets
+ * too large for the cache.  Instead of one full pass over memory per
+ * operation, the data is cut into chunks of a few thousand matrices that
+ * fit in L2, and each chunk goes through every stage before the next one
+ * is read.  A pipeline is:
+ *
+ *  - a source that fills a chunk: an array (MatrixPipelineSetInput()) or a
+ *    callback, e.g. a parser (MatrixPipelineSetSource());
+ *  - stages that transform a chunk in place and may drop matrices from it:
+ *    MatrixInverse(), MatrixMultiply() by a fixed transform, a
+ *    MatrixDeterminant() filter, or a callback;
+ *  - optionally an output array, written in order.
+ *
+ * A pipeline runs in one of two modes:
+ *  - MATRIX_PIPELINE_FUSED: the calling thread takes each chunk through all
+ *    of the stages while it is hot in its L2.  An array source prefetches
+ *    the next chunk while the stages work on the current one, so two chunks
+ *    (the default size is a quarter of L2 each) are in the cache at once.
+ *  - MATRIX_PIPELINE_CONCURRENT: every stage, and the source, runs on a
+ *    thread of its own, with two chunk buffers per stage in flight, so that
+ *    stage s works on one chunk while stage s - 1 fills the next.  This
+ *    pays when the stages are of similar cost; a chunk moves between cores
+ *    through the shared cache.
+ * Either way the output keeps the order of the input.  Every stage counts
+ * the chunks and matrices it handled and the time it spent, for
+ * MatrixPipelineGetStats().
+ */
+
+#include "MatrixMath.h"
+
+/**
+ * MATRIX_PIPELINE_MAX_STAGES is the most stages a pipeline can have,
+ * counting the source and the output.
+ */
+#define MATRIX_PIPELINE_MAX_STAGES 16
+
+/**
+ * Run modes, for MatrixPipelineRun().
+ */
+#define MATRIX_PIPELINE_FUSED 0
+#define MATRIX_PIPELINE_CONCURRENT 1
+
+/**
+ * Sides of the fixed transform in MatrixPipelineAddMultiply().
+ */
+#define MATRIX_PIPELINE_LEFT 0      //transform * mat
+#define MATRIX_PIPELINE_RIGHT 1     //mat * transform
+
+/**
+ * A source fills mats with up to `max` matrices.
+ *
+ * @return: the number filled, 0 at the end of the data
+ */
+typedef int (*MatrixSourceFn)(void *arg, float (*mats)[3][3], int max);
+
+/**
+ * A stage processes the `count` matrices of a chunk in place.  It may drop
+ * matrices by moving the ones it keeps to the front, in order.
+ *
+ * @return: the number of matrices kept
+ */
+typedef int (*MatrixStageFn)(void *arg, float (*mats)[3][3], int count);
+
+/**
+ * What a stage did during the last MatrixPipelineRun().  Stage 0 is the
+ * source; its items_in and items_out are the matrices it produced.
+ */
+struct MatrixStageStats {
+    const char *name;
+    long long chunks;           //chunks processed
+    long long items_in;         //matrices handed to the stage
+    long long items_out;        //matrices it passed on
+    double busy;                //seconds spent in the stage
+    double wait;                //seconds spent waiting for a chunk or buffer
+    double items_per_second;    //items_in / busy
+};
+
+typedef struct MatrixPipeline MatrixPipeline;
+
+/**
+ * MatrixPipelineCreate creates a pipeline without a source or stages.
+ *
+ * @param: chunk, the matrices per chunk, or 0 for a quarter of L2
+ *
+ * @return: the pipeline, or NULL if memory ran out
+ */
+MatrixPipeline *MatrixPipelineCreate(int chunk);
+
+/**
+ * MatrixPipelineChunk gives the matrices per chunk.
+ *
+ * @param: p, the pipeline
+ *
+ * @return: the chunk size
+ */
+int MatrixPipelineChunk(const MatrixPipeline *p);
+
+/**
+ * MatrixPipelineSetInput / MatrixPipelineSetSource set where the matrices
+ * come from, replacing any earlier source.  An array is read from the start
+ * on every run.
+ *
+ * @param: p, the pipeline
+ * @param: mats, the input matrices, which must outlive the runs
+ * @param: count, the number of them
+ * @param: name, the stage name in the statistics
+ * @param: fn, the source
+ * @param: arg, passed to every call of fn
+ */
+void MatrixPipelineSetInput(MatrixPipeline *p, float (*mats)[3][3], int count);
+void MatrixPipelineSetSource(MatrixPipeline *p, const char *name,
+        MatrixSourceFn fn, void *arg);
+
+/**
+ * MatrixPipelineSetOutput makes the pipeline write what leaves its last
+ * stage to an array, in order, after every stage added.
+ *
+ * @param: p, the pipeline
+ * @param: mats, the output array, or NULL for none
+ * @param: capacity, its size in matrices; matrices past it are counted but
+ *         not written
+ */
+void MatrixPipelineSetOutput(MatrixPipeline *p, float (*mats)[3][3],
+        int capacity);
+
+/**
+ * MatrixPipelineAddStage appends a callback stage.
+ *
+ * @param: p, the pipeline
+ * @param: name, the stage name in the statistics
+ * @param: fn, the stage
+ * @param: arg, passed to every call of fn
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddStage(MatrixPipeline *p, const char *name,
+        MatrixStageFn fn, void *arg);
+
+/**
+ * MatrixPipelineAddInverse appends a stage that replaces every matrix by
+ * its MatrixInverse() and drops singular ones.
+ *
+ * @param: p, the pipeline
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddInverse(MatrixPipeline *p);
+
+/**
+ * MatrixPipelineAddMultiply appends a stage that multiplies every matrix by
+ * a fixed transform with MatrixMultiply().
+ *
+ * @param: p, the pipeline
+ * @param: transform, the transform (copied)
+ * @param: side, MATRIX_PIPELINE_LEFT or MATRIX_PIPELINE_RIGHT
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddMultiply(MatrixPipeline *p, float transform[3][3],
+        int side);
+
+/**
+ * MatrixPipelineAddDeterminantFilter appends a stage that keeps the
+ * matrices whose MatrixDeterminant() has an absolute value in
+ * [min_abs, max_abs].
+ *
+ * @param: p, the pipeline
+ * @param: min_abs, the smallest |det| kept
+ * @param: max_abs, the largest |det| kept
+ *
+ * @return: 1 on success, 0 if the pipeline is full
+ */
+int MatrixPipelineAddDeterminantFilter(MatrixPipeline *p, float min_abs,
+        float max_abs);
+
+/**
+ * MatrixPipelineRun streams the source through the stages until it ends.
+ * If the threads of a concurrent run cannot be started, it runs fused.
+ *
+ * @param: p, the pipeline
+ * @param: mode, MATRIX_PIPELINE_FUSED or MATRIX_PIPELINE_CONCURRENT
+ *
+ * @return: the number of matrices that left the last stage, or -1 if the
+ *          pipeline has no source or memory ran out
+ */
+long long MatrixPipelineRun(MatrixPipeline *p, int mode);
+
+/**
+ * MatrixPipelineStages counts the stages, the source and output included.
+ *
+ * @param: p, the pipeline
+ *
+ * @return: the number of stages
+ */
+int MatrixPipelineStages(const MatrixPipeline *p);
+
+/**
+ * MatrixPipelineGetStats copies what stage s did during the last run.
+ *
+ * @param: p, the pipeline
+ * @param: s, the stage, 0 for the source
+ * @param: stats, pointer to the struct to fill
+ *
+ * @return: 1 on success, 0 if there is no stage s
+ */
+int MatrixPipelineGetStats(const MatrixPipeline *p, int s,
+        struct MatrixStageStats *stats);
+
+/**
+ * MatrixPipelineDestroy frees a pipeline.
+ *
+ * @param: p, the pipeline, or NULL
+ */
+void MatrixPipelineDestroy(MatrixPipeline *p);
+
+#endif // MATRIX_PIPELINE_H
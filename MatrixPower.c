@@ -0,0 +1,436 @@
+/**
+ * @file    MatrixPower.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "MatrixMath.h"
+#include "MatrixN.h"
+#include "MatrixArena.h"
+#include "MatrixPower.h"
+
+//coefficients of the [6/6] Pade approximant to e^x
+static const float pade[7] = {
+    1.0f, 1.0f / 2, 5.0f / 44, 1.0f / 66, 1.0f / 792, 1.0f / 15840,
+    1.0f / 665280
+};
+
+//the approximant is accurate to float precision for ||X||_1 <= PADE_NORM
+#define PADE_NORM 0.5f
+
+//number of squarings s so that ||mat||_1 / 2^s <= PADE_NORM
+static int ScalingSteps(float norm)
+{
+    int s;
+    if(!(norm > PADE_NORM) || !isfinite(norm)) {
+        return 0;
+    }
+    frexpf(norm / PADE_NORM, &s);
+    return s;
+}
+
+static float Norm1(int n, const float *mat)
+{
+    float best = 0;
+    for(int j = 0; j < n; j++) {
+        float sum = 0;
+        for(int i = 0; i < n; i++) {
+            sum += fabsf(mat[(size_t)i * n + j]);
+        }
+        if(sum > best) {
+            best = sum;
+        }
+    }
+    return best;
+}
+
+static void Identity(int n, float *mat)
+{
+    memset(mat, 0, (size_t)n * n * sizeof(float));
+    for(int i = 0; i < n; i++) {
+        mat[(size_t)i * n + i] = 1;
+    }
+}
+
+/**
+ * MatrixPower raises a 3x3 matrix to a non-negative integer power and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: k, the exponent; mat^0 is the identity
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain
+ *         mat^k
+ *
+ * @return: none
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+void MatrixPower(float mat[3][3], unsigned int k, float result[3][3])
+{
+    float acc_buf[2][3][3], base_buf[2][3][3];
+    int acc = -1, base = 0; //acc == -1 means the identity, not yet formed
+
+    memcpy(base_buf[0], mat, sizeof(base_buf[0]));
+    while(k > 0) {
+        if(k & 1) {
+            if(acc < 0) {
+                memcpy(acc_buf[0], base_buf[base], sizeof(acc_buf[0]));
+                acc = 0;
+            } else {
+                MatrixMultiply(acc_buf[acc], base_buf[base], acc_buf[!acc]);
+                acc = !acc;
+            }
+        }
+        k >>= 1;
+        if(k > 0) {
+            MatrixMultiply(base_buf[base], base_buf[base], base_buf[!base]);
+            base = !base;
+        }
+    }
+
+    if(acc < 0) {
+        Identity(DIM, &result[0][0]);
+    } else {
+        memcpy(result, acc_buf[acc], sizeof(acc_buf[acc]));
+    }
+}
+
+//extra scaling steps tried when the Pade denominator is singular
+#define EXTRA_STEPS 4
+
+//the Pade approximant of e^(mat / 2^s); returns 0, leaving r untouched, if
+//its denominator is singular
+static int Pade(float mat[3][3], int s, float r[3][3])
+{
+    float x[3][3], x2[3][3], x4[3][3], x6[3][3], t[3][3], u[3][3], v[3][3];
+    float num[3][3], den[3][3], den_inv[3][3], det;
+
+    MatrixScalarMultiply(ldexpf(1.0f, -s), mat, x);
+    MatrixMultiply(x, x, x2);
+    MatrixMultiply(x2, x2, x4);
+    MatrixMultiply(x4, x2, x6);
+
+    //u holds the odd terms, v the even ones: e^x ~ (v + u) / (v - u)
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            float id = (i == j) ? 1 : 0;
+            t[i][j] = pade[1] * id + pade[3] * x2[i][j] + pade[5] * x4[i][j];
+            v[i][j] = pade[0] * id + pade[2] * x2[i][j] + pade[4] * x4[i][j]
+                    + pade[6] * x6[i][j];
+        }
+    }
+    MatrixMultiply(x, t, u);
+    MatrixAdd(v, u, num);
+    MatrixScalarMultiply(-1, u, t);
+    MatrixAdd(v, t, den);
+
+    //MatrixInverse() would leave den_inv unset
+    det = MatrixDeterminant(den);
+    if(det == 0 || !isfinite(det)) {
+        return 0;
+    }
+    MatrixInverse(den, den_inv);
+    MatrixMultiply(den_inv, num, r);
+    return 1;
+}
+
+/**
+ * MatrixExp calculates the matrix exponential e^mat of a 3x3 matrix and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain
+ *         e^mat
+ *
+ * @return: 1 on success, 0 if mat is not finite or the approximant cannot
+ *          be formed (result left untouched)
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixExp(float mat[3][3], float result[3][3])
+{
+    float sq[2][3][3];
+    int s = ScalingSteps(Norm1(DIM, &mat[0][0]));
+    int cur = 0, extra = 0;
+
+    //scale so the approximant converges, then undo it by squaring s times;
+    //a singular denominator is cured by scaling further towards the
+    //identity, unless mat is not finite
+    while(!Pade(mat, s + extra, sq[cur])) {
+        if(++extra > EXTRA_STEPS) {
+            return 0;
+        }
+    }
+    for(int step = 0; step < s + extra; step++) {
+        MatrixMultiply(sq[cur], sq[cur], sq[!cur]);
+        cur = !cur;
+    }
+    memcpy(result, sq[cur], sizeof(sq[cur]));
+    return 1;
+}
+
+/**
+ * MatrixPowerBatch and MatrixExpBatch apply MatrixPower() / MatrixExp() to
+ * each of `count` matrices.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, an array of count 3x3 matrices
+ * @param: results, an array of count 3x3 matrices that is modified to hold
+ *         the results, in order
+ *
+ * @return: MatrixExpBatch gives the number of matrices MatrixExp() failed
+ *          on, whose results are left untouched
+ */
+void MatrixPowerBatch(int count, float mats[][3][3], unsigned int k,
+        float results[][3][3])
+{
+    for(int b = 0; b < count; b++) {
+        MatrixPower(mats[b], k, results[b]);
+    }
+}
+
+int MatrixExpBatch(int count, float mats[][3][3], float results[][3][3])
+{
+    int failed = 0;
+
+    for(int b = 0; b < count; b++) {
+        failed += !MatrixExp(mats[b], results[b]);
+    }
+    return failed;
+}
+
+//MatrixNPower on caller-provided work space of 4 n x n matrices
+static void PowerN(int n, const float *mat, unsigned int k, float *result,
+        float *work)
+{
+    size_t nn = (size_t)n * n;
+    float *acc_buf[2] = {work, work + nn};
+    float *base_buf[2] = {work + 2 * nn, work + 3 * nn};
+    int acc = -1, base = 0;
+
+    memcpy(base_buf[0], mat, nn * sizeof(float));
+    while(k > 0) {
+        if(k & 1) {
+            if(acc < 0) {
+                memcpy(acc_buf[0], base_buf[base], nn * sizeof(float));
+                acc = 0;
+            } else {
+                MatrixNMultiply(n, n, n, acc_buf[acc], base_buf[base],
+                        acc_buf[!acc]);
+                acc = !acc;
+            }
+        }
+        k >>= 1;
+        if(k > 0) {
+            MatrixNMultiply(n, n, n, base_buf[base], base_buf[base],
+                    base_buf[!base]);
+            base = !base;
+        }
+    }
+
+    if(acc < 0) {
+        Identity(n, result);
+    } else {
+        memcpy(result, acc_buf[acc], nn * sizeof(float));
+    }
+}
+
+/**
+ * Overwrites b with den^-1 b by Gaussian elimination with partial pivoting,
+ * destroying den.  Returns 0 if a pivot is zero or not finite (b is then
+ * partly overwritten), which the Pade denominator of a finite, scaled matrix
+ * only gives in float round-off.
+ */
+static int SolveInPlace(int n, float *den, float *b)
+{
+    for(int c = 0; c < n; c++) {
+        int pivot = c;
+        for(int i = c + 1; i < n; i++) {
+            if(fabsf(den[(size_t)i * n + c]) >
+                    fabsf(den[(size_t)pivot * n + c])) {
+                pivot = i;
+            }
+        }
+        if(pivot != c) {
+            for(int j = 0; j < n; j++) {
+                float t = den[(size_t)c * n + j];
+                den[(size_t)c * n + j] = den[(size_t)pivot * n + j];
+                den[(size_t)pivot * n + j] = t;
+                t = b[(size_t)c * n + j];
+                b[(size_t)c * n + j] = b[(size_t)pivot * n + j];
+                b[(size_t)pivot * n + j] = t;
+            }
+        }
+        if(den[(size_t)c * n + c] == 0 || !isfinite(den[(size_t)c * n + c])) {
+            return 0;
+        }
+        for(int i = c + 1; i < n; i++) {
+            float f = den[(size_t)i * n + c] / den[(size_t)c * n + c];
+            if(f == 0) {
+                continue;
+            }
+            for(int j = c; j < n; j++) {
+                den[(size_t)i * n + j] -= f * den[(size_t)c * n + j];
+            }
+            for(int j = 0; j < n; j++) {
+                b[(size_t)i * n + j] -= f * b[(size_t)c * n + j];
+            }
+        }
+    }
+    for(int c = n - 1; c >= 0; c--) {
+        float inv_pivot = 1 / den[(size_t)c * n + c];
+        float *brow = b + (size_t)c * n;
+        for(int j = 0; j < n; j++) {
+            brow[j] *= inv_pivot;
+        }
+        for(int i = 0; i < c; i++) {
+            float f = den[(size_t)i * n + c];
+            for(int j = 0; j < n; j++) {
+                b[(size_t)i * n + j] -= f * brow[j];
+            }
+        }
+    }
+    return 1;
+}
+
+//the Pade approximant of e^(mat / 2^s) into work + nn, on work space of 6
+//n x n matrices; returns 0 if its denominator is singular
+static int PadeN(int n, const float *mat, int s, float *work)
+{
+    size_t nn = (size_t)n * n;
+    float *x = work, *x2 = work + nn, *x4 = work + 2 * nn;
+    float *x6 = work + 3 * nn, *u = work + 4 * nn, *v = work + 5 * nn;
+    float scale = ldexpf(1.0f, -s);
+
+    for(size_t e = 0; e < nn; e++) {
+        x[e] = mat[e] * scale;
+    }
+    MatrixNMultiply(n, n, n, x, x, x2);
+    MatrixNMultiply(n, n, n, x2, x2, x4);
+    MatrixNMultiply(n, n, n, x4, x2, x6);
+
+    //x6 is reused for the odd polynomial once v has consumed it
+    for(size_t e = 0; e < nn; e++) {
+        v[e] = pade[2] * x2[e] + pade[4] * x4[e] + pade[6] * x6[e];
+        x6[e] = pade[3] * x2[e] + pade[5] * x4[e];
+    }
+    for(int i = 0; i < n; i++) {
+        v[(size_t)i * n + i] += pade[0];
+        x6[(size_t)i * n + i] += pade[1];
+    }
+    MatrixNMultiply(n, n, n, x, x6, u);
+
+    //numerator v + u lands in x2, denominator v - u in x4
+    for(size_t e = 0; e < nn; e++) {
+        x2[e] = v[e] + u[e];
+        x4[e] = v[e] - u[e];
+    }
+    return SolveInPlace(n, x4, x2);
+}
+
+//MatrixNExp on caller-provided work space of 6 n x n matrices, with the
+//retries of MatrixExp()
+static int ExpN(int n, const float *mat, float *result, float *work)
+{
+    size_t nn = (size_t)n * n;
+    int s = ScalingSteps(Norm1(n, mat));
+    int cur = 0, extra = 0;
+    float *sq[2];
+
+    while(!PadeN(n, mat, s + extra, work)) {
+        if(++extra > EXTRA_STEPS) {
+            return 0;
+        }
+    }
+    sq[0] = work + nn;
+    sq[1] = work;
+    for(int step = 0; step < s + extra; step++) {
+        MatrixNMultiply(n, n, n, sq[cur], sq[cur], sq[!cur]);
+        cur = !cur;
+    }
+    memcpy(result, sq[cur], nn * sizeof(float));
+    return 1;
+}
+
+/**
+ * MatrixNPower raises an n x n matrix to a non-negative integer power and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: k, the exponent; mat^0 is the identity
+ * @param: result, pointer to an n x n matrix that is modified to contain
+ *         mat^k
+ *
+ * @return: 1 on success, 0 if memory ran out (result left untouched)
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixNPower(int n, const float *mat, unsigned int k, float *result)
+{
+    return MatrixNPowerBatch(n, 1, mat, k, result);
+}
+
+/**
+ * MatrixNExp calculates the matrix exponential of an n x n matrix and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: result, pointer to an n x n matrix that is modified to contain
+ *         e^mat
+ *
+ * @return: 1 on success, 0 if memory ran out, mat is not finite or the
+ *          approximant cannot be formed (result left untouched)
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixNExp(int n, const float *mat, float *result)
+{
+    return MatrixNExpBatch(n, 1, mat, result) == 0;
+}
+
+/**
+ * MatrixNPowerBatch and MatrixNExpBatch apply MatrixNPower() / MatrixNExp()
+ * to `count` n x n matrices stored back to back.
+ *
+ * @return: MatrixNPowerBatch gives 1 on success, 0 if memory ran out
+ *          (results left untouched); MatrixNExpBatch gives the number of
+ *          matrices MatrixNExp() failed on, whose results are left
+ *          untouched, or -1 if memory ran out
+ */
+int MatrixNPowerBatch(int n, int count, const float *mats, unsigned int k,
+        float *results)
+{
+    size_t nn = (size_t)n * n;
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *work = MatrixArenaAlloc(4 * nn * sizeof(float));
+
+    if(work == NULL) {
+        return 0;
+    }
+    for(int b = 0; b < count; b++) {
+        PowerN(n, mats + b * nn, k, results + b * nn, work);
+    }
+    MatrixArenaRelease(pos);
+    return 1;
+}
+
+int MatrixNExpBatch(int n, int count, const float *mats, float *results)
+{
+    size_t nn = (size_t)n * n;
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *work = MatrixArenaAlloc(6 * nn * sizeof(float));
+    int failed = 0;
+
+    if(work == NULL) {
+        return -1;
+    }
+    for(int b = 0; b < count; b++) {
+        failed += !ExpN(n, mats + b * nn, results + b * nn, work);
+    }
+    MatrixArenaRelease(pos);
+    return failed;
+}
@@ -0,0 +1,112 @@
+#ifndef MATRIX_POWER_H
+#define MATRIX_POWER_H
+
+/**
+ * @file    MatrixPower.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements integer matrix powers and the matrix exponential.
+ *
+ * MatrixPower() uses exponentiation by squaring, so mat^k costs about
+ * 2 log2(k) multiplications instead of k.  MatrixExp() uses scaling and
+ * squaring around a degree-6 Pade approximant.  Since MatrixMultiply()
+ * cannot write in place, both alternate between two preallocated buffers
+ * (ping-pong) instead of copying or allocating inside their loops.  The NxN
+ * versions allocate their buffers once per call, so the batched forms
+ * allocate once per batch.
+ */
+
+/**
+ * MatrixPower raises a 3x3 matrix to a non-negative integer power and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: k, the exponent; mat^0 is the identity
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain
+ *         mat^k
+ *
+ * @return: none
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+void MatrixPower(float mat[3][3], unsigned int k, float result[3][3]);
+
+/**
+ * MatrixExp calculates the matrix exponential e^mat of a 3x3 matrix and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain
+ *         e^mat
+ *
+ * @return: 1 on success, 0 if mat is not finite or the approximant cannot
+ *          be formed (result left untouched)
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixExp(float mat[3][3], float result[3][3]);
+
+/**
+ * MatrixPowerBatch and MatrixExpBatch apply MatrixPower() / MatrixExp() to
+ * each of `count` matrices.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, an array of count 3x3 matrices
+ * @param: results, an array of count 3x3 matrices that is modified to hold
+ *         the results, in order
+ *
+ * @return: MatrixExpBatch gives the number of matrices MatrixExp() failed
+ *          on, whose results are left untouched
+ */
+void MatrixPowerBatch(int count, float mats[][3][3], unsigned int k,
+        float results[][3][3]);
+int MatrixExpBatch(int count, float mats[][3][3], float results[][3][3]);
+
+/**
+ * MatrixNPower raises an n x n matrix to a non-negative integer power and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: k, the exponent; mat^0 is the identity
+ * @param: result, pointer to an n x n matrix that is modified to contain
+ *         mat^k
+ *
+ * @return: 1 on success, 0 if memory ran out (result left untouched)
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixNPower(int n, const float *mat, unsigned int k, float *result);
+
+/**
+ * MatrixNExp calculates the matrix exponential of an n x n matrix and
+ * "returns" the result by modifying the last argument.
+ *
+ * @param: n, the dimension of the matrix
+ * @param: mat, pointer to an n x n matrix
+ * @param: result, pointer to an n x n matrix that is modified to contain
+ *         e^mat
+ *
+ * @return: 1 on success, 0 if memory ran out, mat is not finite or the
+ *          approximant cannot be formed (result left untouched)
+ *
+ * mat is not modified by this function.  result may be the same as mat.
+ */
+int MatrixNExp(int n, const float *mat, float *result);
+
+/**
+ * MatrixNPowerBatch and MatrixNExpBatch apply MatrixNPower() / MatrixNExp()
+ * to `count` n x n matrices stored back to back.
+ *
+ * @return: MatrixNPowerBatch gives 1 on success, 0 if memory ran out
+ *          (results left untouched); MatrixNExpBatch gives the number of
+ *          matrices MatrixNExp() failed on, whose results are left
+ *          untouched, or -1 if memory ran out
+ */
+int MatrixNPowerBatch(int n, int count, const float *mats, unsigned int k,
+        float *results);
+int MatrixNExpBatch(int n, int count, const float *mats, float *results);
+
+#endif // MATRIX_POWER_H
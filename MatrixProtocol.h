@@ -0,0 +1,155 @@
+#ifndef MATRIX_PROTOCOL_H
+#define MATRIX_PROTOCOL_H
+
+/**
+ * @file    MatrixProtocol.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file defines the binary wire protocol spoken between mml_daemon and
+ * the MatrixClient library over a Unix domain socket.  Every message is a
+ * fixed-size header followed by a payload of back-to-back items.  An item is
+ * the operands of one MatrixMath.h call (for example two float[3][3] for
+ * MatrixMultiply) and a response item is its result.
+ *
+ * Large payloads do not travel through the socket at all.  A client may hand
+ * the daemon a shared-memory file descriptor once (MML_OP_HELLO) and then
+ * set MML_FLAG_SHM on a request, in which case the header only carries the
+ * offsets of the input and output regions inside that shared buffer.  The
+ * descriptor must be a memfd of at least the announced size, sealed with
+ * F_SEAL_SHRINK, so that the daemon never touches pages the client removed.
+ *
+ * All integers are in host byte order; the socket never leaves the host.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Default socket path, overridable with the MML_SOCKET environment variable.
+ */
+#define MML_SOCKET_PATH "/tmp/mml.sock"
+
+/**
+ * Maximum number of items in a single request.  Keeps a hostile or broken
+ * client from asking the daemon for gigabytes of response buffer.
+ */
+#define MML_MAX_ITEMS (1 << 20)
+
+/**
+ * Requests whose input payload is at least this many bytes go through the
+ * shared-memory buffer when one is attached.
+ */
+#define MML_SHM_THRESHOLD (64 * 1024)
+
+/**
+ * Operation codes, one per MatrixMath.h function.  MatrixPrint is not served
+ * since it would print on the daemon's terminal.
+ */
+enum {
+    MML_OP_HELLO = 0,
+    MML_OP_EQUALS,
+    MML_OP_ADD,
+    MML_OP_MULTIPLY,
+    MML_OP_SCALAR_ADD,
+    MML_OP_SCALAR_MULTIPLY,
+    MML_OP_TRACE,
+    MML_OP_TRANSPOSE,
+    MML_OP_SUBMATRIX,
+    MML_OP_DETERMINANT,
+    MML_OP_INVERSE,
+    MML_OP_COUNT
+};
+
+/**
+ * Request flags.
+ */
+#define MML_FLAG_SHM 0x01
+
+/**
+ * Response status codes.
+ */
+#define MML_STATUS_OK 0
+#define MML_STATUS_BAD_REQUEST -1
+#define MML_STATUS_NO_SHM -2
+
+/**
+ * Request header.  `length` is the number of payload bytes that follow the
+ * header on the socket (always 0 for MML_FLAG_SHM requests).  `scalar` is the
+ * x argument of the scalar operations, `row` and `col` are the i and j
+ * arguments of MatrixSubmatrix.  For MML_OP_HELLO, `count` is the size in
+ * bytes of the shared buffer whose descriptor rides along as SCM_RIGHTS.
+ * `shm_in` and `shm_out` must be multiples of sizeof(float).
+ */
+struct MatrixRequestHeader {
+    uint32_t length;
+    uint32_t id;
+    uint32_t count;
+    uint8_t op;
+    uint8_t flags;
+    uint8_t row;
+    uint8_t col;
+    float scalar;
+    uint32_t shm_in;
+    uint32_t shm_out;
+};
+
+/**
+ * Response header.  `length` is the number of payload bytes that follow (0
+ * for MML_FLAG_SHM requests, whose results are already in the shared buffer).
+ */
+struct MatrixResponseHeader {
+    uint32_t length;
+    uint32_t id;
+    int32_t status;
+    uint32_t count;
+};
+
+/**
+ * MatrixProtocolItemSize reports the size of one input item and one output
+ * item of an operation.
+ *
+ * @param: op, an MML_OP_* code
+ * @param: in_size, set to the bytes of one input item
+ * @param: out_size, set to the bytes of one output item
+ *
+ * @return: 1 if op is a servable operation, otherwise 0
+ */
+static inline int MatrixProtocolItemSize(int op, size_t *in_size,
+        size_t *out_size)
+{
+    const size_t mat = sizeof(float[3][3]);
+
+    switch(op) {
+    case MML_OP_EQUALS:
+        *in_size = 2 * mat;
+        *out_size = sizeof(int32_t);
+        return 1;
+    case MML_OP_ADD:
+    case MML_OP_MULTIPLY:
+        *in_size = 2 * mat;
+        *out_size = mat;
+        return 1;
+    case MML_OP_SCALAR_ADD:
+    case MML_OP_SCALAR_MULTIPLY:
+    case MML_OP_TRANSPOSE:
+    case MML_OP_INVERSE:
+        *in_size = mat;
+        *out_size = mat;
+        return 1;
+    case MML_OP_TRACE:
+    case MML_OP_DETERMINANT:
+        *in_size = mat;
+        *out_size = sizeof(float);
+        return 1;
+    case MML_OP_SUBMATRIX:
+        *in_size = mat;
+        *out_size = sizeof(float[2][2]);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+#endif // MATRIX_PROTOCOL_H
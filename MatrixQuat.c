@@ -0,0 +1,294 @@
+/**
+ * @file    MatrixQuat.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <math.h>
+#include "MatrixMath.h"
+#include "MatrixBatch.h"
+#include "MatrixQuat.h"
+
+//plane c of a SoA batch of count vectors
+#define PLANE(soa, count, c) ((soa) + (c) * (size_t)(count))
+
+void MatrixFromQuatBatch(int count, const float *quats, float *mats)
+{
+    const float *qw = PLANE(quats, count, 0), *qx = PLANE(quats, count, 1);
+    const float *qy = PLANE(quats, count, 2), *qz = PLANE(quats, count, 3);
+    float *m[3][3];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            m[i][j] = MATRIX_SOA(mats, count, i, j);
+        }
+    }
+    for(int b = 0; b < count; b++) {
+        float w = qw[b], x = qx[b], y = qy[b], z = qz[b];
+        //dividing by the squared norm absorbs quaternions that are not unit
+        float s = 2 / (w * w + x * x + y * y + z * z);
+
+        m[0][0][b] = 1 - s * (y * y + z * z);
+        m[0][1][b] = s * (x * y - w * z);
+        m[0][2][b] = s * (x * z + w * y);
+        m[1][0][b] = s * (x * y + w * z);
+        m[1][1][b] = 1 - s * (x * x + z * z);
+        m[1][2][b] = s * (y * z - w * x);
+        m[2][0][b] = s * (x * z - w * y);
+        m[2][1][b] = s * (y * z + w * x);
+        m[2][2][b] = 1 - s * (x * x + y * y);
+    }
+}
+
+void MatrixToQuatBatch(int count, const float *mats, float *quats)
+{
+    float *qw = PLANE(quats, count, 0), *qx = PLANE(quats, count, 1);
+    float *qy = PLANE(quats, count, 2), *qz = PLANE(quats, count, 3);
+    const float *m[3][3];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            m[i][j] = MATRIX_SOA(mats, count, i, j);
+        }
+    }
+    //Shepperd's method: the largest of 4w^2, 4x^2, 4y^2, 4z^2 is taken from
+    //the diagonal and the other three from sums and differences of the off-
+    //diagonal pairs.  The four cases are blended with selects instead of
+    //branches so the loop still vectorizes.
+    for(int b = 0; b < count; b++) {
+        float m00 = m[0][0][b], m11 = m[1][1][b], m22 = m[2][2][b];
+        float t0 = 1 + m00 + m11 + m22, t1 = 1 + m00 - m11 - m22;
+        float t2 = 1 - m00 + m11 - m22, t3 = 1 - m00 - m11 + m22;
+        float a = m[2][1][b] - m[1][2][b], c = m[0][2][b] - m[2][0][b];
+        float d = m[1][0][b] - m[0][1][b], e = m[0][1][b] + m[1][0][b];
+        float f = m[0][2][b] + m[2][0][b], g = m[1][2][b] + m[2][1][b];
+        float big = fmaxf(fmaxf(t0, t1), fmaxf(t2, t3));
+        float r = 0.5f * sqrtf(big), k = 0.25f / r;
+        int c0 = t0 == big, c1 = !c0 && t1 == big;
+        int c2 = !c0 && !c1 && t2 == big;
+        float w, x, y, z, inv;
+
+        w = c0 ? r : (c1 ? a * k : (c2 ? c * k : d * k));
+        x = c0 ? a * k : (c1 ? r : (c2 ? e * k : f * k));
+        y = c0 ? c * k : (c1 ? e * k : (c2 ? r : g * k));
+        z = c0 ? d * k : (c1 ? f * k : (c2 ? g * k : r));
+
+        //q and -q are the same rotation; report the one with w >= 0
+        inv = 1 / sqrtf(w * w + x * x + y * y + z * z);
+        inv = (w < 0) ? -inv : inv;
+        qw[b] = w * inv;
+        qx[b] = x * inv;
+        qy[b] = y * inv;
+        qz[b] = z * inv;
+    }
+}
+
+void MatrixFromAxisAngleBatch(int count, const float *aa, float *mats)
+{
+    const float *ax = PLANE(aa, count, 0), *ay = PLANE(aa, count, 1);
+    const float *az = PLANE(aa, count, 2), *angle = PLANE(aa, count, 3);
+    float *m[3][3];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            m[i][j] = MATRIX_SOA(mats, count, i, j);
+        }
+    }
+    //Rodrigues' formula
+    for(int b = 0; b < count; b++) {
+        float x = ax[b], y = ay[b], z = az[b];
+        float c = cosf(angle[b]), s = sinf(angle[b]), t = 1 - c;
+
+        m[0][0][b] = t * x * x + c;
+        m[0][1][b] = t * x * y - s * z;
+        m[0][2][b] = t * x * z + s * y;
+        m[1][0][b] = t * x * y + s * z;
+        m[1][1][b] = t * y * y + c;
+        m[1][2][b] = t * y * z - s * x;
+        m[2][0][b] = t * x * z - s * y;
+        m[2][1][b] = t * y * z + s * x;
+        m[2][2][b] = t * z * z + c;
+    }
+}
+
+void MatrixToAxisAngleBatch(int count, const float *mats, float *aa)
+{
+    float *ax = PLANE(aa, count, 0), *ay = PLANE(aa, count, 1);
+    float *az = PLANE(aa, count, 2), *angle = PLANE(aa, count, 3);
+
+    //the quaternion is staged in the output planes as (w, x, y, z) and then
+    //rewritten in place as (axis, angle)
+    MatrixToQuatBatch(count, mats, aa);
+    for(int b = 0; b < count; b++) {
+        float w = ax[b], x = ay[b], y = az[b], z = angle[b];
+        float len = sqrtf(x * x + y * y + z * z);
+        int none = !(len > 0);
+        float inv = none ? 0 : 1 / len;
+
+        angle[b] = 2 * atan2f(len, w);
+        ax[b] = none ? 1 : x * inv;
+        ay[b] = y * inv;
+        az[b] = z * inv;
+    }
+}
+
+void MatrixFromEulerBatch(int count, const float *euler, float *mats)
+{
+    const float *yaw = PLANE(euler, count, 0);
+    const float *pitch = PLANE(euler, count, 1);
+    const float *roll = PLANE(euler, count, 2);
+    float *m[3][3];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            m[i][j] = MATRIX_SOA(mats, count, i, j);
+        }
+    }
+    for(int b = 0; b < count; b++) {
+        float cy = cosf(yaw[b]), sy = sinf(yaw[b]);
+        float cp = cosf(pitch[b]), sp = sinf(pitch[b]);
+        float cr = cosf(roll[b]), sr = sinf(roll[b]);
+
+        m[0][0][b] = cy * cp;
+        m[0][1][b] = cy * sp * sr - sy * cr;
+        m[0][2][b] = cy * sp * cr + sy * sr;
+        m[1][0][b] = sy * cp;
+        m[1][1][b] = sy * sp * sr + cy * cr;
+        m[1][2][b] = sy * sp * cr - cy * sr;
+        m[2][0][b] = -sp;
+        m[2][1][b] = cp * sr;
+        m[2][2][b] = cp * cr;
+    }
+}
+
+void MatrixToEulerBatch(int count, const float *mats, float *euler)
+{
+    float *yaw = PLANE(euler, count, 0);
+    float *pitch = PLANE(euler, count, 1);
+    float *roll = PLANE(euler, count, 2);
+    const float *m00 = MATRIX_SOA(mats, count, 0, 0);
+    const float *m10 = MATRIX_SOA(mats, count, 1, 0);
+    const float *m20 = MATRIX_SOA(mats, count, 2, 0);
+    const float *m21 = MATRIX_SOA(mats, count, 2, 1);
+    const float *m22 = MATRIX_SOA(mats, count, 2, 2);
+
+    for(int b = 0; b < count; b++) {
+        //clamped because drift can push |m20| slightly past 1
+        float sp = fminf(1, fmaxf(-1, -m20[b]));
+        yaw[b] = atan2f(m10[b], m00[b]);
+        pitch[b] = asinf(sp);
+        roll[b] = atan2f(m21[b], m22[b]);
+    }
+}
+
+void MatrixQuatMultiplyBatch(int count, const float *q1, const float *q2,
+        float *result)
+{
+    const float *aw = PLANE(q1, count, 0), *ax = PLANE(q1, count, 1);
+    const float *ay = PLANE(q1, count, 2), *az = PLANE(q1, count, 3);
+    const float *bw = PLANE(q2, count, 0), *bx = PLANE(q2, count, 1);
+    const float *by = PLANE(q2, count, 2), *bz = PLANE(q2, count, 3);
+    float *rw = PLANE(result, count, 0), *rx = PLANE(result, count, 1);
+    float *ry = PLANE(result, count, 2), *rz = PLANE(result, count, 3);
+
+    for(int b = 0; b < count; b++) {
+        float w = aw[b] * bw[b] - ax[b] * bx[b] - ay[b] * by[b] - az[b] * bz[b];
+        float x = aw[b] * bx[b] + ax[b] * bw[b] + ay[b] * bz[b] - az[b] * by[b];
+        float y = aw[b] * by[b] - ax[b] * bz[b] + ay[b] * bw[b] + az[b] * bx[b];
+        float z = aw[b] * bz[b] + ax[b] * by[b] - ay[b] * bx[b] + az[b] * bw[b];
+
+        rw[b] = w;
+        rx[b] = x;
+        ry[b] = y;
+        rz[b] = z;
+    }
+}
+
+/**
+ * MatrixFromQuat builds the rotation matrix of a quaternion.
+ *
+ * @param: q, a quaternion (need not be exactly unit length)
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         rotation
+ */
+void MatrixFromQuat(float q[4], float result[3][3])
+{
+    //a SoA batch of one is exactly the row-major layout
+    MatrixFromQuatBatch(1, q, &result[0][0]);
+}
+
+/**
+ * MatrixToQuat calculates the unit quaternion of a rotation matrix, with a
+ * non-negative w.
+ *
+ * @param: mat, a pointer to a 3x3 rotation matrix
+ * @param: q, modified to contain the quaternion
+ */
+void MatrixToQuat(float mat[3][3], float q[4])
+{
+    MatrixToQuatBatch(1, &mat[0][0], q);
+}
+
+/**
+ * MatrixFromAxisAngle / MatrixToAxisAngle convert between a rotation matrix
+ * and an axis-angle pair.  MatrixToAxisAngle returns an angle in [0, pi]
+ * and the axis (1, 0, 0) for the identity.
+ */
+void MatrixFromAxisAngle(float aa[4], float result[3][3])
+{
+    MatrixFromAxisAngleBatch(1, aa, &result[0][0]);
+}
+
+void MatrixToAxisAngle(float mat[3][3], float aa[4])
+{
+    MatrixToAxisAngleBatch(1, &mat[0][0], aa);
+}
+
+/**
+ * MatrixFromEuler / MatrixToEuler convert between a rotation matrix and
+ * Z-Y-X Euler angles.  MatrixToEuler returns a pitch in [-pi/2, pi/2].
+ */
+void MatrixFromEuler(float e[3], float result[3][3])
+{
+    MatrixFromEulerBatch(1, e, &result[0][0]);
+}
+
+void MatrixToEuler(float mat[3][3], float e[3])
+{
+    MatrixToEulerBatch(1, &mat[0][0], e);
+}
+
+/**
+ * MatrixQuatMultiply composes two rotations as quaternions.
+ *
+ * @param: q1, the left quaternion
+ * @param: q2, the right quaternion
+ * @param: result, modified to contain q1 q2 (may be the same as q1 or q2)
+ */
+void MatrixQuatMultiply(float q1[4], float q2[4], float result[4])
+{
+    MatrixQuatMultiplyBatch(1, q1, q2, result);
+}
+
+/**
+ * MatrixQuatChain composes a whole chain of rotations, the quaternion
+ * counterpart of multiplying their matrices left to right.
+ *
+ * @param: count, the number of rotations (0 gives the identity)
+ * @param: quats, the count quaternions, in order
+ * @param: result, modified to contain the normalized product
+ */
+void MatrixQuatChain(int count, float quats[][4], float result[4])
+{
+    float acc[4] = {1, 0, 0, 0};
+    float inv;
+
+    //16 multiply-adds per link instead of 27 for a 3x3 product
+    for(int k = 0; k < count; k++) {
+        MatrixQuatMultiply(acc, quats[k], acc);
+    }
+    inv = 1 / sqrtf(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2] +
+            acc[3] * acc[3]);
+    for(int c = 0; c < 4; c++) {
+        result[c] = acc[c] * inv;
+    }
+}
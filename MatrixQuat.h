@@ -0,0 +1,100 @@
+#ifndef MATRIX_QUAT_H
+#define MATRIX_QUAT_H
+
+/**
+ * @file    MatrixQuat.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements conversions between 3x3 rotation matrices and the
+ * other common rotation representations, plus quaternion composition so
+ * that long chains of rotations never need to be expanded into 3x3
+ * MatrixMultiply() calls.
+ *
+ * Conventions:
+ *  - A quaternion is `float q[4] = {w, x, y, z}`, with w the scalar part.
+ *    Composition follows the matrices: the matrix of MatrixQuatMultiply(a, b)
+ *    is MatrixMultiply() of the matrix of a by the matrix of b.
+ *  - Axis-angle is `float aa[4] = {x, y, z, angle}` with a unit axis and the
+ *    angle in radians.
+ *  - Euler angles are `float e[3] = {yaw, pitch, roll}` in radians for the
+ *    intrinsic Z-Y-X sequence, mat = Rz(yaw) Ry(pitch) Rx(roll).
+ *
+ * The Batch functions take MatrixBatch.h SoA batches, with 4, 4 and 3 planes
+ * for quaternions, axis-angle and Euler angles respectively (component c of
+ * item b at soa[c * count + b]).  Their loops are branch-free so they
+ * vectorize across rotations; the single-rotation functions are the batch
+ * functions with a count of one, so both always agree.
+ */
+
+/**
+ * MatrixFromQuat builds the rotation matrix of a quaternion.
+ *
+ * @param: q, a quaternion (need not be exactly unit length)
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         rotation
+ */
+void MatrixFromQuat(float q[4], float result[3][3]);
+
+/**
+ * MatrixToQuat calculates the unit quaternion of a rotation matrix, with a
+ * non-negative w.
+ *
+ * @param: mat, a pointer to a 3x3 rotation matrix
+ * @param: q, modified to contain the quaternion
+ */
+void MatrixToQuat(float mat[3][3], float q[4]);
+
+/**
+ * MatrixFromAxisAngle / MatrixToAxisAngle convert between a rotation matrix
+ * and an axis-angle pair.  MatrixToAxisAngle returns an angle in [0, pi]
+ * and the axis (1, 0, 0) for the identity.
+ */
+void MatrixFromAxisAngle(float aa[4], float result[3][3]);
+void MatrixToAxisAngle(float mat[3][3], float aa[4]);
+
+/**
+ * MatrixFromEuler / MatrixToEuler convert between a rotation matrix and
+ * Z-Y-X Euler angles.  MatrixToEuler returns a pitch in [-pi/2, pi/2].
+ */
+void MatrixFromEuler(float e[3], float result[3][3]);
+void MatrixToEuler(float mat[3][3], float e[3]);
+
+/**
+ * MatrixQuatMultiply composes two rotations as quaternions.
+ *
+ * @param: q1, the left quaternion
+ * @param: q2, the right quaternion
+ * @param: result, modified to contain q1 q2 (may be the same as q1 or q2)
+ */
+void MatrixQuatMultiply(float q1[4], float q2[4], float result[4]);
+
+/**
+ * MatrixQuatChain composes a whole chain of rotations, the quaternion
+ * counterpart of multiplying their matrices left to right.
+ *
+ * @param: count, the number of rotations (0 gives the identity)
+ * @param: quats, the count quaternions, in order
+ * @param: result, modified to contain the normalized product
+ */
+void MatrixQuatChain(int count, float quats[][4], float result[4]);
+
+/*******************************************************************************
+ * SoA batch versions
+ ******************************************************************************/
+void MatrixFromQuatBatch(int count, const float *quats, float *mats);
+void MatrixToQuatBatch(int count, const float *mats, float *quats);
+void MatrixFromAxisAngleBatch(int count, const float *aa, float *mats);
+void MatrixToAxisAngleBatch(int count, const float *mats, float *aa);
+void MatrixFromEulerBatch(int count, const float *euler, float *mats);
+void MatrixToEulerBatch(int count, const float *mats, float *euler);
+
+/**
+ * MatrixQuatMultiplyBatch composes `count` pairs of SoA quaternions.  result
+ * may be the same as q1 or q2.
+ */
+void MatrixQuatMultiplyBatch(int count, const float *q1, const float *q2,
+        float *result);
+
+#endif // MATRIX_QUAT_H
@@ -0,0 +1,315 @@
+/**
+ * @file    MatrixReduce.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "MatrixMath.h"
+#include "MatrixBatch.h"
+#include "MatrixArena.h"
+#include "MatrixThreads.h"
+#include "MatrixReduce.h"
+
+//matrices per word of an equality mask
+#define WORD_BITS 64
+
+//independent accumulators per total; each lane only ever adds in its own
+//fixed order, so the sums vectorize without reassociating anything
+#define LANES 8
+
+#define ELEMENTS (DIM * DIM)
+
+/**
+ * MatrixTraceBatch, MatrixSumBatch, MatrixFrobeniusNormBatch and
+ * MatrixMaxNormBatch compute, for every matrix of a SoA batch, its trace,
+ * the sum of its elements, its Frobenius norm and its largest absolute
+ * element respectively.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch
+ * @param: result, count floats that are modified to hold the values
+ */
+void MatrixTraceBatch(int count, const float *mats, float *result)
+{
+    const float *m00 = MATRIX_SOA(mats, count, 0, 0);
+    const float *m11 = MATRIX_SOA(mats, count, 1, 1);
+    const float *m22 = MATRIX_SOA(mats, count, 2, 2);
+
+    for(int b = 0; b < count; b++) {
+        result[b] = m00[b] + m11[b] + m22[b];
+    }
+}
+
+void MatrixSumBatch(int count, const float *mats, float *result)
+{
+    memcpy(result, mats, count * sizeof(float));
+    for(int e = 1; e < ELEMENTS; e++) {
+        const float *p = mats + (size_t)e * count;
+        for(int b = 0; b < count; b++) {
+            result[b] += p[b];
+        }
+    }
+}
+
+void MatrixFrobeniusNormBatch(int count, const float *mats, float *result)
+{
+    memset(result, 0, count * sizeof(float));
+    for(int e = 0; e < ELEMENTS; e++) {
+        const float *p = mats + (size_t)e * count;
+        for(int b = 0; b < count; b++) {
+            result[b] += p[b] * p[b];
+        }
+    }
+    for(int b = 0; b < count; b++) {
+        result[b] = sqrtf(result[b]);
+    }
+}
+
+void MatrixMaxNormBatch(int count, const float *mats, float *result)
+{
+    memset(result, 0, count * sizeof(float));
+    for(int e = 0; e < ELEMENTS; e++) {
+        const float *p = mats + (size_t)e * count;
+        for(int b = 0; b < count; b++) {
+            float a = fabsf(p[b]);
+            result[b] = a > result[b] ? a : result[b];
+        }
+    }
+}
+
+/*******************************************************************************
+ * Comparison
+ ******************************************************************************/
+
+struct EqualsJob {
+    int count, mode;
+    float tol;
+    const float *mats1, *mats2;
+    unsigned long long *mask;
+};
+
+//maps the bits of a float to an integer that counts representable floats,
+//with -0 and +0 both at 0
+static inline int32_t Ordered(float f)
+{
+    int32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i < 0 ? INT32_MIN - i : i;
+}
+
+static void CompareWords(void *arg, int begin, int end)
+{
+    const struct EqualsJob *job = arg;
+    float tol = job->tol;
+    uint32_t ulps = tol < UINT32_MAX ? (uint32_t)tol : UINT32_MAX;
+
+    for(int w = begin; w < end; w++) {
+        int start = w * WORD_BITS;
+        int len = job->count - start < WORD_BITS ? job->count - start : WORD_BITS;
+        unsigned char ok[WORD_BITS];
+        unsigned long long word = 0;
+
+        memset(ok, 1, sizeof(ok));
+        for(int e = 0; e < ELEMENTS; e++) {
+            const float *x = job->mats1 + (size_t)e * job->count + start;
+            const float *y = job->mats2 + (size_t)e * job->count + start;
+            if(job->mode == MATRIX_CMP_ABS) {
+                for(int b = 0; b < len; b++) {
+                    ok[b] &= fabsf(x[b] - y[b]) <= tol;
+                }
+            } else if(job->mode == MATRIX_CMP_REL) {
+                for(int b = 0; b < len; b++) {
+                    float ax = fabsf(x[b]), ay = fabsf(y[b]);
+                    ok[b] &= fabsf(x[b] - y[b]) <= tol * (ax > ay ? ax : ay);
+                }
+            } else {
+                for(int b = 0; b < len; b++) {
+                    int32_t ox = Ordered(x[b]), oy = Ordered(y[b]);
+                    //the distance fits in 32 unsigned bits
+                    uint32_t d = ox > oy ? (uint32_t)ox - (uint32_t)oy :
+                            (uint32_t)oy - (uint32_t)ox;
+                    ok[b] &= (d <= ulps) & (x[b] == x[b]) & (y[b] == y[b]);
+                }
+            }
+        }
+        for(int b = 0; b < len; b++) {
+            word |= (unsigned long long)ok[b] << b;
+        }
+        job->mask[w] = word;
+    }
+}
+
+/**
+ * MatrixEqualsBatch compares two SoA batches matrix by matrix.
+ *
+ * @param: count, the number of matrix pairs
+ * @param: mats1, 9 * count floats, the first batch
+ * @param: mats2, 9 * count floats, the second batch
+ * @param: mode, MATRIX_CMP_ABS, MATRIX_CMP_REL or MATRIX_CMP_ULP
+ * @param: tol, the tolerance of that mode (a whole number for ULP)
+ * @param: mask, (count + 63) / 64 words that are modified: bit b % 64 of
+ *         word b / 64 is set if and only if pair b is equal
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the number of equal pairs
+ */
+int MatrixEqualsBatch(int count, const float *mats1, const float *mats2,
+        int mode, float tol, unsigned long long *mask, int threads)
+{
+    struct EqualsJob job = {count, mode, tol, mats1, mats2, mask};
+    int words = (count + WORD_BITS - 1) / WORD_BITS;
+    int equal = 0;
+
+    //threads own whole words, so no two of them write the same one
+    MatrixParallelFor(words, threads, CompareWords, &job);
+    for(int w = 0; w < words; w++) {
+        equal += __builtin_popcountll(mask[w]);
+    }
+    return equal;
+}
+
+/*******************************************************************************
+ * Whole-batch totals
+ ******************************************************************************/
+
+struct Partial {
+    double trace, sum, squares;
+    float max_abs;
+};
+
+struct ReduceJob {
+    int count, units, deterministic;
+    const float *mats;
+    struct Partial *partials;
+};
+
+//the lanes are held in 16-byte vectors, which every x86-64 and ARM64 target
+//keeps in registers; wider targets simply use more of them
+typedef double Double2 __attribute__((vector_size(16)));
+typedef float Float2 __attribute__((vector_size(8)));
+typedef int32_t Int4 __attribute__((vector_size(16)));
+
+static void ReduceRange(const float *mats, int count, int begin, int end,
+        struct Partial *out)
+{
+    Double2 trace[LANES / 2] = {0}, sum[LANES / 2] = {0};
+    Double2 squares[LANES / 2] = {0};
+    Int4 max_bits[LANES / 4] = {0};
+    int full = begin + (end - begin) / LANES * LANES;
+
+    memset(out, 0, sizeof(*out));
+    for(int e = 0; e < ELEMENTS; e++) {
+        const float *p = mats + (size_t)e * count;
+        int diagonal = e % (DIM + 1) == 0;
+        for(int b = begin; b < full; b += LANES) {
+            for(int h = 0; h < LANES / 2; h++) {
+                Float2 f;
+                memcpy(&f, p + b + 2 * h, sizeof(f));
+                Double2 x = __builtin_convertvector(f, Double2);
+                sum[h] += x;
+                squares[h] += x * x;
+                if(diagonal) {
+                    trace[h] += x;
+                }
+            }
+            //with the sign cleared, larger floats have larger bit patterns
+            for(int q = 0; q < LANES / 4; q++) {
+                Int4 bits;
+                memcpy(&bits, p + b + 4 * q, sizeof(bits));
+                bits &= 0x7fffffff;
+                Int4 larger = bits > max_bits[q];
+                max_bits[q] = (bits & larger) | (max_bits[q] & ~larger);
+            }
+        }
+        //the ragged end is added after the lanes, in order
+        for(int b = full; b < end; b++) {
+            double x = p[b];
+            float a = fabsf(p[b]);
+            out->sum += x;
+            out->squares += x * x;
+            out->max_abs = a > out->max_abs ? a : out->max_abs;
+            if(diagonal) {
+                out->trace += x;
+            }
+        }
+    }
+
+    for(int l = 0; l < LANES; l++) {
+        float a;
+        int32_t bits = max_bits[l / 4][l % 4];
+        memcpy(&a, &bits, sizeof(a));
+        out->trace += trace[l / 2][l % 2];
+        out->sum += sum[l / 2][l % 2];
+        out->squares += squares[l / 2][l % 2];
+        out->max_abs = a > out->max_abs ? a : out->max_abs;
+    }
+}
+
+static void ReduceUnits(void *arg, int begin, int end)
+{
+    const struct ReduceJob *job = arg;
+
+    for(int u = begin; u < end; u++) {
+        long long first, last;
+        if(job->deterministic) {
+            first = (long long)u * MATRIX_REDUCE_CHUNK;
+            last = first + MATRIX_REDUCE_CHUNK;
+            last = last < job->count ? last : job->count;
+        } else {
+            first = (long long)job->count * u / job->units;
+            last = (long long)job->count * (u + 1) / job->units;
+        }
+        ReduceRange(job->mats, job->count, (int)first, (int)last,
+                &job->partials[u]);
+    }
+}
+
+/**
+ * MatrixReduceBatch computes the totals of a whole SoA batch.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch
+ * @param: threads, the thread count, or 0 for one per online CPU
+ * @param: deterministic, nonzero for totals that do not depend on threads
+ * @param: totals, modified to hold the totals
+ *
+ * @return: 1 on success, 0 if memory ran out (totals are then untouched)
+ */
+int MatrixReduceBatch(int count, const float *mats, int threads,
+        int deterministic, struct MatrixBatchTotals *totals)
+{
+    MatrixArenaPos pos = MatrixArenaMark();
+    struct ReduceJob job;
+    double squares = 0;
+
+    threads = MatrixThreadCount(threads);
+    job.count = count;
+    job.deterministic = deterministic;
+    job.mats = mats;
+    if(deterministic) {
+        job.units = (count + MATRIX_REDUCE_CHUNK - 1) / MATRIX_REDUCE_CHUNK;
+    } else {
+        job.units = threads < count ? threads : count;
+    }
+    job.partials = MatrixArenaAlloc(job.units * sizeof(struct Partial));
+    if(job.partials == NULL) {
+        return 0;
+    }
+    MatrixParallelFor(job.units, threads, ReduceUnits, &job);
+
+    //partials are combined in batch order, whichever thread made them
+    memset(totals, 0, sizeof(*totals));
+    for(int u = 0; u < job.units; u++) {
+        const struct Partial *p = &job.partials[u];
+        totals->trace += p->trace;
+        totals->sum += p->sum;
+        squares += p->squares;
+        totals->max_abs = p->max_abs > totals->max_abs ? p->max_abs :
+                totals->max_abs;
+    }
+    totals->frobenius = sqrt(squares);
+    MatrixArenaRelease(pos);
+    return 1;
+}
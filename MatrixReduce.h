@@ -0,0 +1,97 @@
+#ifndef MATRIX_REDUCE_H
+#define MATRIX_REDUCE_H
+
+/**
+ * @file    MatrixReduce.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements comparisons and reductions over MatrixBatch.h SoA
+ * batches of 3x3 matrices: per-matrix traces, sums and norms, a batched
+ * MatrixEquals() with a choice of tolerance, and whole-batch totals.
+ *
+ * Every loop runs across matrices, one element plane at a time, so it
+ * vectorizes without changing the order of any floating-point operation.
+ * Whole-batch totals are accumulated in double, in fixed-width lanes.  By
+ * default each thread reduces one contiguous share of the batch, so the
+ * last bits of a total depend on the thread count; in deterministic mode
+ * the batch is cut into fixed MATRIX_REDUCE_CHUNK-matrix chunks that are
+ * combined in order, which gives bit-identical totals for any thread count.
+ */
+
+/**
+ * Tolerance modes of MatrixEqualsBatch().  Two elements x and y match if
+ *  - MATRIX_CMP_ABS: |x - y| <= tol, MatrixEquals() with tol = FP_DELTA
+ *  - MATRIX_CMP_REL: |x - y| <= tol * max(|x|, |y|)
+ *  - MATRIX_CMP_ULP: at most tol representable floats lie between them
+ *    (+0 and -0 count as equal)
+ * NaN never matches.
+ */
+#define MATRIX_CMP_ABS 0
+#define MATRIX_CMP_REL 1
+#define MATRIX_CMP_ULP 2
+
+/**
+ * MATRIX_REDUCE_CHUNK is the number of matrices per chunk in deterministic
+ * mode.
+ */
+#define MATRIX_REDUCE_CHUNK 4096
+
+/**
+ * Totals over a whole batch.
+ */
+struct MatrixBatchTotals {
+    double trace;       //sum of the traces
+    double sum;         //sum of every element
+    double frobenius;   //Frobenius norm of the batch as one long vector
+    float max_abs;      //largest absolute element
+};
+
+/**
+ * MatrixTraceBatch, MatrixSumBatch, MatrixFrobeniusNormBatch and
+ * MatrixMaxNormBatch compute, for every matrix of a SoA batch, its trace,
+ * the sum of its elements, its Frobenius norm and its largest absolute
+ * element respectively.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch
+ * @param: result, count floats that are modified to hold the values
+ */
+void MatrixTraceBatch(int count, const float *mats, float *result);
+void MatrixSumBatch(int count, const float *mats, float *result);
+void MatrixFrobeniusNormBatch(int count, const float *mats, float *result);
+void MatrixMaxNormBatch(int count, const float *mats, float *result);
+
+/**
+ * MatrixEqualsBatch compares two SoA batches matrix by matrix.
+ *
+ * @param: count, the number of matrix pairs
+ * @param: mats1, 9 * count floats, the first batch
+ * @param: mats2, 9 * count floats, the second batch
+ * @param: mode, MATRIX_CMP_ABS, MATRIX_CMP_REL or MATRIX_CMP_ULP
+ * @param: tol, the tolerance of that mode (a whole number for ULP)
+ * @param: mask, (count + 63) / 64 words that are modified: bit b % 64 of
+ *         word b / 64 is set if and only if pair b is equal
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the number of equal pairs
+ */
+int MatrixEqualsBatch(int count, const float *mats1, const float *mats2,
+        int mode, float tol, unsigned long long *mask, int threads);
+
+/**
+ * MatrixReduceBatch computes the totals of a whole SoA batch.
+ *
+ * @param: count, the number of matrices
+ * @param: mats, 9 * count floats, the SoA batch
+ * @param: threads, the thread count, or 0 for one per online CPU
+ * @param: deterministic, nonzero for totals that do not depend on threads
+ * @param: totals, modified to hold the totals
+ *
+ * @return: 1 on success, 0 if memory ran out (totals are then untouched)
+ */
+int MatrixReduceBatch(int count, const float *mats, int threads,
+        int deterministic, struct MatrixBatchTotals *totals);
+
+#endif // MATRIX_REDUCE_H
@@ -0,0 +1,365 @@
+/**
+ * @file    MatrixRefine.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "MatrixArena.h"
+#include "MatrixRefine.h"
+
+//16-byte vectors, so that float steps go four elements at a time and double
+//ones two, on every target the library builds for
+typedef float Float4 __attribute__((vector_size(16)));
+typedef double Double2 __attribute__((vector_size(16)));
+
+//a refinement step that does not at least halve the residual means the float
+//factors cannot get any closer
+#define STAGNATION 0.5
+
+/*******************************************************************************
+ * Float kernels
+ ******************************************************************************/
+
+//y -= f * x
+static void AxpyFloat(int len, float f, const float *x, float *y)
+{
+    int j = 0;
+
+    for(; j + 4 <= len; j += 4) {
+        Float4 vx, vy;
+        memcpy(&vx, x + j, sizeof(vx));
+        memcpy(&vy, y + j, sizeof(vy));
+        vy -= f * vx;
+        memcpy(y + j, &vy, sizeof(vy));
+    }
+    for(; j < len; j++) {
+        y[j] -= f * x[j];
+    }
+}
+
+static float DotFloat(int len, const float *x, const float *y)
+{
+    Float4 acc = {0};
+    float dot;
+    int j = 0;
+
+    for(; j + 4 <= len; j += 4) {
+        Float4 vx, vy;
+        memcpy(&vx, x + j, sizeof(vx));
+        memcpy(&vy, y + j, sizeof(vy));
+        acc += vx * vy;
+    }
+    dot = acc[0] + acc[1] + acc[2] + acc[3];
+    for(; j < len; j++) {
+        dot += x[j] * y[j];
+    }
+    return dot;
+}
+
+//LU with partial pivoting in place: the unit lower factor below the diagonal,
+//U on and above it, and row c swapped with row perm[c] at step c
+static int FactorFloat(int n, float *a, int *perm)
+{
+    for(int c = 0; c < n; c++) {
+        int pivot = c;
+        for(int i = c + 1; i < n; i++) {
+            if(fabsf(a[(size_t)i * n + c]) > fabsf(a[(size_t)pivot * n + c])) {
+                pivot = i;
+            }
+        }
+        perm[c] = pivot;
+        if(a[(size_t)pivot * n + c] == 0) {
+            return 0;
+        }
+        if(pivot != c) {
+            for(int j = 0; j < n; j++) {
+                float t = a[(size_t)c * n + j];
+                a[(size_t)c * n + j] = a[(size_t)pivot * n + j];
+                a[(size_t)pivot * n + j] = t;
+            }
+        }
+
+        const float *prow = a + (size_t)c * n;
+        for(int i = c + 1; i < n; i++) {
+            float *row = a + (size_t)i * n;
+            float f = row[c] / prow[c];
+            row[c] = f;
+            if(f != 0) {
+                AxpyFloat(n - c - 1, f, prow + c + 1, row + c + 1);
+            }
+        }
+    }
+    return 1;
+}
+
+//x = A^-1 x given FactorFloat()'s output
+static void SolveFloat(int n, const float *lu, const int *perm, float *x)
+{
+    for(int c = 0; c < n; c++) {
+        float t = x[c];
+        x[c] = x[perm[c]];
+        x[perm[c]] = t;
+    }
+    for(int i = 1; i < n; i++) {
+        x[i] -= DotFloat(i, lu + (size_t)i * n, x);
+    }
+    for(int i = n - 1; i >= 0; i--) {
+        const float *row = lu + (size_t)i * n;
+        x[i] = (x[i] - DotFloat(n - i - 1, row + i + 1, x + i + 1)) / row[i];
+    }
+}
+
+/*******************************************************************************
+ * Double kernels
+ ******************************************************************************/
+
+static void AxpyDouble(int len, double f, const double *x, double *y)
+{
+    int j = 0;
+
+    for(; j + 2 <= len; j += 2) {
+        Double2 vx, vy;
+        memcpy(&vx, x + j, sizeof(vx));
+        memcpy(&vy, y + j, sizeof(vy));
+        vy -= f * vx;
+        memcpy(y + j, &vy, sizeof(vy));
+    }
+    for(; j < len; j++) {
+        y[j] -= f * x[j];
+    }
+}
+
+static double DotDouble(int len, const double *x, const double *y)
+{
+    Double2 acc = {0};
+    double dot;
+    int j = 0;
+
+    for(; j + 2 <= len; j += 2) {
+        Double2 vx, vy;
+        memcpy(&vx, x + j, sizeof(vx));
+        memcpy(&vy, y + j, sizeof(vy));
+        acc += vx * vy;
+    }
+    dot = acc[0] + acc[1];
+    for(; j < len; j++) {
+        dot += x[j] * y[j];
+    }
+    return dot;
+}
+
+static int FactorDouble(int n, double *a, int *perm)
+{
+    for(int c = 0; c < n; c++) {
+        int pivot = c;
+        for(int i = c + 1; i < n; i++) {
+            if(fabs(a[(size_t)i * n + c]) > fabs(a[(size_t)pivot * n + c])) {
+                pivot = i;
+            }
+        }
+        perm[c] = pivot;
+        if(a[(size_t)pivot * n + c] == 0) {
+            return 0;
+        }
+        if(pivot != c) {
+            for(int j = 0; j < n; j++) {
+                double t = a[(size_t)c * n + j];
+                a[(size_t)c * n + j] = a[(size_t)pivot * n + j];
+                a[(size_t)pivot * n + j] = t;
+            }
+        }
+
+        const double *prow = a + (size_t)c * n;
+        for(int i = c + 1; i < n; i++) {
+            double *row = a + (size_t)i * n;
+            double f = row[c] / prow[c];
+            row[c] = f;
+            if(f != 0) {
+                AxpyDouble(n - c - 1, f, prow + c + 1, row + c + 1);
+            }
+        }
+    }
+    return 1;
+}
+
+static void SolveDouble(int n, const double *lu, const int *perm, double *x)
+{
+    for(int c = 0; c < n; c++) {
+        double t = x[c];
+        x[c] = x[perm[c]];
+        x[perm[c]] = t;
+    }
+    for(int i = 1; i < n; i++) {
+        x[i] -= DotDouble(i, lu + (size_t)i * n, x);
+    }
+    for(int i = n - 1; i >= 0; i--) {
+        const double *row = lu + (size_t)i * n;
+        x[i] = (x[i] - DotDouble(n - i - 1, row + i + 1, x + i + 1)) / row[i];
+    }
+}
+
+//r = b - A x, and the normwise backward error of x
+static double Residual(int n, const double *mat, const double *b,
+        const double *x, double norm_a, double *r)
+{
+    double norm_r = 0, norm_x = 0, norm_b = 0;
+
+    for(int i = 0; i < n; i++) {
+        r[i] = b[i] - DotDouble(n, mat + (size_t)i * n, x);
+        //written so that a NaN is kept rather than skipped
+        norm_r = !(fabs(r[i]) <= norm_r) ? fabs(r[i]) : norm_r;
+        norm_x = fabs(x[i]) > norm_x ? fabs(x[i]) : norm_x;
+        norm_b = fabs(b[i]) > norm_b ? fabs(b[i]) : norm_b;
+    }
+    //a solution that overflowed, or came from factors that did, is no
+    //solution; NaN keeps every later test against tol failing
+    if(!isfinite(norm_r)) {
+        return NAN;
+    }
+    return norm_r > 0 ? norm_r / (norm_a * norm_x + norm_b) : 0;
+}
+
+/*******************************************************************************
+ * Solvers
+ ******************************************************************************/
+
+/**
+ * MatrixNSolveDouble solves mat x = b by LU factorization with partial
+ * pivoting, entirely in double.
+ *
+ * @param: n, the dimension of the system
+ * @param: mat, pointer to an n x n matrix
+ * @param: b, the n-long right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ *
+ * @return: 1 on success, 0 if mat is singular (or memory ran out), in which
+ *          case x is left untouched
+ */
+int MatrixNSolveDouble(int n, const double *mat, const double *b, double *x)
+{
+    size_t nn = (size_t)n * n;
+    MatrixArenaPos pos = MatrixArenaMark();
+    double *lu = MatrixArenaAlloc(nn * sizeof(double));
+    double *y = MatrixArenaAlloc(n * sizeof(double));
+    int *perm = MatrixArenaAlloc(n * sizeof(int));
+
+    if(lu == NULL || y == NULL || perm == NULL) {
+        MatrixArenaRelease(pos);
+        return 0;
+    }
+    memcpy(lu, mat, nn * sizeof(double));
+    if(!FactorDouble(n, lu, perm)) {
+        MatrixArenaRelease(pos);
+        return 0;
+    }
+    memcpy(y, b, n * sizeof(double));
+    SolveDouble(n, lu, perm, y);
+    memcpy(x, y, n * sizeof(double));
+    MatrixArenaRelease(pos);
+    return 1;
+}
+
+/**
+ * MatrixNSolveRefined solves mat x = b with float LU factors and double
+ * iterative refinement.
+ *
+ * @param: n, the dimension of the system
+ * @param: mat, pointer to an n x n matrix
+ * @param: b, the n-long right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ * @param: tol, the residual (as in struct MatrixRefineInfo) to reach, or 0
+ *         for sqrt(n) * DBL_EPSILON
+ * @param: info, modified to describe the solve, or NULL
+ *
+ * @return: 1 on success, 0 if mat is singular (or memory ran out), in which
+ *          case x and info are left untouched
+ */
+int MatrixNSolveRefined(int n, const double *mat, const double *b, double *x,
+        double tol, struct MatrixRefineInfo *info)
+{
+    size_t nn = (size_t)n * n;
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *lu = MatrixArenaAlloc(nn * sizeof(float));
+    float *d = MatrixArenaAlloc(n * sizeof(float));
+    double *y = MatrixArenaAlloc(n * sizeof(double));
+    double *r = MatrixArenaAlloc(n * sizeof(double));
+    int *perm = MatrixArenaAlloc(n * sizeof(int));
+    struct MatrixRefineInfo result = {0, 0, 0};
+    double norm_a = 0, previous = INFINITY;
+
+    if(lu == NULL || d == NULL || y == NULL || r == NULL || perm == NULL) {
+        MatrixArenaRelease(pos);
+        return 0;
+    }
+    if(tol <= 0) {
+        tol = sqrt(n) * DBL_EPSILON;
+    }
+    for(int i = 0; i < n; i++) {
+        double row_sum = 0;
+        for(int j = 0; j < n; j++) {
+            double v = mat[(size_t)i * n + j];
+            lu[(size_t)i * n + j] = (float)v;
+            row_sum += fabs(v);
+        }
+        norm_a = row_sum > norm_a ? row_sum : norm_a;
+    }
+
+    //a matrix that is singular in float may still be solvable in double
+    if(FactorFloat(n, lu, perm)) {
+        for(int i = 0; i < n; i++) {
+            d[i] = (float)b[i];
+        }
+        SolveFloat(n, lu, perm, d);
+        for(int i = 0; i < n; i++) {
+            y[i] = d[i];
+        }
+        result.residual = Residual(n, mat, b, y, norm_a, r);
+        while(!(result.residual <= tol) && result.residual <= STAGNATION * previous
+                && result.iterations < MATRIX_REFINE_MAX_ITER) {
+            for(int i = 0; i < n; i++) {
+                d[i] = (float)r[i];
+            }
+            SolveFloat(n, lu, perm, d);
+            for(int i = 0; i < n; i++) {
+                y[i] += d[i];
+            }
+            previous = result.residual;
+            result.residual = Residual(n, mat, b, y, norm_a, r);
+            result.iterations++;
+        }
+    } else {
+        result.residual = INFINITY;
+    }
+
+    //written so that a NaN residual also takes the double factorization
+    if(!(result.residual <= tol)) {
+        //y is only replaced if the double solve succeeds and does better
+        if(MatrixNSolveDouble(n, mat, b, r)) {
+            double *z = MatrixArenaAlloc(n * sizeof(double));
+            double residual;
+            if(z == NULL) {
+                MatrixArenaRelease(pos);
+                return 0;
+            }
+            residual = Residual(n, mat, b, r, norm_a, z);
+            if(residual < result.residual || isnan(result.residual)) {
+                memcpy(y, r, n * sizeof(double));
+                result.residual = residual;
+                result.fallback = 1;
+            }
+        }
+        if(!isfinite(result.residual)) {
+            MatrixArenaRelease(pos);
+            return 0;
+        }
+    }
+
+    memcpy(x, y, n * sizeof(double));
+    if(info != NULL) {
+        *info = result;
+    }
+    MatrixArenaRelease(pos);
+    return 1;
+}
@@ -0,0 +1,74 @@
+#ifndef MATRIX_REFINE_H
+#define MATRIX_REFINE_H
+
+/**
+ * @file    MatrixRefine.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements mixed-precision linear solves.  The system is given
+ * in double, but the O(n^3) LU factorization runs in float, where a SIMD
+ * register holds twice as many elements and the factor takes half the
+ * memory.  The float solution is then refined: the residual b - A x is
+ * formed in double against the original A, the correction is solved with
+ * the float factors, and x is updated in double.  Each step gains about as
+ * many digits as the float factors are accurate to, so for a reasonably
+ * conditioned system (cond(A) well below 1 / FLT_EPSILON, about 10^7) a few
+ * steps reach full double accuracy.
+ *
+ * If the residual stops shrinking, the system is too ill-conditioned for
+ * float factors and the solve falls back to a double factorization, so the
+ * answer is never worse than MatrixNSolveDouble()'s.
+ *
+ * Matrices follow MatrixN.h: row-major, n * n values.
+ */
+
+/**
+ * MATRIX_REFINE_MAX_ITER is the most refinement steps taken before falling
+ * back to a double factorization.
+ */
+#define MATRIX_REFINE_MAX_ITER 10
+
+/**
+ * What a refined solve did.
+ */
+struct MatrixRefineInfo {
+    int iterations;     //refinement steps taken
+    int fallback;       //1 if the double factorization had to be used
+    double residual;    //final ||b - A x|| / (||A|| ||x|| + ||b||), inf-norms
+};
+
+/**
+ * MatrixNSolveRefined solves mat x = b with float LU factors and double
+ * iterative refinement.
+ *
+ * @param: n, the dimension of the system
+ * @param: mat, pointer to an n x n matrix
+ * @param: b, the n-long right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ * @param: tol, the residual (as in struct MatrixRefineInfo) to reach, or 0
+ *         for sqrt(n) * DBL_EPSILON
+ * @param: info, modified to describe the solve, or NULL
+ *
+ * @return: 1 on success, 0 if mat is singular (or memory ran out), in which
+ *          case x and info are left untouched
+ */
+int MatrixNSolveRefined(int n, const double *mat, const double *b, double *x,
+        double tol, struct MatrixRefineInfo *info);
+
+/**
+ * MatrixNSolveDouble solves mat x = b by LU factorization with partial
+ * pivoting, entirely in double.
+ *
+ * @param: n, the dimension of the system
+ * @param: mat, pointer to an n x n matrix
+ * @param: b, the n-long right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ *
+ * @return: 1 on success, 0 if mat is singular (or memory ran out), in which
+ *          case x is left untouched
+ */
+int MatrixNSolveDouble(int n, const double *mat, const double *b, double *x);
+
+#endif // MATRIX_REFINE_H
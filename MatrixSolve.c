@@ -0,0 +1,261 @@
+/**
+ * @file    MatrixSolve.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "MatrixBatch.h"
+#include "MatrixThreads.h"
+#include "MatrixSolve.h"
+
+//systems solved side by side, one per lane of a 16-byte vector; the single
+//system solves run the same code with every lane equal
+#define LANES 2
+
+typedef double Double2 __attribute__((vector_size(16)));
+typedef float Float2 __attribute__((vector_size(8)));
+typedef int64_t Long2 __attribute__((vector_size(16)));
+
+//what is kept of LANES matrices between the factor and the solves
+struct Cofactors {
+    Double2 c[DIM][DIM];    //c[i][j] is the signed cofactor of element (i, j)
+    Double2 det, scale;    //scale = 1 / det
+    Long2 singular;         //all bits set in the lanes of singular systems
+    Long2 ill;              //and in those of ill-conditioned ones
+};
+
+/*******************************************************************************
+ * Lane kernels
+ ******************************************************************************/
+
+static Double2 Abs(Double2 v)
+{
+    return (Double2)((Long2)v & 0x7fffffffffffffff);
+}
+
+static Double2 Max(Double2 a, Double2 b)
+{
+    Long2 larger = a > b;
+    return (Double2)(((Long2)a & larger) | ((Long2)b & ~larger));
+}
+
+//the arithmetic is in double: a product of two floats is exact there, so
+//every cofactor is rounded once, and the error of x grows with cond(mat)
+//times DBL_EPSILON instead of with cond(mat)^2 times FLT_EPSILON, as a float
+//cofactor product does when two singular values are small
+static void Factor(Double2 a[DIM][DIM], struct Cofactors *f)
+{
+    Double2 rcond, norm = {0}, norm_adj = {0};
+
+    //with the indices taken cyclically the checkerboard signs come for free
+    for(int i = 0; i < DIM; i++) {
+        int i1 = (i + 1) % DIM, i2 = (i + 2) % DIM;
+        for(int j = 0; j < DIM; j++) {
+            int j1 = (j + 1) % DIM, j2 = (j + 2) % DIM;
+            f->c[i][j] = a[i1][j1] * a[i2][j2] - a[i1][j2] * a[i2][j1];
+        }
+    }
+    f->det = a[0][0] * f->c[0][0] + a[0][1] * f->c[0][1] +
+            a[0][2] * f->c[0][2];
+
+    //infinity norms of mat and of adj(mat) = det mat^-1 (row i of the
+    //adjugate is column i of the cofactors)
+    for(int i = 0; i < DIM; i++) {
+        norm = Max(norm, Abs(a[i][0]) + Abs(a[i][1]) + Abs(a[i][2]));
+        norm_adj = Max(norm_adj, Abs(f->c[0][i]) + Abs(f->c[1][i]) +
+                Abs(f->c[2][i]));
+    }
+    //divided in two steps so that large entries do not overflow the product;
+    //a zero det, a NaN or an infinity all leave rcond zero or NaN (tested
+    //as such: GCC 12 crashes on the inverted mask of !(rcond > 0) under
+    //-fprofile-use with LTO)
+    rcond = Abs(f->det) / norm / norm_adj;
+    f->singular = (rcond <= 0) | (rcond != rcond);
+    f->ill = rcond < MATRIX_SOLVE_RCOND;
+    //one division per matrix; its extra rounding is far below float's
+    f->scale = 1 / f->det;
+}
+
+//the status of lane l
+static int Status(const struct Cofactors *f, int l)
+{
+    return f->singular[l] ? MATRIX_SOLVE_SINGULAR :
+            f->ill[l] ? MATRIX_SOLVE_ILL_CONDITIONED : MATRIX_SOLVE_OK;
+}
+
+//x = adj(mat) b / det, zero in singular lanes
+static void Apply(const struct Cofactors *f, const Double2 b[DIM],
+        Double2 x[DIM])
+{
+    for(int i = 0; i < DIM; i++) {
+        Double2 v = (f->c[0][i] * b[0] + f->c[1][i] * b[1] + f->c[2][i] * b[2])
+                * f->scale;
+        x[i] = (Double2)((Long2)v & ~f->singular);
+    }
+}
+
+/*******************************************************************************
+ * Single systems
+ ******************************************************************************/
+
+/**
+ * MatrixSolve3 solves mat x = b and "returns" x by modifying the third
+ * argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: b, the right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ *
+ * @return: MATRIX_SOLVE_OK, MATRIX_SOLVE_ILL_CONDITIONED or
+ *          MATRIX_SOLVE_SINGULAR, in which case x is left untouched
+ *
+ * mat is not modified by this function.
+ */
+int MatrixSolve3(float mat[3][3], float b[3], float x[3])
+{
+    return MatrixSolve3Multi(mat, 1, (float (*)[3])b, (float (*)[3])x);
+}
+
+/**
+ * MatrixSolve3Multi solves mat x = b for several right-hand sides.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: nrhs, the number of right-hand sides
+ * @param: b, the nrhs right-hand sides
+ * @param: x, modified to contain the nrhs solutions (may be the same as b)
+ *
+ * @return: as MatrixSolve3(); x is left untouched if mat is singular
+ */
+int MatrixSolve3Multi(float mat[3][3], int nrhs, float b[][3], float x[][3])
+{
+    Double2 a[DIM][DIM];
+    struct Cofactors f;
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            a[i][j] = (Double2){0} + mat[i][j];
+        }
+    }
+    Factor(a, &f);
+    if(Status(&f, 0) == MATRIX_SOLVE_SINGULAR) {
+        return MATRIX_SOLVE_SINGULAR;
+    }
+    for(int r = 0; r < nrhs; r++) {
+        Double2 vb[DIM], vx[DIM];
+        for(int i = 0; i < DIM; i++) {
+            vb[i] = (Double2){0} + b[r][i];
+        }
+        Apply(&f, vb, vx);
+        for(int i = 0; i < DIM; i++) {
+            x[r][i] = (float)vx[i][0];
+        }
+    }
+    return Status(&f, 0);
+}
+
+/*******************************************************************************
+ * Batches
+ ******************************************************************************/
+
+struct SolveJob {
+    int count, nrhs;
+    const float *mats, *b;
+    float *x;
+    unsigned char *status;
+    atomic_int singular;
+};
+
+//loads `len` lanes from plane p at system k; missing lanes are zero, which
+//makes them singular and keeps them finite
+static Double2 Load(const float *p, int k, int len)
+{
+    Float2 v = {0};
+    if(len == LANES) {
+        memcpy(&v, p + k, sizeof(v));
+    } else {
+        memcpy(&v, p + k, len * sizeof(float));
+    }
+    return __builtin_convertvector(v, Double2);
+}
+
+static void Store(float *p, int k, int len, Double2 v)
+{
+    Float2 f = __builtin_convertvector(v, Float2);
+    if(len == LANES) {
+        memcpy(p + k, &f, sizeof(f));
+    } else {
+        memcpy(p + k, &f, len * sizeof(float));
+    }
+}
+
+//solves the systems of lane groups [begin, end)
+static void SolveGroups(void *arg, int begin, int end)
+{
+    struct SolveJob *job = arg;
+    int count = job->count, singular = 0;
+
+    for(int g = begin; g < end; g++) {
+        int k = g * LANES;
+        int len = count - k < LANES ? count - k : LANES;
+        Double2 a[DIM][DIM];
+        struct Cofactors f;
+
+        for(int i = 0; i < DIM; i++) {
+            for(int j = 0; j < DIM; j++) {
+                a[i][j] = Load(MATRIX_SOA(job->mats, count, i, j), k, len);
+            }
+        }
+        Factor(a, &f);
+        for(int r = 0; r < job->nrhs; r++) {
+            const float *b = job->b + (size_t)r * DIM * count;
+            float *x = job->x + (size_t)r * DIM * count;
+            Double2 vb[DIM], vx[DIM];
+            //every component is read before any is written, so x may be b
+            for(int i = 0; i < DIM; i++) {
+                vb[i] = Load(b + (size_t)i * count, k, len);
+            }
+            Apply(&f, vb, vx);
+            for(int i = 0; i < DIM; i++) {
+                Store(x + (size_t)i * count, k, len, vx[i]);
+            }
+        }
+        for(int l = 0; l < len; l++) {
+            int status = Status(&f, l);
+            singular += status == MATRIX_SOLVE_SINGULAR;
+            if(job->status != NULL) {
+                job->status[k + l] = (unsigned char)status;
+            }
+        }
+    }
+    atomic_fetch_add_explicit(&job->singular, singular, memory_order_relaxed);
+}
+
+/**
+ * MatrixSolve3Batch solves `count` systems in SoA layout, each with nrhs
+ * right-hand sides.  Right-hand side r of every system is a SoA vector
+ * batch of its own: component i of it for system k is
+ * b[(r * DIM + i) * count + k], and x is laid out the same way.
+ *
+ * @param: count, the number of systems
+ * @param: mats, 9 * count floats, the SoA batch of matrices
+ * @param: nrhs, the number of right-hand sides per system
+ * @param: b, 3 * nrhs * count floats, the right-hand sides
+ * @param: x, 3 * nrhs * count floats that are modified to hold the
+ *         solutions, zero for singular systems (may be the same as b)
+ * @param: status, count values that are modified to hold each system's
+ *         status (may be NULL)
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the number of singular systems
+ */
+int MatrixSolve3Batch(int count, const float *mats, int nrhs, const float *b,
+        float *x, unsigned char *status, int threads)
+{
+    struct SolveJob job = {count, nrhs, mats, b, x, status, 0};
+
+    //threads own whole lane groups, so no two of them write the same vector
+    MatrixParallelFor((count + LANES - 1) / LANES, threads, SolveGroups, &job);
+    return atomic_load_explicit(&job.singular, memory_order_relaxed);
+}
@@ -0,0 +1,100 @@
+#ifndef MATRIX_SOLVE_H
+#define MATRIX_SOLVE_H
+
+/**
+ * @file    MatrixSolve.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements direct solves of 3x3 linear systems mat x = b, for
+ * code that would otherwise call MatrixInverse() and multiply.  The solve
+ * is a cofactor product, x = adj(mat) b / det(mat) (Cramer's rule), with
+ * the determinant expanded from the same cofactors, so only the nine
+ * cofactors are formed and no inverse is stored.  Several right-hand sides
+ * per matrix reuse them.  The cofactors are formed in double, which keeps
+ * x within about one float rounding of the exact solution of the given
+ * system until cond(mat) passes about 10^8; a float cofactor product, like
+ * MatrixInverse(), loses accuracy far sooner when two of the singular values
+ * are small.
+ *
+ * Every system gets a status instead of being silently skipped:
+ *  - MATRIX_SOLVE_OK: solved
+ *  - MATRIX_SOLVE_ILL_CONDITIONED: solved, but the reciprocal condition
+ *    number 1 / (||mat|| ||mat^-1||) (infinity norm, computed exactly from
+ *    the cofactors) is below MATRIX_SOLVE_RCOND, so a small error in mat or
+ *    b (such as its own rounding to float) can change x completely
+ *  - MATRIX_SOLVE_SINGULAR: det(mat) is zero or the system holds values
+ *    that are not finite; there is no solution to give
+ *
+ * The batched solve takes MatrixBatch.h SoA batches and runs two systems
+ * per 16-byte SIMD register, branch-free.  The single-system functions run
+ * the same kernel, so a system gets bit-identical results from either.
+ */
+
+#include "MatrixMath.h"
+
+/**
+ * Solve statuses.
+ */
+#define MATRIX_SOLVE_OK 0
+#define MATRIX_SOLVE_ILL_CONDITIONED 1
+#define MATRIX_SOLVE_SINGULAR 2
+
+/**
+ * MATRIX_SOLVE_RCOND is the reciprocal condition number below which a
+ * system is flagged ill-conditioned: past a condition number of 1e5, an
+ * error of one float rounding in mat can leave fewer than two correct
+ * digits in x.
+ */
+#define MATRIX_SOLVE_RCOND 1e-5f
+
+/**
+ * MatrixSolve3 solves mat x = b and "returns" x by modifying the third
+ * argument.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: b, the right-hand side
+ * @param: x, modified to contain the solution (may be the same as b)
+ *
+ * @return: MATRIX_SOLVE_OK, MATRIX_SOLVE_ILL_CONDITIONED or
+ *          MATRIX_SOLVE_SINGULAR, in which case x is left untouched
+ *
+ * mat is not modified by this function.
+ */
+int MatrixSolve3(float mat[3][3], float b[3], float x[3]);
+
+/**
+ * MatrixSolve3Multi solves mat x = b for several right-hand sides.
+ *
+ * @param: mat, a pointer to a 3x3 matrix
+ * @param: nrhs, the number of right-hand sides
+ * @param: b, the nrhs right-hand sides
+ * @param: x, modified to contain the nrhs solutions (may be the same as b)
+ *
+ * @return: as MatrixSolve3(); x is left untouched if mat is singular
+ */
+int MatrixSolve3Multi(float mat[3][3], int nrhs, float b[][3], float x[][3]);
+
+/**
+ * MatrixSolve3Batch solves `count` systems in SoA layout, each with nrhs
+ * right-hand sides.  Right-hand side r of every system is a SoA vector
+ * batch of its own: component i of it for system k is
+ * b[(r * DIM + i) * count + k], and x is laid out the same way.
+ *
+ * @param: count, the number of systems
+ * @param: mats, 9 * count floats, the SoA batch of matrices
+ * @param: nrhs, the number of right-hand sides per system
+ * @param: b, 3 * nrhs * count floats, the right-hand sides
+ * @param: x, 3 * nrhs * count floats that are modified to hold the
+ *         solutions, zero for singular systems (may be the same as b)
+ * @param: status, count values that are modified to hold each system's
+ *         status (may be NULL)
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the number of singular systems
+ */
+int MatrixSolve3Batch(int count, const float *mats, int nrhs, const float *b,
+        float *x, unsigned char *status, int threads);
+
+#endif // MATRIX_SOLVE_H
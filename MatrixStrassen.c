@@ -0,0 +1,363 @@
+/**
+ * @file    MatrixStrassen.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "MatrixArena.h"
+#include "MatrixThreads.h"
+#include "MatrixTune.h"
+#include "MatrixStrassen.h"
+
+#define PRODUCTS 7
+
+static int cutoff = MATRIX_STRASSEN_CUTOFF;
+static int base_block = MATRIX_STRASSEN_BLOCK;
+
+/**
+ * MatrixStrassenSetCutoff / MatrixStrassenGetCutoff set and read the
+ * recursion cutoff.  It must not change between sizing the scratch buffer
+ * and using it.
+ */
+void MatrixStrassenSetCutoff(int n)
+{
+    MatrixTuneInit();
+    cutoff = n < MATRIX_STRASSEN_MIN_CUTOFF ? MATRIX_STRASSEN_MIN_CUTOFF : n;
+}
+
+int MatrixStrassenGetCutoff(void)
+{
+    MatrixTuneInit();
+    return cutoff;
+}
+
+/**
+ * MatrixStrassenSetBlock / MatrixStrassenGetBlock set and read the k-block
+ * of the conventional kernel.
+ */
+void MatrixStrassenSetBlock(int block)
+{
+    MatrixTuneInit();
+    base_block = block < 1 ? 1 : block;
+}
+
+int MatrixStrassenGetBlock(void)
+{
+    MatrixTuneInit();
+    return base_block;
+}
+
+/*******************************************************************************
+ * Kernels on strided sub-matrices: element (i, j) of a is a[i * lda + j]
+ ******************************************************************************/
+
+//conventional kernel: i-k-j order with k blocked so that the rows of b in
+//use stay in cache while every row of a streams past them
+static void BaseMultiply(int n, const float *a, int lda, const float *b,
+        int ldb, float *c, int ldc)
+{
+    for(int i = 0; i < n; i++) {
+        memset(c + (size_t)i * ldc, 0, n * sizeof(float));
+    }
+    for(int kk = 0; kk < n; kk += base_block) {
+        int k_end = kk + base_block < n ? kk + base_block : n;
+        for(int i = 0; i < n; i++) {
+            float *row = c + (size_t)i * ldc;
+            for(int p = kk; p < k_end; p++) {
+                float s = a[(size_t)i * lda + p];
+                const float *b_row = b + (size_t)p * ldb;
+                for(int j = 0; j < n; j++) {
+                    row[j] += s * b_row[j];
+                }
+            }
+        }
+    }
+}
+
+static void Add(int n, const float *a, int lda, const float *b, int ldb,
+        float *c, int ldc)
+{
+    for(int i = 0; i < n; i++) {
+        const float *x = a + (size_t)i * lda, *y = b + (size_t)i * ldb;
+        float *z = c + (size_t)i * ldc;
+        for(int j = 0; j < n; j++) {
+            z[j] = x[j] + y[j];
+        }
+    }
+}
+
+static void Sub(int n, const float *a, int lda, const float *b, int ldb,
+        float *c, int ldc)
+{
+    for(int i = 0; i < n; i++) {
+        const float *x = a + (size_t)i * lda, *y = b + (size_t)i * ldb;
+        float *z = c + (size_t)i * ldc;
+        for(int j = 0; j < n; j++) {
+            z[j] = x[j] - y[j];
+        }
+    }
+}
+
+//finishes an odd n once the leading (n - 1) x (n - 1) block of c holds the
+//product of the leading blocks of a and b
+static void Peel(int n, const float *a, int lda, const float *b, int ldb,
+        float *c, int ldc)
+{
+    int m = n - 1;
+    const float *b_last = b + (size_t)m * ldb;
+    float *c_last = c + (size_t)m * ldc;
+
+    //leading block: add the rank-1 term a(:, m) b(m, :)
+    for(int i = 0; i < m; i++) {
+        float s = a[(size_t)i * lda + m];
+        float *row = c + (size_t)i * ldc;
+        for(int j = 0; j < m; j++) {
+            row[j] += s * b_last[j];
+        }
+    }
+    //last column, then the rest of the last row
+    for(int i = 0; i < n; i++) {
+        float sum = 0;
+        for(int p = 0; p < n; p++) {
+            sum += a[(size_t)i * lda + p] * b[(size_t)p * ldb + m];
+        }
+        c[(size_t)i * ldc + m] = sum;
+    }
+    memset(c_last, 0, m * sizeof(float));
+    for(int p = 0; p < n; p++) {
+        float s = a[(size_t)m * lda + p];
+        const float *b_row = b + (size_t)p * ldb;
+        for(int j = 0; j < m; j++) {
+            c_last[j] += s * b_row[j];
+        }
+    }
+}
+
+/*******************************************************************************
+ * Sequential recursion
+ ******************************************************************************/
+
+static size_t SequentialScratch(int n)
+{
+    size_t total = 0;
+
+    //two half-size temporaries per level, the levels below reuse the rest
+    while(n > cutoff) {
+        size_t h = (size_t)(n / 2);
+        total += 2 * h * h;
+        n = (int)h;
+    }
+    return total;
+}
+
+//the schedule of Boyer, Dumas, Pernet and Zhou ("Memory efficient
+//scheduling of Strassen-Winograd's matrix multiplication algorithm"): the
+//quadrants of c double as temporaries, so only X and Y are extra
+static void Multiply(int n, const float *a, int lda, const float *b, int ldb,
+        float *c, int ldc, float *w)
+{
+    if(n <= cutoff) {
+        BaseMultiply(n, a, lda, b, ldb, c, ldc);
+        return;
+    }
+
+    int h = n / 2;
+    size_t down_a = (size_t)h * lda, down_b = (size_t)h * ldb;
+    size_t down_c = (size_t)h * ldc;
+    const float *a11 = a, *a12 = a + h, *a21 = a + down_a, *a22 = a + down_a + h;
+    const float *b11 = b, *b12 = b + h, *b21 = b + down_b, *b22 = b + down_b + h;
+    float *c11 = c, *c12 = c + h, *c21 = c + down_c, *c22 = c + down_c + h;
+    float *x = w, *y = w + (size_t)h * h, *rest = y + (size_t)h * h;
+
+    Sub(h, a11, lda, a21, lda, x, h);                       //S3
+    Sub(h, b22, ldb, b12, ldb, y, h);                       //T3
+    Multiply(h, x, h, y, h, c21, ldc, rest);                //P7
+    Add(h, a21, lda, a22, lda, x, h);                       //S1
+    Sub(h, b12, ldb, b11, ldb, y, h);                       //T1
+    Multiply(h, x, h, y, h, c22, ldc, rest);                //P5
+    Sub(h, x, h, a11, lda, x, h);                           //S2
+    Sub(h, b22, ldb, y, h, y, h);                           //T2
+    Multiply(h, x, h, y, h, c11, ldc, rest);                //P6
+    Sub(h, a12, lda, x, h, x, h);                           //S4
+    Multiply(h, x, h, b22, ldb, c12, ldc, rest);            //P3
+    Multiply(h, a11, lda, b11, ldb, x, h, rest);            //P1
+    Add(h, x, h, c11, ldc, c11, ldc);                       //U2 = P1 + P6
+    Add(h, c11, ldc, c21, ldc, c21, ldc);                   //U3 = U2 + P7
+    Add(h, c11, ldc, c22, ldc, c11, ldc);                   //U4 = U2 + P5
+    Add(h, c21, ldc, c22, ldc, c22, ldc);                   //U7 = U3 + P5
+    Add(h, c11, ldc, c12, ldc, c12, ldc);                   //U5 = U4 + P3
+    Sub(h, y, h, b21, ldb, y, h);                           //T4
+    Multiply(h, a22, lda, y, h, c11, ldc, rest);            //P4
+    Sub(h, c21, ldc, c11, ldc, c21, ldc);                   //U6 = U3 - P4
+    Multiply(h, a12, lda, b21, ldb, c11, ldc, rest);        //P2
+    Add(h, x, h, c11, ldc, c11, ldc);                       //U1 = P1 + P2
+
+    if(n & 1) {
+        Peel(n, a, lda, b, ldb, c, ldc);
+    }
+}
+
+/*******************************************************************************
+ * Parallel top level
+ ******************************************************************************/
+
+struct Product {
+    const float *left, *right;
+    float *out, *scratch;
+    int ld_left, ld_right, ld_out;
+};
+
+struct TopLevel {
+    int h;
+    struct Product products[PRODUCTS];
+};
+
+static void RunProducts(void *arg, int begin, int end)
+{
+    struct TopLevel *top = arg;
+
+    for(int i = begin; i < end; i++) {
+        struct Product *p = &top->products[i];
+        Multiply(top->h, p->left, p->ld_left, p->right, p->ld_right, p->out,
+                p->ld_out, p->scratch);
+    }
+}
+
+static size_t ParallelScratch(int n)
+{
+    size_t h = (size_t)(n / 2);
+
+    //S1-S4, T1-T4 and three products that have no quadrant of c to live
+    //in, plus private recursion space for each of the seven products
+    return 11 * h * h + PRODUCTS * SequentialScratch((int)h);
+}
+
+static void ParallelMultiply(int n, const float *a, const float *b, float *c,
+        float *w, int threads)
+{
+    int h = n / 2;
+    size_t hh = (size_t)h * h, down = (size_t)h * n;
+    const float *a11 = a, *a12 = a + h, *a21 = a + down, *a22 = a + down + h;
+    const float *b11 = b, *b12 = b + h, *b21 = b + down, *b22 = b + down + h;
+    float *c11 = c, *c12 = c + h, *c21 = c + down, *c22 = c + down + h;
+    float *s1 = w, *s2 = s1 + hh, *s3 = s2 + hh, *s4 = s3 + hh;
+    float *t1 = s4 + hh, *t2 = t1 + hh, *t3 = t2 + hh, *t4 = t3 + hh;
+    float *p2 = t4 + hh, *p3 = p2 + hh, *p4 = p3 + hh, *rest = p4 + hh;
+    size_t per_product = SequentialScratch(h);
+
+    Add(h, a21, n, a22, n, s1, h);
+    Sub(h, s1, h, a11, n, s2, h);
+    Sub(h, a11, n, a21, n, s3, h);
+    Sub(h, a12, n, s2, h, s4, h);
+    Sub(h, b12, n, b11, n, t1, h);
+    Sub(h, b22, n, t1, h, t2, h);
+    Sub(h, b22, n, b12, n, t3, h);
+    Sub(h, t2, h, b21, n, t4, h);
+
+    struct TopLevel top = {h, {
+        {a11, b11, c11, NULL, n, n, n},     //P1
+        {a12, b21, p2, NULL, n, n, h},      //P2
+        {s4, b22, p3, NULL, h, n, h},       //P3
+        {a22, t4, p4, NULL, n, h, h},       //P4
+        {s1, t1, c22, NULL, h, h, n},       //P5
+        {s2, t2, c12, NULL, h, h, n},       //P6
+        {s3, t3, c21, NULL, h, h, n},       //P7
+    }};
+    for(int i = 0; i < PRODUCTS; i++) {
+        top.products[i].scratch = rest + i * per_product;
+    }
+    MatrixParallelFor(PRODUCTS, threads, RunProducts, &top);
+
+    //same additions in the same order as the sequential schedule, so both
+    //give identical results
+    for(int i = 0; i < h; i++) {
+        float *r11 = c11 + (size_t)i * n, *r12 = c12 + (size_t)i * n;
+        float *r21 = c21 + (size_t)i * n, *r22 = c22 + (size_t)i * n;
+        const float *q2 = p2 + (size_t)i * h, *q3 = p3 + (size_t)i * h;
+        const float *q4 = p4 + (size_t)i * h;
+        for(int j = 0; j < h; j++) {
+            float u2 = r11[j] + r12[j];
+            float u3 = u2 + r21[j];
+            float u4 = u2 + r22[j];
+            r11[j] = r11[j] + q2[j];
+            r12[j] = u4 + q3[j];
+            r21[j] = u3 - q4[j];
+            r22[j] = u3 + r22[j];
+        }
+    }
+
+    if(n & 1) {
+        Peel(n, a, n, b, n, c, n);
+    }
+}
+
+/**
+ * MatrixStrassenScratchSize gives the scratch space MatrixStrassenExecute()
+ * needs.
+ *
+ * @param: n, the dimension of the matrices
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the number of floats of scratch space
+ */
+size_t MatrixStrassenScratchSize(int n, int threads)
+{
+    MatrixTuneInit();
+    if(n > cutoff && MatrixThreadCount(threads) > 1) {
+        return ParallelScratch(n);
+    }
+    return SequentialScratch(n);
+}
+
+/**
+ * MatrixStrassenExecute multiplies two n x n matrices using caller-provided
+ * scratch space.
+ *
+ * @param: n, the dimension of the matrices
+ * @param: mat1, pointer to the left n x n factor
+ * @param: mat2, pointer to the right n x n factor
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         product (must not overlap either factor)
+ * @param: scratch, MatrixStrassenScratchSize(n, threads) floats
+ * @param: threads, the thread count, or 0 for one per online CPU
+ */
+void MatrixStrassenExecute(int n, const float *mat1, const float *mat2,
+        float *result, float *scratch, int threads)
+{
+    MatrixTuneInit();
+    threads = MatrixThreadCount(threads);
+    if(n > cutoff && threads > 1) {
+        ParallelMultiply(n, mat1, mat2, result, scratch, threads);
+    } else {
+        Multiply(n, mat1, n, mat2, n, result, n, scratch);
+    }
+}
+
+/**
+ * MatrixStrassenMultiply is MatrixStrassenExecute() with the scratch space
+ * allocated internally.
+ *
+ * @param: n, the dimension of the matrices
+ * @param: mat1, pointer to the left n x n factor
+ * @param: mat2, pointer to the right n x n factor
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         product (must not overlap either factor)
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: 1 on success, 0 if memory ran out (result is then untouched)
+ */
+int MatrixStrassenMultiply(int n, const float *mat1, const float *mat2,
+        float *result, int threads)
+{
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *scratch = MatrixArenaAlloc(MatrixStrassenScratchSize(n, threads) *
+            sizeof(float));
+
+    if(scratch == NULL) {
+        return 0;
+    }
+    MatrixStrassenExecute(n, mat1, mat2, result, scratch, threads);
+    MatrixArenaRelease(pos);
+    return 1;
+}
@@ -0,0 +1,102 @@
+#ifndef MATRIX_STRASSEN_H
+#define MATRIX_STRASSEN_H
+
+/**
+ * @file    MatrixStrassen.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements Strassen-Winograd multiplication of large square
+ * matrices (MatrixN.h layout).  Each level of recursion replaces 8 half-size
+ * products by 7 products and 15 additions; below the cutoff the recursion
+ * hands over to a conventional cache-blocked kernel.  Odd sizes are handled
+ * by peeling off the last row and column, so no padding is needed.
+ *
+ * All temporaries live in one caller-provided scratch buffer, sized by
+ * MatrixStrassenScratchSize(), so the recursion never allocates.  With more
+ * than one thread the 7 top-level products run concurrently; that schedule
+ * needs more scratch than the sequential one but gives bit-identical
+ * results.
+ *
+ * Accuracy: the error is normwise rather than componentwise and grows
+ * faster with n than that of the classic algorithm (Higham, "Accuracy and
+ * Stability of Numerical Algorithms", ch. 23: roughly as (n/n0)^log2(18)
+ * instead of n for the Winograd variant, with n0 the cutoff).  A larger
+ * cutoff trades speed for accuracy; mml_bench strassen reports both.
+ */
+
+#include <stddef.h>
+
+/**
+ * MATRIX_STRASSEN_CUTOFF is the default size at or below which the
+ * conventional kernel is used.  MATRIX_STRASSEN_MIN_CUTOFF is the smallest
+ * cutoff MatrixStrassenSetCutoff() accepts.
+ */
+#define MATRIX_STRASSEN_CUTOFF 128
+#define MATRIX_STRASSEN_MIN_CUTOFF 16
+
+/**
+ * MATRIX_STRASSEN_BLOCK is the default k-block of the conventional kernel:
+ * how many rows of the right factor it keeps in cache at a time.
+ */
+#define MATRIX_STRASSEN_BLOCK 64
+
+/**
+ * MatrixStrassenSetCutoff / MatrixStrassenGetCutoff set and read the
+ * recursion cutoff.  It must not change between sizing the scratch buffer
+ * and using it.
+ */
+void MatrixStrassenSetCutoff(int cutoff);
+int MatrixStrassenGetCutoff(void);
+
+/**
+ * MatrixStrassenSetBlock / MatrixStrassenGetBlock set and read the k-block
+ * of the conventional kernel.
+ */
+void MatrixStrassenSetBlock(int block);
+int MatrixStrassenGetBlock(void);
+
+/**
+ * MatrixStrassenScratchSize gives the scratch space MatrixStrassenExecute()
+ * needs.
+ *
+ * @param: n, the dimension of the matrices
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the number of floats of scratch space
+ */
+size_t MatrixStrassenScratchSize(int n, int threads);
+
+/**
+ * MatrixStrassenExecute multiplies two n x n matrices using caller-provided
+ * scratch space.
+ *
+ * @param: n, the dimension of the matrices
+ * @param: mat1, pointer to the left n x n factor
+ * @param: mat2, pointer to the right n x n factor
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         product (must not overlap either factor)
+ * @param: scratch, MatrixStrassenScratchSize(n, threads) floats
+ * @param: threads, the thread count, or 0 for one per online CPU
+ */
+void MatrixStrassenExecute(int n, const float *mat1, const float *mat2,
+        float *result, float *scratch, int threads);
+
+/**
+ * MatrixStrassenMultiply is MatrixStrassenExecute() with the scratch space
+ * allocated internally.
+ *
+ * @param: n, the dimension of the matrices
+ * @param: mat1, pointer to the left n x n factor
+ * @param: mat2, pointer to the right n x n factor
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         product (must not overlap either factor)
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: 1 on success, 0 if memory ran out (result is then untouched)
+ */
+int MatrixStrassenMultiply(int n, const float *mat1, const float *mat2,
+        float *result, int threads);
+
+#endif // MATRIX_STRASSEN_H
@@ -0,0 +1,313 @@
+/**
+ * @file    MatrixThreads.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "MatrixThreads.h"
+
+#define MAX_THREADS 256
+
+/*******************************************************************************
+ * Topology
+ ******************************************************************************/
+
+//the NUMA nodes that hold CPUs this process may run on, read once from
+//sysfs; a machine without that information is one node with every CPU
+struct Topology {
+    int nodes;
+    int id[MATRIX_MAX_NODES];           //the kernel's number for each node
+    cpu_set_t cpus[MATRIX_MAX_NODES];
+    int num_cpus[MATRIX_MAX_NODES];
+    int total_cpus;
+    short cpu_node[CPU_SETSIZE];        //index of the node holding each CPU
+};
+
+static struct Topology topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static atomic_int affinity = MATRIX_AFFINITY_NODE;
+
+//adds a sysfs CPU list such as "0-3,8-11" to set
+static void ParseCpuList(const char *list, cpu_set_t *set)
+{
+    while(*list != '\0' && *list != '\n') {
+        char *end;
+        long first = strtol(list, &end, 10), last = first;
+        if(end == list) {
+            return;
+        }
+        if(*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+        }
+        for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        list = *end == ',' ? end + 1 : end;
+    }
+}
+
+static void ReadTopology(void)
+{
+    struct Topology *t = &topology;
+    cpu_set_t allowed;
+    const char *env = getenv("MML_AFFINITY");
+
+    if(env != NULL) {
+        if(strcmp(env, "none") == 0) {
+            atomic_store(&affinity, MATRIX_AFFINITY_NONE);
+        } else if(strcmp(env, "node") == 0) {
+            atomic_store(&affinity, MATRIX_AFFINITY_NODE);
+        } else if(strcmp(env, "core") == 0) {
+            atomic_store(&affinity, MATRIX_AFFINITY_CORE);
+        }
+    }
+
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for(int cpu = 0; cpu < MatrixThreadCount(0) && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+    for(int id = 0; id < MATRIX_MAX_NODES; id++) {
+        char path[64], list[4096];
+        FILE *f;
+        cpu_set_t cpus;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+                id);
+        f = fopen(path, "r");
+        if(f == NULL) {
+            continue;
+        }
+        CPU_ZERO(&cpus);
+        if(fgets(list, sizeof(list), f) != NULL) {
+            ParseCpuList(list, &cpus);
+        }
+        fclose(f);
+        CPU_AND(&cpus, &cpus, &allowed);
+        if(CPU_COUNT(&cpus) > 0) {
+            t->id[t->nodes] = id;
+            t->cpus[t->nodes] = cpus;
+            t->nodes++;
+        }
+    }
+    if(t->nodes == 0) {
+        t->nodes = 1;
+        t->id[0] = 0;
+        t->cpus[0] = allowed;
+    }
+    for(int n = 0; n < t->nodes; n++) {
+        t->num_cpus[n] = CPU_COUNT(&t->cpus[n]);
+        t->total_cpus += t->num_cpus[n];
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &t->cpus[n])) {
+                t->cpu_node[cpu] = (short)n;
+            }
+        }
+    }
+}
+
+static const struct Topology *GetTopology(void)
+{
+    pthread_once(&topology_once, ReadTopology);
+    return &topology;
+}
+
+//the node index of worker w of `threads`: nodes take consecutive workers in
+//proportion to their CPUs, so consecutive chunks of a range share a node
+static int WorkerNode(const struct Topology *t, int w, int threads, int *rank)
+{
+    int n = 0, seen = 0;
+
+    while(n + 1 < t->nodes && (long long)threads * (seen + t->num_cpus[n])
+            / t->total_cpus <= w) {
+        seen += t->num_cpus[n];
+        n++;
+    }
+    *rank = w - (int)((long long)threads * seen / t->total_cpus);
+    return n;
+}
+
+//the CPUs worker w may run on, or 0 if it is not placed at all
+static int WorkerCpus(int w, int threads, cpu_set_t *set)
+{
+    const struct Topology *t = GetTopology();
+    int mode = atomic_load(&affinity), rank, n;
+
+    if(mode == MATRIX_AFFINITY_NONE ||
+            (mode == MATRIX_AFFINITY_NODE && t->nodes == 1)) {
+        return 0;
+    }
+    n = WorkerNode(t, w, threads, &rank);
+    if(mode == MATRIX_AFFINITY_NODE) {
+        *set = t->cpus[n];
+        return 1;
+    }
+    //the rank-th CPU of the node, wrapping if there are more workers
+    rank %= t->num_cpus[n];
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(CPU_ISSET(cpu, &t->cpus[n]) && rank-- == 0) {
+            CPU_ZERO(set);
+            CPU_SET(cpu, set);
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * MatrixNumaNodes counts the NUMA nodes with CPUs this process may use.
+ *
+ * @return: the number of nodes, 1 on a machine without NUMA information
+ */
+int MatrixNumaNodes(void)
+{
+    return GetTopology()->nodes;
+}
+
+/**
+ * MatrixCurrentNode gives the node the calling thread is running on.
+ *
+ * @return: the node's number, 0 if it cannot be told
+ */
+int MatrixCurrentNode(void)
+{
+    const struct Topology *t = GetTopology();
+    int cpu = sched_getcpu();
+
+    if(t->nodes == 1 || cpu < 0 || cpu >= CPU_SETSIZE) {
+        return t->id[0];
+    }
+    return t->id[t->cpu_node[cpu]];
+}
+
+/**
+ * MatrixThreadNode gives the node worker `w` of a MatrixParallelFor() on
+ * `threads` threads runs on.
+ *
+ * @param: w, the worker, from 0 for the first chunk
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the node's number, or -1 if workers are not placed by node
+ *          (MATRIX_AFFINITY_NONE); for worker 0, which is the calling
+ *          thread, the node it would be given, not where it runs
+ */
+int MatrixThreadNode(int w, int threads)
+{
+    const struct Topology *t = GetTopology();
+    int rank;
+
+    if(atomic_load(&affinity) == MATRIX_AFFINITY_NONE) {
+        return -1;
+    }
+    return t->id[WorkerNode(t, w, MatrixThreadCount(threads), &rank)];
+}
+
+/**
+ * MatrixThreadsSetAffinity / MatrixThreadsGetAffinity choose where the
+ * workers of later MatrixParallelFor() calls run.
+ *
+ * @param: mode, MATRIX_AFFINITY_NONE, MATRIX_AFFINITY_NODE or
+ *         MATRIX_AFFINITY_CORE
+ */
+void MatrixThreadsSetAffinity(int mode)
+{
+    GetTopology();
+    if(mode >= MATRIX_AFFINITY_NONE && mode <= MATRIX_AFFINITY_CORE) {
+        atomic_store(&affinity, mode);
+    }
+}
+
+int MatrixThreadsGetAffinity(void)
+{
+    GetTopology();
+    return atomic_load(&affinity);
+}
+
+/*******************************************************************************
+ * Parallel loops
+ ******************************************************************************/
+
+struct Chunk {
+    MatrixRangeFn fn;
+    void *arg;
+    int begin, end;
+};
+
+static void *RunChunk(void *p)
+{
+    struct Chunk *chunk = p;
+    chunk->fn(chunk->arg, chunk->begin, chunk->end);
+    return NULL;
+}
+
+int MatrixThreadCount(int threads)
+{
+    if(threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    return threads > MAX_THREADS ? MAX_THREADS : threads;
+}
+
+void MatrixParallelFor(int count, int threads, MatrixRangeFn fn, void *arg)
+{
+    struct Chunk chunks[MAX_THREADS];
+    pthread_t ids[MAX_THREADS];
+    int started[MAX_THREADS];
+    cpu_set_t set;
+
+    threads = MatrixThreadCount(threads);
+    if(threads > count) {
+        threads = count;
+    }
+    if(threads <= 1) {
+        if(count > 0) {
+            fn(arg, 0, count);
+        }
+        return;
+    }
+
+    for(int t = 0; t < threads; t++) {
+        chunks[t].fn = fn;
+        chunks[t].arg = arg;
+        chunks[t].begin = (int)((long long)count * t / threads);
+        chunks[t].end = (int)((long long)count * (t + 1) / threads);
+        started[t] = 0;
+    }
+    for(int t = 1; t < threads; t++) {
+        pthread_attr_t attr;
+        int placed_worker = 0;
+        pthread_attr_init(&attr);
+        if(WorkerCpus(t, threads, &set)) {
+            placed_worker = pthread_attr_setaffinity_np(&attr, sizeof(set),
+                    &set) == 0;
+        }
+        started[t] = pthread_create(&ids[t], &attr, RunChunk, &chunks[t]) == 0;
+        //pthread_create() fails if the CPUs are no longer allowed (e.g. the
+        //process mask shrank since the topology was read); the worker then
+        //runs unplaced rather than its chunk running on the caller
+        if(!started[t] && placed_worker) {
+            started[t] = pthread_create(&ids[t], NULL, RunChunk,
+                    &chunks[t]) == 0;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    //the calling thread runs chunk 0 as it is; its affinity is the caller's
+    RunChunk(&chunks[0]);
+    for(int t = 1; t < threads; t++) {
+        if(started[t]) {
+            pthread_join(ids[t], NULL);
+        } else {
+            RunChunk(&chunks[t]);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef MATRIX_THREADS_H
+#define MATRIX_THREADS_H
+
+/**
+ * @file    MatrixThreads.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements the fork-join helper shared by the multithreaded
+ * kernels.  A range of work items is cut into one contiguous chunk per
+ * thread; the calling thread runs the first chunk itself.
+ *
+ * On a NUMA machine the workers are spread over the nodes in order, each
+ * node taking a share proportional to its CPUs, so that consecutive chunks
+ * of a range run on the same node.  Memory a chunk first touches is placed
+ * on its node by the kernel, and MatrixAllocPlaced() (MatrixArena.h) uses
+ * that to put each chunk of a large batch next to the worker that will
+ * process it.  The topology is read from sysfs once; a machine with one
+ * node, or without that information, behaves exactly as without it.
+ */
+
+/**
+ * Worker placement, for MatrixThreadsSetAffinity() or the MML_AFFINITY
+ * environment variable ("none", "node" or "core"):
+ *  - MATRIX_AFFINITY_NONE: the scheduler places every worker
+ *  - MATRIX_AFFINITY_NODE: each worker is bound to the CPUs of its node
+ *    (the default; nothing is bound on a single-node machine)
+ *  - MATRIX_AFFINITY_CORE: each worker is pinned to one CPU of its node
+ * Only the threads MatrixParallelFor() starts are placed.  The calling
+ * thread's affinity is never changed, so the first chunk runs wherever the
+ * caller does.
+ */
+#define MATRIX_AFFINITY_NONE 0
+#define MATRIX_AFFINITY_NODE 1
+#define MATRIX_AFFINITY_CORE 2
+
+/**
+ * MATRIX_MAX_NODES is the number of NUMA nodes looked for.
+ */
+#define MATRIX_MAX_NODES 64
+
+/**
+ * The body of a parallel loop: processes items [begin, end) of the range.
+ */
+typedef void (*MatrixRangeFn)(void *arg, int begin, int end);
+
+/**
+ * MatrixThreadCount resolves a requested thread count.
+ *
+ * @param: threads, the requested count, or 0 for one per online CPU
+ *
+ * @return: the number of threads to use (at least 1)
+ */
+int MatrixThreadCount(int threads);
+
+/**
+ * MatrixParallelFor runs fn over [0, count) on up to `threads` threads and
+ * returns once every chunk is done.
+ *
+ * @param: count, the number of work items
+ * @param: threads, the thread count, or 0 for one per online CPU
+ * @param: fn, the loop body
+ * @param: arg, passed to every call of fn
+ *
+ * If a thread cannot be started its chunk runs on the calling thread, so
+ * the loop always completes.
+ */
+void MatrixParallelFor(int count, int threads, MatrixRangeFn fn, void *arg);
+
+/**
+ * MatrixNumaNodes counts the NUMA nodes with CPUs this process may use.
+ *
+ * @return: the number of nodes, 1 on a machine without NUMA information
+ */
+int MatrixNumaNodes(void);
+
+/**
+ * MatrixCurrentNode gives the node the calling thread is running on.
+ *
+ * @return: the node's number, 0 if it cannot be told
+ */
+int MatrixCurrentNode(void);
+
+/**
+ * MatrixThreadNode gives the node worker `w` of a MatrixParallelFor() on
+ * `threads` threads runs on.
+ *
+ * @param: w, the worker, from 0 for the first chunk
+ * @param: threads, the thread count, or 0 for one per online CPU
+ *
+ * @return: the node's number, or -1 if workers are not placed by node
+ *          (MATRIX_AFFINITY_NONE); for worker 0, which is the calling
+ *          thread, the node it would be given, not where it runs
+ */
+int MatrixThreadNode(int w, int threads);
+
+/**
+ * MatrixThreadsSetAffinity / MatrixThreadsGetAffinity choose where the
+ * workers of later MatrixParallelFor() calls run.
+ *
+ * @param: mode, MATRIX_AFFINITY_NONE, MATRIX_AFFINITY_NODE or
+ *         MATRIX_AFFINITY_CORE
+ */
+void MatrixThreadsSetAffinity(int mode);
+int MatrixThreadsGetAffinity(void);
+
+#endif // MATRIX_THREADS_H
@@ -0,0 +1,198 @@
+/**
+ * @file    MatrixTransform.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <string.h>
+#include "MatrixMath.h"
+#include "MatrixOrtho.h"
+#include "MatrixTransform.h"
+
+#define TDIM 4
+
+/**
+ * MatrixTransformFromParts builds a transform from a 3x3 linear part and a
+ * translation.
+ *
+ * @param: rot, a pointer to the 3x3 linear part
+ * @param: trans, the translation
+ * @param: result, a pointer to a 4x4 transform that is modified
+ */
+void MatrixTransformFromParts(float rot[3][3], float trans[3],
+        float result[4][4])
+{
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            result[i][j] = rot[i][j];
+        }
+        result[i][DIM] = trans[i];
+    }
+    result[3][0] = 0;
+    result[3][1] = 0;
+    result[3][2] = 0;
+    result[3][3] = 1;
+}
+
+/**
+ * MatrixTransformCompose calculates the transform that applies t2 and then
+ * t1, i.e. the product t1 t2.
+ *
+ * @param: t1, a pointer to the left 4x4 transform
+ * @param: t2, a pointer to the right 4x4 transform
+ * @param: result, a pointer to a 4x4 transform that is modified to contain
+ *         t1 t2 (must not be t1 or t2)
+ */
+void MatrixTransformCompose(float t1[4][4], float t2[4][4],
+        float result[4][4])
+{
+    //row i = t1[i][0] * t2 row 0 + ... + t1[i][3] * (0, 0, 0, 1); every line
+    //below is one 4-wide multiply-add over a whole row
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < TDIM; j++) {
+            result[i][j] = t1[i][0] * t2[0][j] + t1[i][1] * t2[1][j] +
+                    t1[i][2] * t2[2][j];
+        }
+        result[i][DIM] += t1[i][DIM];
+    }
+    result[3][0] = 0;
+    result[3][1] = 0;
+    result[3][2] = 0;
+    result[3][3] = 1;
+}
+
+/**
+ * MatrixTransformPoint applies a transform to a point.
+ *
+ * @param: t, a pointer to a 4x4 transform
+ * @param: p, the point
+ * @param: result, modified to contain t p (may be the same as p)
+ */
+void MatrixTransformPoint(float t[4][4], float p[3], float result[3])
+{
+    float x = p[0], y = p[1], z = p[2];
+
+    for(int i = 0; i < DIM; i++) {
+        result[i] = t[i][0] * x + t[i][1] * y + t[i][2] * z + t[i][3];
+    }
+}
+
+/**
+ * MatrixTransformPoints applies one transform to `count` points stored as
+ * three SoA planes (x of point b at p[b], y at p[count + b], z at
+ * p[2 * count + b]).
+ *
+ * @param: t, a pointer to a 4x4 transform
+ * @param: count, the number of points
+ * @param: p, 3 * count floats, the points
+ * @param: result, 3 * count floats that are modified (may be the same as p)
+ */
+void MatrixTransformPoints(float t[4][4], int count, const float *p,
+        float *result)
+{
+    const float *px = p, *py = p + count, *pz = p + 2 * (size_t)count;
+    float *rx = result, *ry = result + count, *rz = result + 2 * (size_t)count;
+    //hoisted so the compiler knows the transform cannot alias the points
+    float m[3][4];
+
+    memcpy(m, t, sizeof(m));
+    for(int b = 0; b < count; b++) {
+        float x = px[b], y = py[b], z = pz[b];
+        rx[b] = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+        ry[b] = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+        rz[b] = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+    }
+}
+
+//the inverse given the inverse of the linear part: (A^-1, -A^-1 t)
+static void FromLinearInverse(float t[4][4], float inv[3][3],
+        float result[4][4])
+{
+    float trans[3];
+
+    for(int i = 0; i < DIM; i++) {
+        trans[i] = -(inv[i][0] * t[0][3] + inv[i][1] * t[1][3] +
+                inv[i][2] * t[2][3]);
+    }
+    MatrixTransformFromParts(inv, trans, result);
+}
+
+/**
+ * MatrixTransformInverseRigid inverts a rigid transform as (R^T, -R^T t).
+ *
+ * @param: t, a pointer to a 4x4 transform whose linear part is a rotation
+ * @param: result, a pointer to a 4x4 transform that is modified to contain
+ *         the inverse (must not be t)
+ */
+void MatrixTransformInverseRigid(float t[4][4], float result[4][4])
+{
+    float rot_T[3][3];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            rot_T[i][j] = t[j][i];
+        }
+    }
+    FromLinearInverse(t, rot_T, result);
+}
+
+/**
+ * MatrixTransformInverse inverts any affine transform.  If the linear part
+ * is a rotation to within MATRIX_ORTHO_TOL it takes the rigid path,
+ * otherwise it inverts the linear part with MatrixInverse().
+ *
+ * @param: t, a pointer to a 4x4 transform
+ * @param: result, a pointer to a 4x4 transform that is modified to contain
+ *         the inverse (must not be t)
+ *
+ * @return: 1 on success, 0 if the linear part is singular (result is then
+ *          left untouched)
+ */
+int MatrixTransformInverse(float t[4][4], float result[4][4])
+{
+    float linear[3][3], inv[3][3];
+
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            linear[i][j] = t[i][j];
+        }
+    }
+    if(MatrixOrthoError(linear) <= MATRIX_ORTHO_TOL) {
+        MatrixTransformInverseRigid(t, result);
+        return 1;
+    }
+    if(MatrixDeterminant(linear) == 0) {
+        return 0;
+    }
+    MatrixInverse(linear, inv);
+    FromLinearInverse(t, inv, result);
+    return 1;
+}
+
+/**
+ * MatrixTransformHierarchy evaluates a whole transform hierarchy: the world
+ * transform of node i is world[parent[i]] local[i], or local[i] for a root.
+ *
+ * @param: count, the number of nodes
+ * @param: parent, the parent of each node, -1 for roots; every parent must
+ *         come before its children
+ * @param: locals, count local transforms
+ * @param: worlds, count transforms that are modified to hold the results
+ *
+ * @return: 1 on success, 0 if some parent does not precede its child (the
+ *          nodes before it are still evaluated)
+ */
+int MatrixTransformHierarchy(int count, const int *parent,
+        float locals[][4][4], float worlds[][4][4])
+{
+    //parents first means one forward sweep sees every parent already done
+    for(int i = 0; i < count; i++) {
+        if(parent[i] < 0) {
+            memcpy(worlds[i], locals[i], sizeof(worlds[i]));
+        } else if(parent[i] < i) {
+            MatrixTransformCompose(worlds[parent[i]], locals[i], worlds[i]);
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,110 @@
+#ifndef MATRIX_TRANSFORM_H
+#define MATRIX_TRANSFORM_H
+
+/**
+ * @file    MatrixTransform.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements 4x4 homogeneous transforms.  A transform is a
+ * row-major `float t[4][4]` like the 3x3 matrices of MatrixMath.h:
+ *
+ *   R00 R01 R02 tx
+ *   R10 R11 R12 ty
+ *   R20 R21 R22 tz
+ *    0   0   0   1
+ *
+ * The bottom row is assumed to be (0, 0, 0, 1), which lets composition skip
+ * a quarter of the work and inversion reduce to a 3x3 problem: a transpose
+ * for rigid transforms (R a rotation) or the MatrixInverse() cofactor path
+ * for general affine ones.  Compose works a whole row at a time (row i of
+ * the result is a weighted sum of the 4-float rows of the right factor),
+ * which the compiler maps onto 4-wide SIMD.
+ */
+
+/**
+ * MatrixTransformFromParts builds a transform from a 3x3 linear part and a
+ * translation.
+ *
+ * @param: rot, a pointer to the 3x3 linear part
+ * @param: trans, the translation
+ * @param: result, a pointer to a 4x4 transform that is modified
+ */
+void MatrixTransformFromParts(float rot[3][3], float trans[3],
+        float result[4][4]);
+
+/**
+ * MatrixTransformCompose calculates the transform that applies t2 and then
+ * t1, i.e. the product t1 t2.
+ *
+ * @param: t1, a pointer to the left 4x4 transform
+ * @param: t2, a pointer to the right 4x4 transform
+ * @param: result, a pointer to a 4x4 transform that is modified to contain
+ *         t1 t2 (must not be t1 or t2)
+ */
+void MatrixTransformCompose(float t1[4][4], float t2[4][4],
+        float result[4][4]);
+
+/**
+ * MatrixTransformPoint applies a transform to a point.
+ *
+ * @param: t, a pointer to a 4x4 transform
+ * @param: p, the point
+ * @param: result, modified to contain t p (may be the same as p)
+ */
+void MatrixTransformPoint(float t[4][4], float p[3], float result[3]);
+
+/**
+ * MatrixTransformPoints applies one transform to `count` points stored as
+ * three SoA planes (x of point b at p[b], y at p[count + b], z at
+ * p[2 * count + b]).
+ *
+ * @param: t, a pointer to a 4x4 transform
+ * @param: count, the number of points
+ * @param: p, 3 * count floats, the points
+ * @param: result, 3 * count floats that are modified (may be the same as p)
+ */
+void MatrixTransformPoints(float t[4][4], int count, const float *p,
+        float *result);
+
+/**
+ * MatrixTransformInverseRigid inverts a rigid transform as (R^T, -R^T t).
+ *
+ * @param: t, a pointer to a 4x4 transform whose linear part is a rotation
+ * @param: result, a pointer to a 4x4 transform that is modified to contain
+ *         the inverse (must not be t)
+ */
+void MatrixTransformInverseRigid(float t[4][4], float result[4][4]);
+
+/**
+ * MatrixTransformInverse inverts any affine transform.  If the linear part
+ * is a rotation to within MATRIX_ORTHO_TOL it takes the rigid path,
+ * otherwise it inverts the linear part with MatrixInverse().
+ *
+ * @param: t, a pointer to a 4x4 transform
+ * @param: result, a pointer to a 4x4 transform that is modified to contain
+ *         the inverse (must not be t)
+ *
+ * @return: 1 on success, 0 if the linear part is singular (result is then
+ *          left untouched)
+ */
+int MatrixTransformInverse(float t[4][4], float result[4][4]);
+
+/**
+ * MatrixTransformHierarchy evaluates a whole transform hierarchy: the world
+ * transform of node i is world[parent[i]] local[i], or local[i] for a root.
+ *
+ * @param: count, the number of nodes
+ * @param: parent, the parent of each node, -1 for roots; every parent must
+ *         come before its children
+ * @param: locals, count local transforms
+ * @param: worlds, count transforms that are modified to hold the results
+ *
+ * @return: 1 on success, 0 if some parent does not precede its child (the
+ *          nodes before it are still evaluated)
+ */
+int MatrixTransformHierarchy(int count, const int *parent,
+        float locals[][4][4], float worlds[][4][4]);
+
+#endif // MATRIX_TRANSFORM_H
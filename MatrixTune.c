@@ -0,0 +1,564 @@
+/**
+ * @file    MatrixTune.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "MatrixArena.h"
+#include "MatrixN.h"
+#include "MatrixStrassen.h"
+#include "MatrixTune.h"
+
+//problem sizes of the trials: big enough to leave L2, small enough that a
+//whole run of trials stays around a second
+#define TRANSPOSE_N 1024
+#define BLOCK_N 256
+#define CUTOFF_N 512
+
+#define MAX_LINE 256
+
+static const char *isa_names[] = {"scalar", "sse", "avx"};
+#define ISA_COUNT ((int)(sizeof(isa_names) / sizeof(isa_names[0])))
+
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int ready;
+static int source = MATRIX_TUNE_DEFAULT;
+//set while this thread settles the parameters, whose setters call back in
+static _Thread_local int initializing;
+
+/**
+ * MatrixTuneDefaults fills t with the built-in defaults.
+ *
+ * @param: t, modified to hold the defaults
+ */
+void MatrixTuneDefaults(struct MatrixTuning *t)
+{
+    t->strassen_cutoff = MATRIX_STRASSEN_CUTOFF;
+    t->strassen_block = MATRIX_STRASSEN_BLOCK;
+    t->transpose_leaf = MATRIX_TRANSPOSE_LEAF;
+    t->transpose_isa = MATRIX_ISA_SCALAR;
+    for(int isa = ISA_COUNT - 1; isa > MATRIX_ISA_SCALAR; isa--) {
+        if(MatrixNSupportsKernel(isa)) {
+            t->transpose_isa = isa;
+            break;
+        }
+    }
+}
+
+static int Valid(const struct MatrixTuning *t)
+{
+    return t->strassen_cutoff >= MATRIX_STRASSEN_MIN_CUTOFF &&
+            t->strassen_block >= 1 && t->transpose_leaf >= 8 &&
+            MatrixNSupportsKernel(t->transpose_isa);
+}
+
+/**
+ * MatrixTuneGet / MatrixTuneApply read and set every parameter at once.
+ * Changing them must not race with the kernels that use them.
+ *
+ * @param: t, the parameters
+ *
+ * @return (Apply): 1 on success, 0 if a value is invalid or the CPU cannot
+ *          run the kernel (nothing changes)
+ */
+void MatrixTuneGet(struct MatrixTuning *t)
+{
+    t->strassen_cutoff = MatrixStrassenGetCutoff();
+    t->strassen_block = MatrixStrassenGetBlock();
+    t->transpose_leaf = MatrixNGetTransposeLeaf();
+    t->transpose_isa = MatrixNGetTransposeKernel();
+}
+
+int MatrixTuneApply(const struct MatrixTuning *t)
+{
+    if(!Valid(t)) {
+        return 0;
+    }
+    MatrixStrassenSetCutoff(t->strassen_cutoff);
+    MatrixStrassenSetBlock(t->strassen_block);
+    MatrixNSetTransposeLeaf(t->transpose_leaf);
+    MatrixNSetTransposeKernel(t->transpose_isa);
+    return 1;
+}
+
+/**
+ * MatrixTuneIsaName gives the name of a MATRIX_ISA_* value, as profiles and
+ * MML_TRANSPOSE_ISA spell it.
+ *
+ * @param: isa, a MATRIX_ISA_* value
+ *
+ * @return: "scalar", "sse" or "avx", or NULL if isa is none of them
+ */
+const char *MatrixTuneIsaName(int isa)
+{
+    return isa >= 0 && isa < ISA_COUNT ? isa_names[isa] : NULL;
+}
+
+static int IsaFromName(const char *name)
+{
+    for(int isa = 0; isa < ISA_COUNT; isa++) {
+        if(strcmp(name, isa_names[isa]) == 0) {
+            return isa;
+        }
+    }
+    return -1;
+}
+
+//a whole positive number, or 0
+static int PositiveInt(const char *text)
+{
+    char *end;
+    long value;
+
+    if(text == NULL) {
+        return 0;
+    }
+    errno = 0;
+    value = strtol(text, &end, 10);
+    if(errno != 0 || end == text || *end != '\0' || value < 1 ||
+            value > 1 << 20) {
+        return 0;
+    }
+    return (int)value;
+}
+
+/**
+ * MatrixTuneFromEnv overrides the fields of t whose MML_* variable holds a
+ * valid value.
+ *
+ * @param: t, the parameters, modified
+ */
+void MatrixTuneFromEnv(struct MatrixTuning *t)
+{
+    int value;
+    const char *isa = getenv("MML_TRANSPOSE_ISA");
+
+    if((value = PositiveInt(getenv("MML_STRASSEN_CUTOFF"))) >=
+            MATRIX_STRASSEN_MIN_CUTOFF) {
+        t->strassen_cutoff = value;
+    }
+    if((value = PositiveInt(getenv("MML_STRASSEN_BLOCK"))) > 0) {
+        t->strassen_block = value;
+    }
+    if((value = PositiveInt(getenv("MML_TRANSPOSE_LEAF"))) >= 8) {
+        t->transpose_leaf = value;
+    }
+    if(isa != NULL && IsaFromName(isa) >= 0 &&
+            MatrixNSupportsKernel(IsaFromName(isa))) {
+        t->transpose_isa = IsaFromName(isa);
+    }
+}
+
+/*******************************************************************************
+ * Trials
+ ******************************************************************************/
+
+struct TrialArgs {
+    int n;
+    float *a, *b, *c;
+};
+
+static void TransposeTrial(struct TrialArgs *t)
+{
+    MatrixNTranspose(t->n, t->n, t->a, t->c);
+}
+
+static void MultiplyTrial(struct TrialArgs *t)
+{
+    MatrixStrassenMultiply(t->n, t->a, t->b, t->c, 1);
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//the best of at least two runs, the first of them untimed, that fit in
+//`seconds`
+static double Trial(void (*fn)(struct TrialArgs *), struct TrialArgs *arg,
+        double seconds)
+{
+    double start = Now(), best = INFINITY;
+
+    fn(arg);
+    do {
+        double t0 = Now();
+        fn(arg);
+        t0 = Now() - t0;
+        best = t0 < best ? t0 : best;
+    } while(Now() - start < seconds);
+    return best;
+}
+
+static void SetIsa(int isa)
+{
+    MatrixNSetTransposeKernel(isa);
+}
+
+//times every candidate value of one parameter (those the setter rejects
+//are skipped), leaves the fastest set and returns it
+static int Tune(FILE *log, const char *name, void (*set)(int),
+        const int *candidates, int count, void (*fn)(struct TrialArgs *),
+        struct TrialArgs *arg, double seconds)
+{
+    double times[8], best_time = INFINITY;
+    int best = candidates[0];
+
+    for(int i = 0; i < count; i++) {
+        times[i] = INFINITY;
+        if(set == SetIsa && !MatrixNSupportsKernel(candidates[i])) {
+            continue;
+        }
+        set(candidates[i]);
+        times[i] = Trial(fn, arg, seconds);
+        if(times[i] < best_time) {
+            best_time = times[i];
+            best = candidates[i];
+        }
+    }
+    for(int i = 0; log != NULL && i < count; i++) {
+        if(isinf(times[i])) {
+            continue;
+        }
+        if(set == SetIsa) {
+            fprintf(log, "  %-16s %-8s", name, isa_names[candidates[i]]);
+        } else {
+            fprintf(log, "  %-16s %-8d", name, candidates[i]);
+        }
+        fprintf(log, " %10.3f ms%s\n", times[i] * 1e3,
+                candidates[i] == best ? "  <" : "");
+    }
+    set(best);
+    return best;
+}
+
+/**
+ * MatrixTuneRun times candidate values of each parameter on this machine,
+ * one parameter after the other, and applies the winners.
+ *
+ * @param: seconds, the approximate time to spend, e.g. MATRIX_TUNE_SECONDS
+ * @param: log, a stream to report every trial on, or NULL
+ * @param: result, modified to hold the winners, or NULL
+ *
+ * @return: 1 on success, 0 if memory ran out (nothing changes)
+ */
+int MatrixTuneRun(double seconds, FILE *log, struct MatrixTuning *result)
+{
+    static const int isas[] = {MATRIX_ISA_SCALAR, MATRIX_ISA_SSE,
+            MATRIX_ISA_AVX};
+    static const int leaves[] = {16, 32, 64, 128};
+    static const int blocks[] = {16, 32, 64, 128, 256};
+    static const int cutoffs[] = {32, 64, 128, 256, CUTOFF_N};
+    int n_leaves = sizeof(leaves) / sizeof(leaves[0]);
+    int n_blocks = sizeof(blocks) / sizeof(blocks[0]);
+    int n_cutoffs = sizeof(cutoffs) / sizeof(cutoffs[0]);
+    size_t nn = (size_t)TRANSPOSE_N * TRANSPOSE_N;
+    struct MatrixTuning saved, best;
+    struct TrialArgs args;
+    double slice;
+
+    args.a = MatrixAlloc(nn * sizeof(float));
+    args.b = MatrixAlloc(nn * sizeof(float));
+    args.c = MatrixAlloc(nn * sizeof(float));
+    if(args.a == NULL || args.b == NULL || args.c == NULL) {
+        MatrixFree(args.a);
+        MatrixFree(args.b);
+        MatrixFree(args.c);
+        return 0;
+    }
+    for(size_t i = 0; i < nn; i++) {
+        args.a[i] = (float)((i * 7919) % 1000) / 1000 - 0.5f;
+        args.b[i] = (float)((i * 104729) % 1000) / 1000 - 0.5f;
+    }
+    MatrixTuneGet(&saved);
+    slice = seconds / (ISA_COUNT + n_leaves + n_blocks + n_cutoffs);
+
+    //transposes: the instruction set at the current leaf, then the leaf
+    args.n = TRANSPOSE_N;
+    best.transpose_isa = Tune(log, "transpose_isa", SetIsa, isas, ISA_COUNT,
+            TransposeTrial, &args, slice);
+    best.transpose_leaf = Tune(log, "transpose_leaf", MatrixNSetTransposeLeaf,
+            leaves, n_leaves, TransposeTrial, &args, slice);
+
+    //products: the conventional kernel's block with Strassen out of the way,
+    //then the cutoff with that block
+    args.n = BLOCK_N;
+    MatrixStrassenSetCutoff(BLOCK_N);
+    best.strassen_block = Tune(log, "strassen_block", MatrixStrassenSetBlock,
+            blocks, n_blocks, MultiplyTrial, &args, slice);
+    args.n = CUTOFF_N;
+    best.strassen_cutoff = Tune(log, "strassen_cutoff",
+            MatrixStrassenSetCutoff, cutoffs, n_cutoffs, MultiplyTrial, &args,
+            slice);
+
+    MatrixFree(args.a);
+    MatrixFree(args.b);
+    MatrixFree(args.c);
+    if(!MatrixTuneApply(&best)) {
+        MatrixTuneApply(&saved);
+    }
+    if(result != NULL) {
+        MatrixTuneGet(result);
+    }
+    return 1;
+}
+
+/*******************************************************************************
+ * Profiles
+ ******************************************************************************/
+
+/**
+ * MatrixTuneCpuModel gives the name of the CPU model, as profiles are keyed.
+ *
+ * @param: model, modified to hold the name
+ * @param: size, the size of model
+ */
+void MatrixTuneCpuModel(char *model, size_t size)
+{
+    //most ARM kernels only give the part number
+    static const char *keys[] = {"model name", "Hardware", "CPU part"};
+    char line[MAX_LINE];
+    FILE *f;
+
+#if defined(__x86_64__) || defined(__i386__)
+    //the brand string straight from the CPU, far quicker than /proc
+    unsigned int brand[12];
+    if(__get_cpuid(0x80000004, &brand[8], &brand[9], &brand[10], &brand[11])) {
+        for(unsigned int leaf = 0; leaf < 3; leaf++) {
+            __get_cpuid(0x80000002 + leaf, &brand[4 * leaf],
+                    &brand[4 * leaf + 1], &brand[4 * leaf + 2],
+                    &brand[4 * leaf + 3]);
+        }
+        memcpy(line, brand, sizeof(brand));
+        line[sizeof(brand)] = '\0';
+        snprintf(model, size, "%s", line + strspn(line, " "));
+        return;
+    }
+#endif
+    snprintf(model, size, "unknown");
+    f = fopen("/proc/cpuinfo", "r");
+    if(f == NULL) {
+        return;
+    }
+    while(fgets(line, sizeof(line), f) != NULL) {
+        char *colon = strchr(line, ':');
+        if(colon == NULL) {
+            continue;
+        }
+        for(size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+            if(strncmp(line, keys[k], strlen(keys[k])) == 0) {
+                char *value = colon + 1 + strspn(colon + 1, " \t");
+                value[strcspn(value, "\n")] = '\0';
+                snprintf(model, size, "%s", value);
+                fclose(f);
+                return;
+            }
+        }
+    }
+    fclose(f);
+}
+
+/**
+ * MatrixTuneProfilePath gives the path of this CPU model's profile.
+ *
+ * @param: path, modified to hold the path
+ * @param: size, the size of path
+ *
+ * @return: 1 on success, 0 if there is no home or cache directory or the
+ *          path does not fit
+ */
+int MatrixTuneProfilePath(char *path, size_t size)
+{
+    const char *custom = getenv("MML_TUNE_PROFILE");
+    const char *cache = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    char model[MAX_LINE], name[MAX_LINE];
+    size_t len = 0;
+    int written;
+
+    if(custom != NULL && custom[0] != '\0') {
+        written = snprintf(path, size, "%s", custom);
+        return written > 0 && (size_t)written < size;
+    }
+
+    //"Intel(R) Xeon(R) CPU @ 2.20GHz" -> "Intel_R_Xeon_R_CPU_2_20GHz"
+    MatrixTuneCpuModel(model, sizeof(model));
+    for(const char *c = model; *c != '\0'; c++) {
+        int alnum = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                (*c >= '0' && *c <= '9') || *c == '-';
+        if(alnum) {
+            name[len++] = *c;
+        } else if(len > 0 && name[len - 1] != '_') {
+            name[len++] = '_';
+        }
+    }
+    while(len > 0 && name[len - 1] == '_') {
+        len--;
+    }
+    name[len] = '\0';
+
+    if(cache != NULL && cache[0] == '/') {
+        written = snprintf(path, size, "%s/mml/%s.tune", cache, name);
+    } else if(home != NULL && home[0] == '/') {
+        written = snprintf(path, size, "%s/.cache/mml/%s.tune", home, name);
+    } else {
+        return 0;
+    }
+    return written > 0 && (size_t)written < size;
+}
+
+/**
+ * MatrixTuneLoad / MatrixTuneSave read and write a profile.  A profile only
+ * loads on the CPU model it was saved on.
+ *
+ * @param: path, the profile file
+ * @param: t, the parameters (only modified by Load on success)
+ *
+ * @return: 1 on success, 0 if the file could not be read or written, is for
+ *          another CPU model or holds invalid values
+ */
+int MatrixTuneLoad(const char *path, struct MatrixTuning *t)
+{
+    FILE *f = fopen(path, "r");
+    struct MatrixTuning loaded = *t;
+    char line[MAX_LINE], model[MAX_LINE];
+    int model_matches = 0;
+
+    if(f == NULL) {
+        return 0;
+    }
+    MatrixTuneCpuModel(model, sizeof(model));
+    //one "key value" pair per line; unknown keys are skipped
+    while(fgets(line, sizeof(line), f) != NULL) {
+        char *value = line + strcspn(line, " ");
+        line[strcspn(line, "\n")] = '\0';
+        if(line[0] == '#' || *value == '\0') {
+            continue;
+        }
+        *value++ = '\0';
+        if(strcmp(line, "cpu") == 0) {
+            model_matches = strcmp(value, model) == 0;
+        } else if(strcmp(line, "strassen_cutoff") == 0) {
+            loaded.strassen_cutoff = PositiveInt(value);
+        } else if(strcmp(line, "strassen_block") == 0) {
+            loaded.strassen_block = PositiveInt(value);
+        } else if(strcmp(line, "transpose_leaf") == 0) {
+            loaded.transpose_leaf = PositiveInt(value);
+        } else if(strcmp(line, "transpose_isa") == 0) {
+            loaded.transpose_isa = IsaFromName(value);
+        }
+    }
+    fclose(f);
+    if(!model_matches || !Valid(&loaded)) {
+        return 0;
+    }
+    *t = loaded;
+    return 1;
+}
+
+//creates every missing directory above the file at path
+static void MakeParents(const char *path)
+{
+    char dir[MAX_LINE * 2];
+
+    if(snprintf(dir, sizeof(dir), "%s", path) >= (int)sizeof(dir)) {
+        return;
+    }
+    for(char *slash = strchr(dir + 1, '/'); slash != NULL;
+            slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+        *slash = '/';
+    }
+}
+
+int MatrixTuneSave(const char *path, const struct MatrixTuning *t)
+{
+    char model[MAX_LINE], temp[MAX_LINE * 2];
+    FILE *f;
+    int ok;
+
+    if(!Valid(t) || snprintf(temp, sizeof(temp), "%s.%ld", path,
+            (long)getpid()) >= (int)sizeof(temp)) {
+        return 0;
+    }
+    MakeParents(path);
+    f = fopen(temp, "w");
+    if(f == NULL) {
+        return 0;
+    }
+    MatrixTuneCpuModel(model, sizeof(model));
+    fprintf(f, "# written by MatrixTuneSave(); values override the defaults\n");
+    fprintf(f, "cpu %s\n", model);
+    fprintf(f, "strassen_cutoff %d\n", t->strassen_cutoff);
+    fprintf(f, "strassen_block %d\n", t->strassen_block);
+    fprintf(f, "transpose_leaf %d\n", t->transpose_leaf);
+    fprintf(f, "transpose_isa %s\n", isa_names[t->transpose_isa]);
+    ok = fclose(f) == 0;
+    //readers see the old profile or the new one, never half of one
+    if(!ok || rename(temp, path) != 0) {
+        remove(temp);
+        return 0;
+    }
+    return 1;
+}
+
+/*******************************************************************************
+ * Startup
+ ******************************************************************************/
+
+/**
+ * MatrixTuneInit settles the parameters as described above.  Only the first
+ * call does anything; the tuned kernels make it themselves.
+ *
+ * @return: MATRIX_TUNE_DEFAULT, MATRIX_TUNE_PROFILE or MATRIX_TUNE_TRIALS
+ */
+int MatrixTuneInit(void)
+{
+    if(atomic_load_explicit(&ready, memory_order_acquire) || initializing) {
+        return source;
+    }
+    pthread_mutex_lock(&init_lock);
+    if(!atomic_load_explicit(&ready, memory_order_relaxed)) {
+        const char *mode = getenv("MML_TUNE");
+        int force = mode != NULL && strcmp(mode, "force") == 0;
+        int tune = force || (mode != NULL && strcmp(mode, "auto") == 0);
+        struct MatrixTuning t;
+        char path[MAX_LINE * 2];
+        int have_path = MatrixTuneProfilePath(path, sizeof(path));
+
+        initializing = 1;
+        MatrixTuneDefaults(&t);
+        if(mode == NULL || strcmp(mode, "off") != 0) {
+            if(!force && have_path && MatrixTuneLoad(path, &t)) {
+                source = MATRIX_TUNE_PROFILE;
+            } else if(tune) {
+                MatrixTuneApply(&t);
+                if(MatrixTuneRun(MATRIX_TUNE_SECONDS, NULL, &t)) {
+                    source = MATRIX_TUNE_TRIALS;
+                    if(have_path) {
+                        MatrixTuneSave(path, &t);
+                    }
+                }
+            }
+        }
+        MatrixTuneFromEnv(&t);
+        MatrixTuneApply(&t);
+        initializing = 0;
+        atomic_store_explicit(&ready, 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&init_lock);
+    return source;
+}
@@ -0,0 +1,150 @@
+#ifndef MATRIX_TUNE_H
+#define MATRIX_TUNE_H
+
+/**
+ * @file    MatrixTune.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements the autotuner for the parameters whose best values
+ * depend on the CPU: the Strassen cutoff and conventional-kernel block, and
+ * the transpose leaf size and instruction set.
+ *
+ * The first call into a tuned kernel runs MatrixTuneInit(), which settles
+ * the parameters once per process:
+ *
+ *  1. the built-in defaults, with the widest transpose kernel the CPU runs;
+ *  2. replaced by the profile saved for this CPU model, if there is one
+ *     (one small file read, a few microseconds); or, with MML_TUNE=auto and
+ *     no profile, by short timed trials whose winners are then saved;
+ *  3. with each MML_* variable below that is set overriding its parameter.
+ *
+ * The mml_tune tool runs the trials and saves the profile explicitly.
+ *
+ * Environment:
+ *  - MML_TUNE: unset to load a profile only, "auto" to also tune when there
+ *    is none, "force" to tune (and save) even if there is one, "off" to
+ *    ignore profiles
+ *  - MML_TUNE_PROFILE: the profile file to use instead of
+ *    $XDG_CACHE_HOME/mml/<cpu model>.tune (or ~/.cache/mml/<cpu model>.tune)
+ *  - MML_STRASSEN_CUTOFF, MML_STRASSEN_BLOCK, MML_TRANSPOSE_LEAF: numbers
+ *  - MML_TRANSPOSE_ISA: "scalar", "sse" or "avx"
+ * Invalid or unsupported values are ignored.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * MATRIX_TUNE_SECONDS is the default time budget of MatrixTuneRun().
+ */
+#define MATRIX_TUNE_SECONDS 1.0
+
+/**
+ * Where the parameters came from, as returned by MatrixTuneInit().
+ */
+#define MATRIX_TUNE_DEFAULT 0
+#define MATRIX_TUNE_PROFILE 1
+#define MATRIX_TUNE_TRIALS 2
+
+/**
+ * The tuned parameters.
+ */
+struct MatrixTuning {
+    int strassen_cutoff;    //MatrixStrassenSetCutoff()
+    int strassen_block;     //MatrixStrassenSetBlock()
+    int transpose_leaf;     //MatrixNSetTransposeLeaf()
+    int transpose_isa;      //MatrixNSetTransposeKernel(), a MATRIX_ISA_*
+};
+
+/**
+ * MatrixTuneInit settles the parameters as described above.  Only the first
+ * call does anything; the tuned kernels make it themselves.
+ *
+ * @return: MATRIX_TUNE_DEFAULT, MATRIX_TUNE_PROFILE or MATRIX_TUNE_TRIALS
+ */
+int MatrixTuneInit(void);
+
+/**
+ * MatrixTuneDefaults fills t with the built-in defaults.
+ *
+ * @param: t, modified to hold the defaults
+ */
+void MatrixTuneDefaults(struct MatrixTuning *t);
+
+/**
+ * MatrixTuneIsaName gives the name of a MATRIX_ISA_* value, as profiles and
+ * MML_TRANSPOSE_ISA spell it.
+ *
+ * @param: isa, a MATRIX_ISA_* value
+ *
+ * @return: "scalar", "sse" or "avx", or NULL if isa is none of them
+ */
+const char *MatrixTuneIsaName(int isa);
+
+/**
+ * MatrixTuneGet / MatrixTuneApply read and set every parameter at once.
+ * Changing them must not race with the kernels that use them.
+ *
+ * @param: t, the parameters
+ *
+ * @return (Apply): 1 on success, 0 if a value is invalid or the CPU cannot
+ *          run the kernel (nothing changes)
+ */
+void MatrixTuneGet(struct MatrixTuning *t);
+int MatrixTuneApply(const struct MatrixTuning *t);
+
+/**
+ * MatrixTuneFromEnv overrides the fields of t whose MML_* variable holds a
+ * valid value.
+ *
+ * @param: t, the parameters, modified
+ */
+void MatrixTuneFromEnv(struct MatrixTuning *t);
+
+/**
+ * MatrixTuneRun times candidate values of each parameter on this machine,
+ * one parameter after the other, and applies the winners.
+ *
+ * @param: seconds, the approximate time to spend, e.g. MATRIX_TUNE_SECONDS
+ * @param: log, a stream to report every trial on, or NULL
+ * @param: result, modified to hold the winners, or NULL
+ *
+ * @return: 1 on success, 0 if memory ran out (nothing changes)
+ */
+int MatrixTuneRun(double seconds, FILE *log, struct MatrixTuning *result);
+
+/**
+ * MatrixTuneCpuModel gives the name of the CPU model, as profiles are keyed.
+ *
+ * @param: model, modified to hold the name
+ * @param: size, the size of model
+ */
+void MatrixTuneCpuModel(char *model, size_t size);
+
+/**
+ * MatrixTuneProfilePath gives the path of this CPU model's profile.
+ *
+ * @param: path, modified to hold the path
+ * @param: size, the size of path
+ *
+ * @return: 1 on success, 0 if there is no home or cache directory or the
+ *          path does not fit
+ */
+int MatrixTuneProfilePath(char *path, size_t size);
+
+/**
+ * MatrixTuneLoad / MatrixTuneSave read and write a profile.  A profile only
+ * loads on the CPU model it was saved on.
+ *
+ * @param: path, the profile file
+ * @param: t, the parameters (only modified by Load on success)
+ *
+ * @return: 1 on success, 0 if the file could not be read or written, is for
+ *          another CPU model or holds invalid values
+ */
+int MatrixTuneLoad(const char *path, struct MatrixTuning *t);
+int MatrixTuneSave(const char *path, const struct MatrixTuning *t);
+
+#endif // MATRIX_TUNE_H
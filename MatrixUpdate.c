@@ -0,0 +1,233 @@
+/**
+ * @file    MatrixUpdate.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include "MatrixMath.h"
+#include "MatrixN.h"
+#include "MatrixArena.h"
+#include "MatrixUpdate.h"
+
+static atomic_ullong num_updates, num_fallbacks, num_singular;
+
+//1-norm (max column sum) of a k x k matrix
+static float Norm1(int k, const float *mat)
+{
+    float best = 0;
+    for(int j = 0; j < k; j++) {
+        float sum = 0;
+        for(int i = 0; i < k; i++) {
+            sum += fabsf(mat[i * k + j]);
+        }
+        if(sum > best) {
+            best = sum;
+        }
+    }
+    return best;
+}
+
+/**
+ * MatrixInverseUpdate calculates the inverse of mat + u v^T from the inverse
+ * of mat and "returns" it by modifying the last argument.
+ *
+ * @param: mat, a pointer to the 3x3 matrix before the update (only read on
+ *         fallback)
+ * @param: inv, a pointer to the 3x3 inverse of mat, e.g. from MatrixInverse()
+ * @param: u, the column vector of the update
+ * @param: v, the row vector of the update
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         inverse of mat + u v^T
+ *
+ * @return: 1 on success, 0 if mat + u v^T is singular, in which case result
+ *          is left untouched
+ *
+ * No argument other than result is modified.  result may be the same as inv.
+ */
+int MatrixInverseUpdate(float mat[3][3], float inv[3][3], float u[3],
+        float v[3], float result[3][3])
+{
+    float w[3], z[3], denom = 1, scale = 1, updated[3][3];
+
+    //w = inv u, z^T = v^T inv
+    for(int i = 0; i < DIM; i++) {
+        w[i] = 0;
+        z[i] = 0;
+        for(int j = 0; j < DIM; j++) {
+            w[i] += inv[i][j] * u[j];
+            z[i] += v[j] * inv[j][i];
+        }
+    }
+    for(int i = 0; i < DIM; i++) {
+        denom += v[i] * w[i];
+        scale += fabsf(v[i] * w[i]);
+    }
+
+    //C = denom has cancelled if it is small next to the terms that formed it
+    if(fabsf(denom) > MATRIX_UPDATE_TOL * scale) {
+        float inv_denom = 1 / denom;
+        for(int i = 0; i < DIM; i++) {
+            for(int j = 0; j < DIM; j++) {
+                result[i][j] = inv[i][j] - w[i] * z[j] * inv_denom;
+            }
+        }
+        atomic_fetch_add(&num_updates, 1);
+        return 1;
+    }
+
+    atomic_fetch_add(&num_fallbacks, 1);
+    for(int i = 0; i < DIM; i++) {
+        for(int j = 0; j < DIM; j++) {
+            updated[i][j] = mat[i][j] + u[i] * v[j];
+        }
+    }
+    if(MatrixDeterminant(updated) == 0) {
+        atomic_fetch_add(&num_singular, 1);
+        return 0;
+    }
+    MatrixInverse(updated, result);
+    return 1;
+}
+
+//full re-inversion of mat + U V^T
+static int Fallback(int n, int k, const float *mat, const float *U,
+        const float *V, float *result)
+{
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *updated = MatrixArenaAlloc((size_t)n * n * sizeof(float));
+    int ok;
+
+    atomic_fetch_add(&num_fallbacks, 1);
+    if(updated == NULL) {
+        return 0;
+    }
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < n; j++) {
+            float sum = mat[(size_t)i * n + j];
+            for(int p = 0; p < k; p++) {
+                sum += U[(size_t)i * k + p] * V[(size_t)j * k + p];
+            }
+            updated[(size_t)i * n + j] = sum;
+        }
+    }
+    ok = MatrixNInverse(n, updated, result);
+    if(!ok) {
+        atomic_fetch_add(&num_singular, 1);
+    }
+    MatrixArenaRelease(pos);
+    return ok;
+}
+
+/**
+ * MatrixNInverseUpdate calculates the inverse of mat + U V^T from the inverse
+ * of mat and "returns" it by modifying the last argument.
+ *
+ * @param: n, the dimension of mat
+ * @param: k, the rank of the update
+ * @param: mat, pointer to the n x n matrix before the update (only read on
+ *         fallback)
+ * @param: inv, pointer to the n x n inverse of mat
+ * @param: U, pointer to an n x k matrix
+ * @param: V, pointer to an n x k matrix
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         inverse of mat + U V^T
+ *
+ * @return: 1 on success, 0 if mat + U V^T is singular (or memory ran out),
+ *          in which case result is left untouched
+ *
+ * No argument other than result is modified.  result may be the same as inv.
+ */
+int MatrixNInverseUpdate(int n, int k, const float *mat, const float *inv,
+        const float *U, const float *V, float *result)
+{
+    size_t nk = (size_t)n * k;
+    MatrixArenaPos pos = MatrixArenaMark();
+    float *W, *Z, *C, *C_inv, *T;
+    float cond;
+
+    W = MatrixArenaAlloc((2 * nk + 2 * (size_t)k * k + nk) * sizeof(float));
+    if(W == NULL) {
+        return 0;
+    }
+    Z = W + nk;
+    C = Z + nk;
+    C_inv = C + (size_t)k * k;
+    T = C_inv + (size_t)k * k;
+
+    //W = inv U (n x k) and Z = V^T inv (k x n)
+    MatrixNMultiply(n, n, k, inv, U, W);
+    for(int p = 0; p < k; p++) {
+        float *zrow = Z + (size_t)p * n;
+        for(int j = 0; j < n; j++) {
+            zrow[j] = 0;
+        }
+        for(int i = 0; i < n; i++) {
+            float vip = V[(size_t)i * k + p];
+            const float *irow = inv + (size_t)i * n;
+            for(int j = 0; j < n; j++) {
+                zrow[j] += vip * irow[j];
+            }
+        }
+    }
+
+    //C = I + V^T W
+    for(int p = 0; p < k; p++) {
+        for(int q = 0; q < k; q++) {
+            float sum = (p == q) ? 1 : 0;
+            for(int i = 0; i < n; i++) {
+                sum += V[(size_t)i * k + p] * W[(size_t)i * k + q];
+            }
+            C[p * k + q] = sum;
+        }
+    }
+
+    if(!MatrixNInverse(k, C, C_inv)) {
+        MatrixArenaRelease(pos);
+        return Fallback(n, k, mat, U, V, result);
+    }
+    cond = Norm1(k, C) * Norm1(k, C_inv);
+    if(!(cond * MATRIX_UPDATE_TOL < 1)) {
+        MatrixArenaRelease(pos);
+        return Fallback(n, k, mat, U, V, result);
+    }
+
+    //result = inv - W (C^-1 Z)
+    MatrixNMultiply(k, k, n, C_inv, Z, T);
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < n; j++) {
+            float sum = 0;
+            for(int p = 0; p < k; p++) {
+                sum += W[(size_t)i * k + p] * T[(size_t)p * n + j];
+            }
+            result[(size_t)i * n + j] = inv[(size_t)i * n + j] - sum;
+        }
+    }
+    MatrixArenaRelease(pos);
+    atomic_fetch_add(&num_updates, 1);
+    return 1;
+}
+
+/**
+ * MatrixUpdateGetStats copies the counters into stats.
+ *
+ * @param: stats, pointer to the struct to fill
+ */
+void MatrixUpdateGetStats(struct MatrixUpdateStats *stats)
+{
+    stats->updates = atomic_load(&num_updates);
+    stats->fallbacks = atomic_load(&num_fallbacks);
+    stats->singular = atomic_load(&num_singular);
+}
+
+/**
+ * MatrixUpdateResetStats sets every counter back to zero.
+ */
+void MatrixUpdateResetStats(void)
+{
+    atomic_store(&num_updates, 0);
+    atomic_store(&num_fallbacks, 0);
+    atomic_store(&num_singular, 0);
+}
@@ -0,0 +1,98 @@
+#ifndef MATRIX_UPDATE_H
+#define MATRIX_UPDATE_H
+
+/**
+ * @file    MatrixUpdate.h
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * @section DESCRIPTION
+ *
+ * This file implements incremental inverse updates.  When a matrix A whose
+ * inverse is already known changes by a low-rank term, the new inverse is
+ * obtained from the old one in O(n^2) work instead of a full re-inversion:
+ *
+ *   rank 1 (Sherman-Morrison):  (A + u v^T)^-1 = A^-1 - (A^-1 u)(v^T A^-1)
+ *                                                       / (1 + v^T A^-1 u)
+ *   rank k (Woodbury):          (A + U V^T)^-1 = A^-1 - A^-1 U C^-1 V^T A^-1
+ *                                   with C = I + V^T A^-1 U  (k x k)
+ *
+ * If the update brings the matrix close to singular (C near zero or badly
+ * conditioned), the formula would amplify rounding error, so the functions
+ * fall back to inverting A + U V^T from scratch.  MatrixUpdateGetStats() counts how
+ * often that happens.
+ */
+
+/**
+ * The update is abandoned for a full inversion when C is too close to
+ * singular.  For the 3x3 rank-1 update C is the scalar 1 + v^T w (w =
+ * A^-1 u), and the test is for cancellation: it must keep
+ * |1 + v^T w| > MATRIX_UPDATE_TOL * (1 + sum |v_i w_i|).  For the rank-k
+ * update the 1-norm condition number of C must stay below
+ * 1 / MATRIX_UPDATE_TOL.
+ */
+#define MATRIX_UPDATE_TOL 1e-4
+
+/**
+ * Counters since the program started (or the last reset).
+ */
+struct MatrixUpdateStats {
+    unsigned long long updates;   //solved by the low-rank formula
+    unsigned long long fallbacks; //re-inverted from scratch
+    unsigned long long singular;  //fallbacks that found A + U V^T singular
+};
+
+/**
+ * MatrixInverseUpdate calculates the inverse of mat + u v^T from the inverse
+ * of mat and "returns" it by modifying the last argument.
+ *
+ * @param: mat, a pointer to the 3x3 matrix before the update (only read on
+ *         fallback)
+ * @param: inv, a pointer to the 3x3 inverse of mat, e.g. from MatrixInverse()
+ * @param: u, the column vector of the update
+ * @param: v, the row vector of the update
+ * @param: result, a pointer to a 3x3 matrix that is modified to contain the
+ *         inverse of mat + u v^T
+ *
+ * @return: 1 on success, 0 if mat + u v^T is singular, in which case result
+ *          is left untouched
+ *
+ * No argument other than result is modified.  result may be the same as inv.
+ */
+int MatrixInverseUpdate(float mat[3][3], float inv[3][3], float u[3],
+        float v[3], float result[3][3]);
+
+/**
+ * MatrixNInverseUpdate calculates the inverse of mat + U V^T from the inverse
+ * of mat and "returns" it by modifying the last argument.
+ *
+ * @param: n, the dimension of mat
+ * @param: k, the rank of the update
+ * @param: mat, pointer to the n x n matrix before the update (only read on
+ *         fallback)
+ * @param: inv, pointer to the n x n inverse of mat
+ * @param: U, pointer to an n x k matrix
+ * @param: V, pointer to an n x k matrix
+ * @param: result, pointer to an n x n matrix that is modified to contain the
+ *         inverse of mat + U V^T
+ *
+ * @return: 1 on success, 0 if mat + U V^T is singular (or memory ran out),
+ *          in which case result is left untouched
+ *
+ * No argument other than result is modified.  result may be the same as inv.
+ */
+int MatrixNInverseUpdate(int n, int k, const float *mat, const float *inv,
+        const float *U, const float *V, float *result);
+
+/**
+ * MatrixUpdateGetStats copies the counters into stats.
+ *
+ * @param: stats, pointer to the struct to fill
+ */
+void MatrixUpdateGetStats(struct MatrixUpdateStats *stats);
+
+/**
+ * MatrixUpdateResetStats sets every counter back to zero.
+ */
+void MatrixUpdateResetStats(void);
+
+#endif // MATRIX_UPDATE_H
@@ -0,0 +1,945 @@
+/**
+ * @file    mml_bench.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * Benchmarks for the library's kernels.  Each benchmark compares a new
+ * kernel with the plain algorithm it replaces and reports speed next to
+ * accuracy, so every speedup comes with its cost.
+ *
+ * Usage: mml_bench [-c] <benchmark> [options]
+ *        mml_bench                  (lists the benchmarks)
+ *
+ * -c (or MML_BENCH_COUNTERS=1) adds the hardware counters of MatrixBench.h
+ * to every measurement, per call and per item.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <unistd.h>
+#include "MatrixBench.h"
+#include "MatrixN.h"
+#include "MatrixStrassen.h"
+#include "MatrixMath.h"
+#include "MatrixBatch.h"
+#include "MatrixReduce.h"
+#include "MatrixRefine.h"
+#include "MatrixSolve.h"
+#include "MatrixArena.h"
+#include "MatrixThreads.h"
+#include "MatrixPipeline.h"
+
+#define MIN_SECONDS 0.5
+
+static float *RandomMatrix(size_t count)
+{
+    float *m = malloc(count * sizeof(float));
+
+    if(m != NULL) {
+        for(size_t i = 0; i < count; i++) {
+            m[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        }
+    }
+    return m;
+}
+
+static float MaxAbs(size_t count, const float *m)
+{
+    float max = 0;
+
+    for(size_t i = 0; i < count; i++) {
+        if(fabsf(m[i]) > max) {
+            max = fabsf(m[i]);
+        }
+    }
+    return max;
+}
+
+/*******************************************************************************
+ * strassen: Strassen-Winograd against the classic triple loop
+ ******************************************************************************/
+
+struct ProductArgs {
+    int n, threads;
+    const float *a, *b;
+    float *c, *scratch;
+};
+
+static void BenchClassic(void *arg)
+{
+    struct ProductArgs *p = arg;
+    MatrixNMultiply(p->n, p->n, p->n, p->a, p->b, p->c);
+}
+
+static void BenchStrassen(void *arg)
+{
+    struct ProductArgs *p = arg;
+    MatrixStrassenExecute(p->n, p->a, p->b, p->c, p->scratch, p->threads);
+}
+
+//max |c - a b| with a b formed in double
+static double MaxError(int n, const float *a, const float *b, const float *c)
+{
+    double *row = malloc(n * sizeof(double)), max = 0;
+
+    if(row == NULL) {
+        return -1;
+    }
+    for(int i = 0; i < n; i++) {
+        memset(row, 0, n * sizeof(double));
+        for(int p = 0; p < n; p++) {
+            double s = a[(size_t)i * n + p];
+            const float *b_row = b + (size_t)p * n;
+            for(int j = 0; j < n; j++) {
+                row[j] += s * b_row[j];
+            }
+        }
+        for(int j = 0; j < n; j++) {
+            double e = fabs(row[j] - c[(size_t)i * n + j]);
+            max = e > max ? e : max;
+        }
+    }
+    free(row);
+    return max;
+}
+
+static int RunStrassen(int argc, char *argv[])
+{
+    static const int default_sizes[] = {512, 1024, 2048};
+    int threads = 0, opt;
+
+    while((opt = getopt(argc, argv, "t:c:")) != -1) {
+        switch(opt) {
+        case 't': threads = atoi(optarg); break;
+        case 'c': MatrixStrassenSetCutoff(atoi(optarg)); break;
+        default:
+            fprintf(stderr, "usage: mml_bench strassen [-t threads] "
+                    "[-c cutoff] [n ...]\n");
+            return 1;
+        }
+    }
+    int count = argc - optind;
+    if(count == 0) {
+        count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    }
+
+    printf("cutoff %d, errors in units of u max|A| max|B| (u = %g); the\n"
+            "bounds are n^2 for the classic loop and Higham's\n"
+            "[(n/n0)^log2(18) (n0^2 + 6 n0) - 6n] for Strassen-Winograd\n\n",
+            MatrixStrassenGetCutoff(), FLT_EPSILON / 2);
+    for(int s = 0; s < count; s++) {
+        int n = optind < argc ? atoi(argv[optind + s]) : default_sizes[s];
+        size_t nn = (size_t)n * n;
+        struct ProductArgs p = {n, threads, NULL, NULL, NULL, NULL};
+        float *a = RandomMatrix(nn), *b = RandomMatrix(nn);
+        float *classic = malloc(nn * sizeof(float));
+        float *fast = malloc(nn * sizeof(float));
+
+        p.scratch = malloc(MatrixStrassenScratchSize(n, threads) *
+                sizeof(float) + 1);
+        if(n < 1 || !a || !b || !classic || !fast || !p.scratch) {
+            fprintf(stderr, "mml_bench: bad size or out of memory (n = %d)\n",
+                    n);
+            free(a); free(b); free(classic); free(fast); free(p.scratch);
+            return 1;
+        }
+        p.a = a;
+        p.b = b;
+
+        struct MatrixBenchResult r_classic, r_fast;
+        char name_classic[32], name_fast[32];
+        snprintf(name_classic, sizeof(name_classic), "classic n=%d", n);
+        snprintf(name_fast, sizeof(name_fast), "strassen n=%d", n);
+        p.c = classic;
+        MatrixBenchRun(name_classic, BenchClassic, &p, 1, MIN_SECONDS,
+                &r_classic);
+        p.c = fast;
+        MatrixBenchRun(name_fast, BenchStrassen, &p, 1, MIN_SECONDS, &r_fast);
+
+        //leaf size of the recursion, for the bound
+        double n0 = n, u = FLT_EPSILON / 2;
+        while(n0 > MatrixStrassenGetCutoff()) {
+            n0 = floor(n0 / 2);
+        }
+        double scale = u * MaxAbs(nn, a) * MaxAbs(nn, b);
+        double e_classic = MaxError(n, a, b, classic) / scale;
+        double e_fast = MaxError(n, a, b, fast) / scale;
+        double bound = pow(n / n0, log2(18)) * (n0 * n0 + 6 * n0) - 6.0 * n;
+
+        MatrixBenchHeader();
+        MatrixBenchPrint(&r_classic);
+        MatrixBenchPrint(&r_fast);
+        printf("  speedup %.2fx, %.2f GFLOP/s\n",
+                r_classic.ns_per_call / r_fast.ns_per_call,
+                2.0 * n * nn / r_fast.ns_per_call);
+        printf("  error classic %.1f (bound %.3g), strassen %.1f "
+                "(bound %.3g), ratio %.2f\n\n", e_classic, (double)nn,
+                e_fast, bound, e_fast / e_classic);
+
+        free(a); free(b); free(classic); free(fast); free(p.scratch);
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * transpose: recursive and in-place transposes against the naive loop
+ ******************************************************************************/
+
+struct TransposeArgs {
+    int rows, cols;
+    const float *src;
+    float *dst;
+};
+
+static void BenchNaiveTranspose(void *arg)
+{
+    struct TransposeArgs *t = arg;
+
+    //the MatrixTranspose() loop scaled up: result[i][j] = mat[j][i]
+    for(int i = 0; i < t->cols; i++) {
+        for(int j = 0; j < t->rows; j++) {
+            t->dst[(size_t)i * t->rows + j] = t->src[(size_t)j * t->cols + i];
+        }
+    }
+}
+
+static void BenchTranspose(void *arg)
+{
+    struct TransposeArgs *t = arg;
+    MatrixNTranspose(t->rows, t->cols, t->src, t->dst);
+}
+
+static void BenchTransposeInPlace(void *arg)
+{
+    struct TransposeArgs *t = arg;
+    int rows = t->rows;
+
+    //each call leaves the transpose behind, so the next one undoes it
+    MatrixNTransposeInPlace(rows, t->cols, t->dst);
+    t->rows = t->cols;
+    t->cols = rows;
+}
+
+static int RunTranspose(int argc, char *argv[])
+{
+    static const int default_sizes[] = {1024, 2048, 4096, 8192, 16384};
+    int count = argc - 1;
+
+    if(count == 0) {
+        count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    }
+    printf("GB/s counts one read and one write per element\n\n");
+    for(int s = 0; s < count; s++) {
+        int n = argc > 1 ? atoi(argv[1 + s]) : default_sizes[s];
+        size_t nn = (size_t)n * n;
+        float *src = RandomMatrix(nn), *dst = malloc(nn * sizeof(float));
+
+        if(n < 2 || src == NULL || dst == NULL) {
+            fprintf(stderr, "mml_bench: bad size or out of memory (n = %d)\n",
+                    n);
+            free(src);
+            free(dst);
+            return 1;
+        }
+
+        struct {
+            const char *label;
+            MatrixBenchFn fn;
+            int rows, cols;
+        } cases[] = {
+            {"naive", BenchNaiveTranspose, n, n},
+            {"recursive", BenchTranspose, n, n},
+            {"in-place", BenchTransposeInPlace, n, n},
+            {"naive", BenchNaiveTranspose, n, n / 2},
+            {"recursive", BenchTranspose, n, n / 2},
+            {"in-place cycles", BenchTransposeInPlace, n, n / 2},
+        };
+        MatrixBenchHeader();
+        for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            struct TransposeArgs t = {cases[c].rows, cases[c].cols, src, dst};
+            struct MatrixBenchResult r;
+            char name[48];
+            long items = (long)cases[c].rows * cases[c].cols;
+
+            memcpy(dst, src, nn * sizeof(float));
+            snprintf(name, sizeof(name), "%s %dx%d", cases[c].label,
+                    cases[c].rows, cases[c].cols);
+            MatrixBenchRun(name, cases[c].fn, &t, items, MIN_SECONDS, &r);
+            MatrixBenchPrint(&r);
+            printf("%-32s %.2f GB/s\n", "", 2 * sizeof(float) / r.ns_per_item);
+        }
+        printf("\n");
+        free(src);
+        free(dst);
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * reduce: batched comparisons and totals against per-matrix calls
+ ******************************************************************************/
+
+struct ReduceArgs {
+    int count, threads;
+    float (*aos1)[3][3], (*aos2)[3][3];
+    const float *soa1, *soa2;
+    float *values;
+    unsigned long long *mask;
+    int equal;
+    struct MatrixBatchTotals totals;
+};
+
+static void BenchEqualsLoop(void *arg)
+{
+    struct ReduceArgs *r = arg;
+
+    r->equal = 0;
+    for(int b = 0; b < r->count; b++) {
+        r->equal += MatrixEquals(r->aos1[b], r->aos2[b]);
+    }
+}
+
+static void BenchEqualsBatch(void *arg)
+{
+    struct ReduceArgs *r = arg;
+    r->equal = MatrixEqualsBatch(r->count, r->soa1, r->soa2, MATRIX_CMP_ABS,
+            FP_DELTA, r->mask, r->threads);
+}
+
+static void BenchTraceLoop(void *arg)
+{
+    struct ReduceArgs *r = arg;
+
+    for(int b = 0; b < r->count; b++) {
+        r->values[b] = MatrixTrace(r->aos1[b]);
+    }
+}
+
+static void BenchTraceBatch(void *arg)
+{
+    struct ReduceArgs *r = arg;
+    MatrixTraceBatch(r->count, r->soa1, r->values);
+}
+
+static void BenchReduceFast(void *arg)
+{
+    struct ReduceArgs *r = arg;
+    MatrixReduceBatch(r->count, r->soa1, r->threads, 0, &r->totals);
+}
+
+static void BenchReduceDeterministic(void *arg)
+{
+    struct ReduceArgs *r = arg;
+    MatrixReduceBatch(r->count, r->soa1, r->threads, 1, &r->totals);
+}
+
+static int RunReduce(int argc, char *argv[])
+{
+    struct ReduceArgs r;
+    int count = argc > 1 ? atoi(argv[1]) : 1 << 20;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    size_t floats = (size_t)count * 9;
+    float *soa1 = RandomMatrix(floats), *soa2 = RandomMatrix(floats);
+    float (*aos1)[3][3] = malloc(count * sizeof(*aos1));
+    float (*aos2)[3][3] = malloc(count * sizeof(*aos2));
+    float *values = malloc(count * sizeof(float));
+    unsigned long long *mask = malloc((count + 63) / 64 * sizeof(*mask));
+
+    if(count < 1 || !soa1 || !soa2 || !aos1 || !aos2 || !values || !mask) {
+        fprintf(stderr, "mml_bench: bad count or out of memory\n");
+        free(soa1); free(soa2); free(aos1); free(aos2); free(values);
+        free(mask);
+        return 1;
+    }
+    //half of the pairs equal, so neither side can exit early every time
+    for(size_t i = 0; i < floats; i++) {
+        if(i % count % 2 == 0) {
+            soa2[i] = soa1[i];
+        }
+    }
+    MatrixBatchFromSoA(count, soa1, aos1);
+    MatrixBatchFromSoA(count, soa2, aos2);
+
+    struct {
+        const char *name;
+        MatrixBenchFn fn;
+    } cases[] = {
+        {"MatrixEquals loop", BenchEqualsLoop},
+        {"MatrixEqualsBatch", BenchEqualsBatch},
+        {"MatrixTrace loop", BenchTraceLoop},
+        {"MatrixTraceBatch", BenchTraceBatch},
+        {"MatrixReduceBatch", BenchReduceFast},
+        {"MatrixReduceBatch determ.", BenchReduceDeterministic},
+    };
+    r = (struct ReduceArgs){count, threads, aos1, aos2, soa1, soa2, values,
+            mask};
+    printf("%d matrices, ns/item is per matrix\n\n", count);
+    MatrixBenchHeader();
+    for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        struct MatrixBenchResult result;
+        MatrixBenchRun(cases[c].name, cases[c].fn, &r, count, MIN_SECONDS,
+                &result);
+        MatrixBenchPrint(&result);
+        if(c % 2 == 1) {
+            printf("\n");
+        }
+    }
+    printf("totals: trace %.6f, sum %.6f, frobenius %.6f, max %.6f\n",
+            r.totals.trace, r.totals.sum, r.totals.frobenius,
+            r.totals.max_abs);
+
+    free(soa1); free(soa2); free(aos1); free(aos2); free(values); free(mask);
+    return 0;
+}
+
+/*******************************************************************************
+ * refine: mixed-precision refined solve against a pure double solve
+ ******************************************************************************/
+
+struct SolveArgs {
+    int n;
+    const double *mat, *b;
+    double *x;
+    struct MatrixRefineInfo info;
+};
+
+static void BenchSolveDouble(void *arg)
+{
+    struct SolveArgs *s = arg;
+    MatrixNSolveDouble(s->n, s->mat, s->b, s->x);
+}
+
+static void BenchSolveRefined(void *arg)
+{
+    struct SolveArgs *s = arg;
+    MatrixNSolveRefined(s->n, s->mat, s->b, s->x, 0, &s->info);
+}
+
+//||b - A x|| / (||A|| ||x|| + ||b||) in inf-norms, as MatrixRefine reports it
+static double BackwardError(int n, const double *mat, const double *b,
+        const double *x)
+{
+    double norm_r = 0, norm_a = 0, norm_x = 0, norm_b = 0;
+
+    for(int i = 0; i < n; i++) {
+        double r = b[i], row_sum = 0;
+        for(int j = 0; j < n; j++) {
+            r -= mat[(size_t)i * n + j] * x[j];
+            row_sum += fabs(mat[(size_t)i * n + j]);
+        }
+        norm_r = fmax(norm_r, fabs(r));
+        norm_a = fmax(norm_a, row_sum);
+        norm_x = fmax(norm_x, fabs(x[i]));
+        norm_b = fmax(norm_b, fabs(b[i]));
+    }
+    return norm_r / (norm_a * norm_x + norm_b);
+}
+
+static int RunRefine(int argc, char *argv[])
+{
+    static const int default_sizes[] = {128, 256, 512, 1024};
+    int count = argc - 1;
+
+    if(count == 0) {
+        count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    }
+    for(int s = 0; s < count; s++) {
+        int n = argc > 1 ? atoi(argv[1 + s]) : default_sizes[s];
+        size_t nn = (size_t)n * n;
+        double *mat = malloc(nn * sizeof(double));
+        double *b = malloc(n * sizeof(double));
+        double *x_double = malloc(n * sizeof(double));
+        double *x_refined = malloc(n * sizeof(double));
+
+        if(n < 1 || !mat || !b || !x_double || !x_refined) {
+            fprintf(stderr, "mml_bench: bad size or out of memory (n = %d)\n",
+                    n);
+            free(mat); free(b); free(x_double); free(x_refined);
+            return 1;
+        }
+        //random entries: cond(A) grows roughly like n, well inside float range
+        for(size_t i = 0; i < nn; i++) {
+            mat[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        for(int i = 0; i < n; i++) {
+            b[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+
+        struct SolveArgs d = {n, mat, b, x_double}, r = {n, mat, b, x_refined};
+        struct MatrixBenchResult r_double, r_refined;
+        MatrixBenchRun("double LU", BenchSolveDouble, &d, 1, MIN_SECONDS,
+                &r_double);
+        MatrixBenchRun("float LU + refinement", BenchSolveRefined, &r, 1,
+                MIN_SECONDS, &r_refined);
+
+        double diff = 0, size = 0;
+        for(int i = 0; i < n; i++) {
+            diff = fmax(diff, fabs(x_double[i] - x_refined[i]));
+            size = fmax(size, fabs(x_double[i]));
+        }
+        printf("n = %d\n", n);
+        MatrixBenchHeader();
+        MatrixBenchPrint(&r_double);
+        MatrixBenchPrint(&r_refined);
+        printf("  speedup %.2fx, %d refinement steps%s\n",
+                r_double.ns_per_call / r_refined.ns_per_call,
+                r.info.iterations, r.info.fallback ? " (fell back)" : "");
+        printf("  backward error double %.2e, refined %.2e; solutions differ "
+                "by %.2e relative\n\n", BackwardError(n, mat, b, x_double),
+                r.info.residual, diff / size);
+
+        free(mat); free(b); free(x_double); free(x_refined);
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * solve3: direct 3x3 solves against MatrixInverse() and a multiply
+ ******************************************************************************/
+
+struct Solve3Args {
+    int count, nrhs, threads;
+    float (*aos)[3][3];
+    float (*b)[3], (*x)[3];
+    float *soa, *b_soa, *x_soa;
+};
+
+static void BenchInverseMultiply(void *arg)
+{
+    struct Solve3Args *s = arg;
+
+    for(int k = 0; k < s->count; k++) {
+        //MatrixInverse() leaves a singular matrix's result untouched
+        float inv[3][3] = {{0}};
+        MatrixInverse(s->aos[k], inv);
+        for(int r = 0; r < s->nrhs; r++) {
+            const float *b = s->b[(size_t)k * s->nrhs + r];
+            float *x = s->x[(size_t)k * s->nrhs + r];
+            for(int i = 0; i < DIM; i++) {
+                x[i] = inv[i][0] * b[0] + inv[i][1] * b[1] + inv[i][2] * b[2];
+            }
+        }
+    }
+}
+
+static void BenchSolve3(void *arg)
+{
+    struct Solve3Args *s = arg;
+
+    for(int k = 0; k < s->count; k++) {
+        MatrixSolve3Multi(s->aos[k], s->nrhs, s->b + (size_t)k * s->nrhs,
+                s->x + (size_t)k * s->nrhs);
+    }
+}
+
+static void BenchSolve3Batch(void *arg)
+{
+    struct Solve3Args *s = arg;
+    MatrixSolve3Batch(s->count, s->soa, s->nrhs, s->b_soa, s->x_soa, NULL,
+            s->threads);
+}
+
+static int RunSolve3(int argc, char *argv[])
+{
+    struct Solve3Args s;
+    int count = argc > 1 ? atoi(argv[1]) : 1 << 18;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    size_t vectors = (size_t)count * 4;
+    float *soa = RandomMatrix((size_t)count * 9);
+    float *b = RandomMatrix(vectors * 3), *b_soa = RandomMatrix(vectors * 3);
+    float *x = malloc(vectors * 3 * sizeof(float));
+    float *x_soa = malloc(vectors * 3 * sizeof(float));
+    float (*aos)[3][3] = malloc(count * sizeof(*aos));
+    struct {
+        const char *name;
+        MatrixBenchFn fn;
+    } cases[] = {
+        {"MatrixInverse + multiply", BenchInverseMultiply},
+        {"MatrixSolve3", BenchSolve3},
+        {"MatrixSolve3Batch", BenchSolve3Batch},
+    };
+
+    if(count < 1 || !soa || !b || !b_soa || !x || !x_soa || !aos) {
+        fprintf(stderr, "mml_bench: bad count or out of memory\n");
+        free(soa); free(b); free(b_soa); free(x); free(x_soa); free(aos);
+        return 1;
+    }
+    MatrixBatchFromSoA(count, soa, aos);
+    s = (struct Solve3Args){count, 1, threads, aos, (float (*)[3])b,
+            (float (*)[3])x, soa, b_soa, x_soa};
+    printf("%d systems, ns/item is per system\n", count);
+    for(s.nrhs = 1; s.nrhs <= 4; s.nrhs *= 4) {
+        printf("\n%d right-hand side%s per system\n", s.nrhs,
+                s.nrhs > 1 ? "s" : "");
+        MatrixBenchHeader();
+        for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            struct MatrixBenchResult result;
+            MatrixBenchRun(cases[c].name, cases[c].fn, &s, count, MIN_SECONDS,
+                    &result);
+            MatrixBenchPrint(&result);
+        }
+    }
+    printf("\naccuracy against a double reference: mml_test diff\n");
+
+    free(soa); free(b); free(b_soa); free(x); free(x_soa); free(aos);
+    return 0;
+}
+
+/*******************************************************************************
+ * numa: streaming batch kernels with and without NUMA-aware placement
+ ******************************************************************************/
+
+struct NumaArgs {
+    int count, threads;
+    float *soa, *b, *x;
+    struct MatrixBatchTotals totals;
+};
+
+static void BenchNumaReduce(void *arg)
+{
+    struct NumaArgs *n = arg;
+    MatrixReduceBatch(n->count, n->soa, n->threads, 0, &n->totals);
+}
+
+static void BenchNumaSolve3(void *arg)
+{
+    struct NumaArgs *n = arg;
+    MatrixSolve3Batch(n->count, n->soa, 1, n->b, n->x, NULL, n->threads);
+}
+
+//one batch of `planes` planes, either zeroed by the calling thread alone
+//(every page on its node) or by MatrixAllocPlaced()
+static float *NumaBatch(int count, int planes, int placed, int threads)
+{
+    size_t floats = (size_t)count * planes;
+    float *p;
+
+    if(placed) {
+        p = MatrixAllocPlaced(count, planes, sizeof(float), threads);
+    } else {
+        p = MatrixAlloc(floats * sizeof(float));
+        if(p != NULL) {
+            memset(p, 0, floats * sizeof(float));
+        }
+    }
+    //the pages are placed by now; filling them does not move them
+    for(size_t i = 0; p != NULL && i < floats; i++) {
+        p[i] = (float)rand() / RAND_MAX * 2 - 1;
+    }
+    return p;
+}
+
+static int RunNuma(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1 << 21;
+    int threads = MatrixThreadCount(argc > 2 ? atoi(argv[2]) : 0);
+    int nodes = MatrixNumaNodes();
+    struct {
+        const char *name;
+        int placed, affinity;
+    } configs[] = {
+        {"caller first touch, unbound", 0, MATRIX_AFFINITY_NONE},
+        {"placed, workers bound to node", 1, MATRIX_AFFINITY_NODE},
+        {"placed, workers pinned to core", 1, MATRIX_AFFINITY_CORE},
+    };
+    struct {
+        const char *name;
+        MatrixBenchFn fn;
+        double bytes;       //moved per matrix
+    } kernels[] = {
+        {"MatrixReduceBatch", BenchNumaReduce, 9 * sizeof(float)},
+        {"MatrixSolve3Batch", BenchNumaSolve3, 15 * sizeof(float)},
+    };
+    int saved = MatrixThreadsGetAffinity();
+
+    if(count < 1) {
+        fprintf(stderr, "mml_bench: bad count\n");
+        return 1;
+    }
+    printf("%d matrices on %d thread%s, %d NUMA node%s\n", count, threads,
+            threads > 1 ? "s" : "", nodes, nodes > 1 ? "s" : "");
+    if(nodes == 1) {
+        printf("note: with one node every page is local, so the "
+                "configurations differ\nonly by where the workers run\n");
+    }
+    for(size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        struct NumaArgs n = {count, threads};
+
+        MatrixThreadsSetAffinity(configs[c].affinity);
+        n.soa = NumaBatch(count, 9, configs[c].placed, threads);
+        n.b = NumaBatch(count, 3, configs[c].placed, threads);
+        n.x = NumaBatch(count, 3, configs[c].placed, threads);
+        if(!n.soa || !n.b || !n.x) {
+            fprintf(stderr, "mml_bench: out of memory\n");
+            MatrixFree(n.soa); MatrixFree(n.b); MatrixFree(n.x);
+            MatrixThreadsSetAffinity(saved);
+            return 1;
+        }
+        printf("\n%s", configs[c].name);
+        if(nodes > 1) {
+            printf(" (first matrix on node %d, last on node %d)",
+                    MatrixNodeOfAddress(n.soa),
+                    MatrixNodeOfAddress(n.soa + count - 1));
+        }
+        printf("\n");
+        MatrixBenchHeader();
+        for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            struct MatrixBenchResult result;
+            MatrixBenchRun(kernels[k].name, kernels[k].fn, &n, count,
+                    MIN_SECONDS, &result);
+            MatrixBenchPrint(&result);
+            printf("  %.2f GB/s\n", kernels[k].bytes / result.ns_per_item);
+        }
+        MatrixFree(n.soa); MatrixFree(n.b); MatrixFree(n.x);
+    }
+    MatrixThreadsSetAffinity(saved);
+    return 0;
+}
+
+/*******************************************************************************
+ * pipeline: chunked streaming against one pass over memory per operation
+ ******************************************************************************/
+
+struct PipelineArgs {
+    int count, mode;
+    float (*in)[3][3], (*work)[3][3], (*out)[3][3];
+    float transform[3][3];
+    long long kept;
+    MatrixPipeline *p;
+};
+
+//inverse, times the transform, keep 0.01 <= |det| <= 100: each a full pass
+static void BenchPasses(void *arg)
+{
+    struct PipelineArgs *a = arg;
+    int count = 0, kept = 0;
+
+    memcpy(a->work, a->in, a->count * sizeof(*a->work));
+    for(int k = 0; k < a->count; k++) {
+        if(MatrixDeterminant(a->work[k]) != 0) {
+            MatrixInverse(a->work[k], a->work[count++]);
+        }
+    }
+    for(int k = 0; k < count; k++) {
+        float result[3][3];
+        MatrixMultiply(a->work[k], a->transform, result);
+        memcpy(a->work[k], result, sizeof(result));
+    }
+    for(int k = 0; k < count; k++) {
+        float det = fabsf(MatrixDeterminant(a->work[k]));
+        if(det >= 0.01f && det <= 100) {
+            memcpy(a->out[kept++], a->work[k], sizeof(a->work[k]));
+        }
+    }
+    a->kept = kept;
+}
+
+static void BenchPipeline(void *arg)
+{
+    struct PipelineArgs *a = arg;
+    a->kept = MatrixPipelineRun(a->p, a->mode);
+}
+
+static int RunPipeline(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1 << 21;
+    int chunk = argc > 2 ? atoi(argv[2]) : 0;
+    float *in = RandomMatrix((size_t)count * 9);
+    struct PipelineArgs a = {count, 0, (float (*)[3][3])in,
+            malloc(count * sizeof(*a.work)), malloc(count * sizeof(*a.out)),
+            {{0, -1, 0}, {1, 0, 0}, {0, 0, 2}}};
+    struct {
+        const char *name;
+        MatrixBenchFn fn;
+        int mode;
+    } cases[] = {
+        {"a pass per operation", BenchPasses, 0},
+        {"pipeline, fused", BenchPipeline, MATRIX_PIPELINE_FUSED},
+        {"pipeline, thread per stage", BenchPipeline,
+                MATRIX_PIPELINE_CONCURRENT},
+    };
+
+    a.p = MatrixPipelineCreate(chunk);
+    if(count < 1 || !in || !a.work || !a.out || !a.p) {
+        fprintf(stderr, "mml_bench: bad count or out of memory\n");
+        free(in); free(a.work); free(a.out); MatrixPipelineDestroy(a.p);
+        return 1;
+    }
+    MatrixPipelineSetInput(a.p, a.in, count);
+    MatrixPipelineAddInverse(a.p);
+    MatrixPipelineAddMultiply(a.p, a.transform, MATRIX_PIPELINE_RIGHT);
+    MatrixPipelineAddDeterminantFilter(a.p, 0.01f, 100);
+    MatrixPipelineSetOutput(a.p, a.out, count);
+
+    printf("%d matrices, chunks of %d (%zu KiB), ns/item is per input "
+            "matrix\n\n", count, MatrixPipelineChunk(a.p),
+            MatrixPipelineChunk(a.p) * sizeof(float[3][3]) / 1024);
+    MatrixBenchHeader();
+    for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        struct MatrixBenchResult result;
+        a.mode = cases[c].mode;
+        MatrixBenchRun(cases[c].name, cases[c].fn, &a, count, MIN_SECONDS,
+                &result);
+        MatrixBenchPrint(&result);
+    }
+    printf("%lld of %d matrices kept\n", a.kept, count);
+
+    //stage by stage, for the last run of each mode
+    for(int mode = MATRIX_PIPELINE_FUSED; mode <= MATRIX_PIPELINE_CONCURRENT;
+            mode++) {
+        MatrixPipelineRun(a.p, mode);
+        printf("\n%-28s %10s %12s %10s %10s %12s\n", mode ==
+                MATRIX_PIPELINE_FUSED ? "stage (fused)" : "stage (concurrent)",
+                "chunks", "matrices in", "busy s", "wait s", "Mmatrices/s");
+        for(int s = 0; s < MatrixPipelineStages(a.p); s++) {
+            struct MatrixStageStats st;
+            MatrixPipelineGetStats(a.p, s, &st);
+            printf("%-28s %10lld %12lld %10.4f %10.4f %12.2f\n", st.name,
+                    st.chunks, st.items_in, st.busy, st.wait,
+                    st.items_per_second * 1e-6);
+        }
+    }
+
+    free(in); free(a.work); free(a.out); MatrixPipelineDestroy(a.p);
+    return 0;
+}
+
+/*******************************************************************************
+ * basic: the 3x3 MatrixMath.h functions, one matrix at a time
+ ******************************************************************************/
+
+#define BASIC_COUNT 4096
+
+struct BasicArgs {
+    float (*a)[3][3], (*b)[3][3], (*c)[3][3];
+    float sink;
+};
+
+static void BenchMultiply(void *arg)
+{
+    struct BasicArgs *m = arg;
+
+    for(int i = 0; i < BASIC_COUNT; i++) {
+        MatrixMultiply(m->a[i], m->b[i], m->c[i]);
+    }
+}
+
+static void BenchInverse(void *arg)
+{
+    struct BasicArgs *m = arg;
+
+    for(int i = 0; i < BASIC_COUNT; i++) {
+        MatrixInverse(m->a[i], m->c[i]);
+    }
+}
+
+static void BenchDeterminant(void *arg)
+{
+    struct BasicArgs *m = arg;
+
+    for(int i = 0; i < BASIC_COUNT; i++) {
+        m->sink += MatrixDeterminant(m->a[i]);
+    }
+}
+
+static void BenchTranspose3(void *arg)
+{
+    struct BasicArgs *m = arg;
+
+    for(int i = 0; i < BASIC_COUNT; i++) {
+        MatrixTranspose(m->a[i], m->c[i]);
+    }
+}
+
+static int RunBasic(int argc, char *argv[])
+{
+    struct BasicArgs m;
+    float *a = RandomMatrix(9 * BASIC_COUNT), *b = RandomMatrix(9 * BASIC_COUNT);
+    float *c = malloc(9 * BASIC_COUNT * sizeof(float));
+    struct {
+        const char *name;
+        MatrixBenchFn fn;
+    } cases[] = {
+        {"MatrixMultiply", BenchMultiply},
+        {"MatrixInverse", BenchInverse},
+        {"MatrixDeterminant", BenchDeterminant},
+        {"MatrixTranspose", BenchTranspose3},
+    };
+
+    (void)argc;
+    (void)argv;
+    if(a == NULL || b == NULL || c == NULL) {
+        fprintf(stderr, "mml_bench: out of memory\n");
+        free(a); free(b); free(c);
+        return 1;
+    }
+    m.a = (float (*)[3][3])a;
+    m.b = (float (*)[3][3])b;
+    m.c = (float (*)[3][3])c;
+    m.sink = 0;
+    printf("%d matrices per call, ns/item is per matrix\n\n", BASIC_COUNT);
+    MatrixBenchHeader();
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        struct MatrixBenchResult r;
+        MatrixBenchRun(cases[i].name, cases[i].fn, &m, BASIC_COUNT,
+                MIN_SECONDS, &r);
+        MatrixBenchPrint(&r);
+    }
+    free(a); free(b); free(c);
+    return 0;
+}
+
+/*******************************************************************************
+ * Driver
+ ******************************************************************************/
+
+static const struct {
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+    const char *help;
+} benchmarks[] = {
+    {"basic", RunBasic, "3x3 MatrixMath.h functions, per matrix"},
+    {"strassen", RunStrassen, "Strassen-Winograd vs classic NxN multiply"},
+    {"transpose", RunTranspose, "recursive and in-place vs naive transpose"},
+    {"reduce", RunReduce, "batched comparisons and totals vs per-matrix calls"},
+    {"refine", RunRefine, "float LU with double refinement vs double LU"},
+    {"solve3", RunSolve3, "direct 3x3 solves vs MatrixInverse and multiply"},
+    {"numa", RunNuma, "batch bandwidth with and without NUMA placement"},
+    {"pipeline", RunPipeline, "chunked pipeline vs a pass per operation"},
+};
+
+int main(int argc, char *argv[])
+{
+    int count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    const char *env = getenv("MML_BENCH_COUNTERS");
+    int counters = env != NULL && strcmp(env, "0") != 0;
+
+    if(argc > 1 && strcmp(argv[1], "-c") == 0) {
+        counters = 1;
+        argc--;
+        argv++;
+    }
+    if(counters) {
+        int available = MatrixBenchUseCounters(1);
+        if(available != (1 << MATRIX_BENCH_COUNTERS) - 1) {
+            printf("note: %s hardware counters are unavailable here and show "
+                    "as n/a\n\n", available == 0 ? "all" : "some");
+        }
+    }
+    if(argc > 1) {
+        for(int i = 0; i < count; i++) {
+            if(strcmp(argv[1], benchmarks[i].name) == 0) {
+                return benchmarks[i].run(argc - 1, argv + 1);
+            }
+        }
+    }
+    fprintf(stderr, "usage: %s [-c] <benchmark> [options]\n\nbenchmarks:\n",
+            argv[0]);
+    for(int i = 0; i < count; i++) {
+        fprintf(stderr, "  %-12s %s\n", benchmarks[i].name,
+                benchmarks[i].help);
+    }
+    return argc > 1;
+}
@@ -0,0 +1,747 @@
+/**
+ * @file    mml_daemon.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * Serves every MatrixMath.h operation to local processes over a Unix domain
+ * socket (protocol in MatrixProtocol.h, client in MatrixClient.h).
+ *
+ * The daemon is a single-threaded poll() loop, so the whole host shares one
+ * core's worth of matrix work instead of every process spinning its own
+ * threads.  Each pass of the loop drains every readable client first, then
+ * coalesces the pending requests of each operation, from every client, into
+ * one structure-of-arrays batch (MatrixBatch.h), runs the batched kernel over
+ * it once and scatters the results back, so many small requests cost about
+ * as much as one large one.
+ *
+ * Usage: mml_daemon [socket path]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "MatrixMath.h"
+#include "MatrixBatch.h"
+#include "MatrixReduce.h"
+#include "MatrixProtocol.h"
+
+#define MAX_CLIENTS 1024
+#define READ_CHUNK (256 * 1024)
+
+//the largest request a client can send; nothing more is read from a client
+//until what it has buffered is parsed
+#define MAX_REQUEST (sizeof(struct MatrixRequestHeader) + \
+        (size_t)MML_MAX_ITEMS * 2 * sizeof(float[3][3]))
+
+//items per SoA batch; requests are coalesced into batches of this size, and
+//a larger request is split over several
+#define BATCH_ITEMS 4096
+
+struct Client {
+    int fd;
+    int pending_fd;
+    int dead;
+    char *rbuf;
+    size_t rlen, rpos, rcap;
+    char *wbuf;
+    size_t wlen, wpos, wcap;
+    void *shm;
+    size_t shm_size;
+};
+
+/**
+ * One parsed request waiting for its batch to run.  Inline payloads are kept
+ * as offsets since the client buffers may still grow while a pass is parsed.
+ */
+struct Pending {
+    struct Client *client;
+    struct MatrixRequestHeader req;
+    size_t in_off, out_off;
+};
+
+/**
+ * Items [first, first + count) of one request, as placed in a batch.
+ */
+struct Segment {
+    const struct Pending *p;
+    uint32_t first, count;
+};
+
+/**
+ * A batch of up to BATCH_ITEMS items of one operation.  a and b hold the
+ * operands and out the results as SoA planes of n floats; x, row and col
+ * hold the scalar and submatrix arguments of every item.
+ */
+struct Batch {
+    int n, num_segs;
+    float a[9 * BATCH_ITEMS], b[9 * BATCH_ITEMS], out[9 * BATCH_ITEMS];
+    float x[BATCH_ITEMS];
+    unsigned char row[BATCH_ITEMS], col[BATCH_ITEMS];
+    unsigned long long equal[BATCH_ITEMS / 64];
+    struct Segment segs[BATCH_ITEMS];
+};
+
+static struct Client clients[MAX_CLIENTS];
+static struct Batch batch;
+static struct pollfd pfds[MAX_CLIENTS + 1];
+static int num_clients;
+static volatile sig_atomic_t running = 1;
+
+static void HandleSignal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static int Reserve(char **buf, size_t *cap, size_t need)
+{
+    if(need <= *cap) {
+        return 0;
+    }
+    size_t cap2 = *cap ? *cap : 4096;
+    while(cap2 < need) {
+        cap2 *= 2;
+    }
+    char *p = realloc(*buf, cap2);
+    if(p == NULL) {
+        return -1;
+    }
+    *buf = p;
+    *cap = cap2;
+    return 0;
+}
+
+static void DropClient(int index)
+{
+    struct Client *c = &clients[index];
+
+    close(c->fd);
+    if(c->pending_fd >= 0) {
+        close(c->pending_fd);
+    }
+    if(c->shm != NULL) {
+        munmap(c->shm, c->shm_size);
+    }
+    free(c->rbuf);
+    free(c->wbuf);
+    clients[index] = clients[--num_clients];
+}
+
+//drains the socket, keeping any descriptor passed along with the data
+static int ReadClient(struct Client *c)
+{
+    for(;;) {
+        char control[CMSG_SPACE(sizeof(int))];
+        struct iovec iov;
+        struct msghdr msg;
+        ssize_t n;
+
+        if(c->rlen >= MAX_REQUEST) {
+            return 0;
+        }
+        if(Reserve(&c->rbuf, &c->rcap, c->rlen + READ_CHUNK) < 0) {
+            return -1;
+        }
+        iov.iov_base = c->rbuf + c->rlen;
+        iov.iov_len = c->rcap - c->rlen;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        n = recvmsg(c->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if(n < 0) {
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        }
+        if(n == 0) {
+            return -1;
+        }
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+                cm = CMSG_NXTHDR(&msg, cm)) {
+            if(cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+                if(c->pending_fd >= 0) {
+                    close(c->pending_fd);
+                }
+                memcpy(&c->pending_fd, CMSG_DATA(cm), sizeof(int));
+            }
+        }
+        c->rlen += n;
+        if((size_t)n < iov.iov_len) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Appends a response header and reserves room for its payload.  Returns the
+ * payload's offset in the write buffer, or 0 if out of memory.
+ */
+static size_t QueueResponse(struct Client *c, uint32_t id, int32_t status,
+        uint32_t count, size_t length)
+{
+    struct MatrixResponseHeader resp;
+
+    if(Reserve(&c->wbuf, &c->wcap, c->wlen + sizeof(resp) + length) < 0) {
+        return 0;
+    }
+    resp.length = (uint32_t)length;
+    resp.id = id;
+    resp.status = status;
+    resp.count = count;
+    memcpy(c->wbuf + c->wlen, &resp, sizeof(resp));
+    c->wlen += sizeof(resp) + length;
+    return c->wlen - length;
+}
+
+/**
+ * Maps the buffer passed along with a HELLO.  Touching a page past the end of
+ * the file would kill the daemon with SIGBUS, so the file must already hold
+ * `count` bytes and be sealed against shrinking.
+ */
+static int AttachShm(struct Client *c, const struct MatrixRequestHeader *req)
+{
+    struct stat st;
+    void *p = MAP_FAILED;
+    int seals;
+
+    if(c->pending_fd < 0 || req->count == 0) {
+        return MML_STATUS_NO_SHM;
+    }
+    seals = fcntl(c->pending_fd, F_GET_SEALS);
+    if(fstat(c->pending_fd, &st) == 0 && st.st_size >= (off_t)req->count &&
+            seals >= 0 && (seals & F_SEAL_SHRINK)) {
+        p = mmap(NULL, req->count, PROT_READ | PROT_WRITE, MAP_SHARED,
+                c->pending_fd, 0);
+    }
+    close(c->pending_fd);
+    c->pending_fd = -1;
+    if(p == MAP_FAILED) {
+        return MML_STATUS_NO_SHM;
+    }
+    if(c->shm != NULL) {
+        munmap(c->shm, c->shm_size);
+    }
+    c->shm = p;
+    c->shm_size = req->count;
+    return MML_STATUS_OK;
+}
+
+//the start of a request's input or output items, in the client's buffers or
+//its shared memory
+static const float *InputOf(const struct Pending *p)
+{
+    const struct Client *c = p->client;
+    const char *base = (p->req.flags & MML_FLAG_SHM) ? c->shm : c->rbuf;
+    return (const float *)(base + p->in_off);
+}
+
+static float *OutputOf(const struct Pending *p)
+{
+    const struct Client *c = p->client;
+    char *base = (p->req.flags & MML_FLAG_SHM) ? c->shm : c->wbuf;
+    return (float *)(base + p->out_off);
+}
+
+//copies the input items of every segment into the SoA planes
+static void Gather(struct Batch *bt, int operands)
+{
+    int n = bt->n, q = 0;
+
+    for(int s = 0; s < bt->num_segs; s++) {
+        const struct Segment *seg = &bt->segs[s];
+        const struct MatrixRequestHeader *req = &seg->p->req;
+        const float *in = InputOf(seg->p) + (size_t)seg->first * 9 * operands;
+
+        for(uint32_t k = 0; k < seg->count; k++, q++) {
+            for(int e = 0; e < 9; e++) {
+                bt->a[e * n + q] = in[e];
+            }
+            if(operands == 2) {
+                for(int e = 0; e < 9; e++) {
+                    bt->b[e * n + q] = in[9 + e];
+                }
+            }
+            bt->x[q] = req->scalar;
+            bt->row[q] = req->row;
+            bt->col[q] = req->col;
+            in += 9 * operands;
+        }
+    }
+}
+
+//copies the results of every segment back to its request's output items
+static void Scatter(const struct Batch *bt, int op, int floats)
+{
+    int n = bt->n, q = 0;
+
+    for(int s = 0; s < bt->num_segs; s++) {
+        const struct Segment *seg = &bt->segs[s];
+        float *out = OutputOf(seg->p) + (size_t)seg->first * floats;
+
+        for(uint32_t k = 0; k < seg->count; k++, q++) {
+            if(op == MML_OP_EQUALS) {
+                int32_t eq = (bt->equal[q / 64] >> (q % 64)) & 1;
+                memcpy(out, &eq, sizeof(eq));
+            } else {
+                for(int e = 0; e < floats; e++) {
+                    out[e] = bt->out[e * n + q];
+                }
+            }
+            out += floats;
+        }
+    }
+}
+
+//MatrixDeterminant() of every matrix of a SoA batch, in its order of
+//operations
+static void DeterminantKernel(int n, const float *a, float *det)
+{
+    const float *m00 = MATRIX_SOA(a, n, 0, 0), *m01 = MATRIX_SOA(a, n, 0, 1);
+    const float *m02 = MATRIX_SOA(a, n, 0, 2), *m10 = MATRIX_SOA(a, n, 1, 0);
+    const float *m11 = MATRIX_SOA(a, n, 1, 1), *m12 = MATRIX_SOA(a, n, 1, 2);
+    const float *m20 = MATRIX_SOA(a, n, 2, 0), *m21 = MATRIX_SOA(a, n, 2, 1);
+    const float *m22 = MATRIX_SOA(a, n, 2, 2);
+
+    for(int q = 0; q < n; q++) {
+        float i = m00[q] * (m11[q] * m22[q] - m12[q] * m21[q]);
+        float j = m01[q] * (m10[q] * m22[q] - m12[q] * m20[q]);
+        float k = m02[q] * (m10[q] * m21[q] - m11[q] * m20[q]);
+        det[q] = i - j + k;
+    }
+}
+
+//MatrixInverse() of every matrix of a SoA batch, with zeros for a singular
+//one; the adjugate is built plane by plane from the cofactors
+static void InverseKernel(int n, const float *a, float *det, float *out)
+{
+    DeterminantKernel(n, a, det);
+    for(int i = 0; i < DIM; i++) {
+        int r0 = i == 0 ? 1 : 0, r1 = i == 2 ? 1 : 2;
+        for(int j = 0; j < DIM; j++) {
+            int c0 = j == 0 ? 1 : 0, c1 = j == 2 ? 1 : 2;
+            const float *s00 = MATRIX_SOA(a, n, r0, c0);
+            const float *s01 = MATRIX_SOA(a, n, r0, c1);
+            const float *s10 = MATRIX_SOA(a, n, r1, c0);
+            const float *s11 = MATRIX_SOA(a, n, r1, c1);
+            float *res = MATRIX_SOA(out, n, j, i);
+            float sign = ((i + j) % 2) ? -1 : 1;
+
+            for(int q = 0; q < n; q++) {
+                float minor = sign * (s00[q] * s11[q] - s01[q] * s10[q]);
+                res[q] = det[q] != 0 ? minor * (1 / det[q]) : 0;
+            }
+        }
+    }
+}
+
+/**
+ * Runs the kernel of one operation over a gathered batch.  This is the only
+ * place the daemon computes anything.
+ */
+static void RunKernel(struct Batch *bt, int op)
+{
+    int n = bt->n;
+    const float *a = bt->a, *b = bt->b;
+    float *out = bt->out;
+
+    switch(op) {
+    case MML_OP_EQUALS:
+        MatrixEqualsBatch(n, a, b, MATRIX_CMP_ABS, FP_DELTA, bt->equal, 1);
+        break;
+    case MML_OP_ADD:
+        for(int e = 0; e < 9 * n; e++) {
+            out[e] = a[e] + b[e];
+        }
+        break;
+    case MML_OP_MULTIPLY:
+        for(int i = 0; i < DIM; i++) {
+            for(int j = 0; j < DIM; j++) {
+                const float *a0 = MATRIX_SOA(a, n, i, 0);
+                const float *a1 = MATRIX_SOA(a, n, i, 1);
+                const float *a2 = MATRIX_SOA(a, n, i, 2);
+                const float *b0 = MATRIX_SOA(b, n, 0, j);
+                const float *b1 = MATRIX_SOA(b, n, 1, j);
+                const float *b2 = MATRIX_SOA(b, n, 2, j);
+                float *res = MATRIX_SOA(out, n, i, j);
+                for(int q = 0; q < n; q++) {
+                    res[q] = a0[q] * b0[q] + a1[q] * b1[q] + a2[q] * b2[q];
+                }
+            }
+        }
+        break;
+    case MML_OP_SCALAR_ADD:
+        for(int e = 0; e < 9; e++) {
+            for(int q = 0; q < n; q++) {
+                out[e * n + q] = a[e * n + q] + bt->x[q];
+            }
+        }
+        break;
+    case MML_OP_SCALAR_MULTIPLY:
+        for(int e = 0; e < 9; e++) {
+            for(int q = 0; q < n; q++) {
+                out[e * n + q] = a[e * n + q] * bt->x[q];
+            }
+        }
+        break;
+    case MML_OP_TRACE:
+        MatrixTraceBatch(n, a, out);
+        break;
+    case MML_OP_TRANSPOSE:
+        for(int i = 0; i < DIM; i++) {
+            for(int j = 0; j < DIM; j++) {
+                memcpy(MATRIX_SOA(out, n, i, j), MATRIX_SOA(a, n, j, i),
+                        n * sizeof(float));
+            }
+        }
+        break;
+    case MML_OP_SUBMATRIX:
+        //element (r, c) of the 2x2 result is plane r * 2 + c
+        for(int r = 0; r < 2; r++) {
+            for(int c = 0; c < 2; c++) {
+                for(int q = 0; q < n; q++) {
+                    int i = r + (r >= bt->row[q]), j = c + (c >= bt->col[q]);
+                    out[(r * 2 + c) * n + q] = a[(i * DIM + j) * n + q];
+                }
+            }
+        }
+        break;
+    case MML_OP_DETERMINANT:
+        DeterminantKernel(n, a, out);
+        break;
+    case MML_OP_INVERSE:
+        //x is not an argument of MatrixInverse(), so it holds the determinants
+        InverseKernel(n, a, bt->x, out);
+        break;
+    }
+}
+
+/**
+ * Runs every request of a group of one operation: their items are packed
+ * into batches of up to BATCH_ITEMS regardless of which request or client
+ * they came from, each batch runs once, and its results are scattered back.
+ */
+static void RunGroup(const struct Pending *group, size_t num)
+{
+    struct Batch *bt = &batch;
+    int op = group[0].req.op;
+    size_t in_size, out_size, r = 0;
+    uint32_t first = 0;
+
+    if(!MatrixProtocolItemSize(op, &in_size, &out_size)) {
+        return;
+    }
+    while(r < num) {
+        bt->n = 0;
+        bt->num_segs = 0;
+        while(r < num && bt->n < BATCH_ITEMS) {
+            uint32_t take = group[r].req.count - first;
+            if(take > (uint32_t)(BATCH_ITEMS - bt->n)) {
+                take = BATCH_ITEMS - bt->n;
+            }
+            if(take > 0) {
+                bt->segs[bt->num_segs].p = &group[r];
+                bt->segs[bt->num_segs].first = first;
+                bt->segs[bt->num_segs].count = take;
+                bt->num_segs++;
+                bt->n += take;
+                first += take;
+            }
+            if(first == group[r].req.count) {
+                r++;
+                first = 0;
+            }
+        }
+        if(bt->n > 0) {
+            Gather(bt, (int)(in_size / sizeof(float[3][3])));
+            RunKernel(bt, op);
+            Scatter(bt, op, (int)(out_size / sizeof(float)));
+        }
+    }
+}
+
+/**
+ * Checks a header as soon as it arrives, before its payload is waited for.
+ * A header that fails cannot be framed (or asks for more than MML_MAX_ITEMS
+ * items), so its client is dropped rather than buffered for.
+ */
+static int ValidHeader(const struct MatrixRequestHeader *req)
+{
+    size_t in_size, out_size;
+
+    if(req->op == MML_OP_HELLO) {
+        return req->length == 0;
+    }
+    if(!MatrixProtocolItemSize(req->op, &in_size, &out_size) ||
+            req->count > MML_MAX_ITEMS) {
+        return 0;
+    }
+    if(req->flags & MML_FLAG_SHM) {
+        return req->length == 0;
+    }
+    return req->length == req->count * in_size;
+}
+
+/**
+ * Turns a request that passed ValidHeader() into a Pending entry.  Returns 1
+ * if the request was queued for batching, 0 if it was answered (or rejected)
+ * on the spot, and -1 if the client must be dropped.
+ */
+static int ParseRequest(struct Client *c, const struct MatrixRequestHeader *req,
+        size_t payload_off, struct Pending *p)
+{
+    size_t in_size, out_size, out_len;
+
+    if(req->op == MML_OP_HELLO) {
+        return QueueResponse(c, req->id, AttachShm(c, req), 0, 0) ? 0 : -1;
+    }
+    if(!MatrixProtocolItemSize(req->op, &in_size, &out_size) ||
+            (req->op == MML_OP_SUBMATRIX && (req->row > 2 || req->col > 2))) {
+        return QueueResponse(c, req->id, MML_STATUS_BAD_REQUEST, 0, 0) ? 0 : -1;
+    }
+
+    p->client = c;
+    p->req = *req;
+    if(req->flags & MML_FLAG_SHM) {
+        size_t in_end = (size_t)req->shm_in + req->count * in_size;
+        size_t out_end = (size_t)req->shm_out + req->count * out_size;
+        //the items are read and written as floats, in place
+        if(c->shm == NULL || in_end > c->shm_size || out_end > c->shm_size ||
+                req->shm_in % sizeof(float) != 0 ||
+                req->shm_out % sizeof(float) != 0) {
+            int32_t status = c->shm ? MML_STATUS_BAD_REQUEST : MML_STATUS_NO_SHM;
+            return QueueResponse(c, req->id, status, 0, 0) ? 0 : -1;
+        }
+        p->in_off = req->shm_in;
+        p->out_off = req->shm_out;
+        return QueueResponse(c, req->id, MML_STATUS_OK, req->count, 0) ? 1 : -1;
+    }
+    //the response slot is reserved now so replies keep request order
+    out_len = req->count * out_size;
+    p->in_off = payload_off;
+    p->out_off = QueueResponse(c, req->id, MML_STATUS_OK, req->count, out_len);
+    return p->out_off ? 1 : -1;
+}
+
+static void AcceptClients(int listen_fd)
+{
+    for(;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            return;
+        }
+        if(num_clients == MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        memset(&clients[num_clients], 0, sizeof(clients[0]));
+        clients[num_clients].fd = fd;
+        clients[num_clients].pending_fd = -1;
+        num_clients++;
+    }
+}
+
+//writes as much of the queued responses as the socket takes without blocking
+static void FlushClient(struct Client *c)
+{
+    while(c->wpos < c->wlen) {
+        ssize_t n = send(c->fd, c->wbuf + c->wpos, c->wlen - c->wpos,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            if(n < 0 && errno != EAGAIN) {
+                c->dead = 1;
+            }
+            break;
+        }
+        c->wpos += n;
+    }
+    //keep the unsent tail at the front, or a client that reads slowly would
+    //never see the buffer reused
+    if(c->wpos > 0) {
+        memmove(c->wbuf, c->wbuf + c->wpos, c->wlen - c->wpos);
+        c->wlen -= c->wpos;
+        c->wpos = 0;
+    }
+}
+
+//whether a client has more replies queued than it is allowed to; it is then
+//neither read nor parsed until it takes some of them
+static int Backlogged(const struct Client *c)
+{
+    return c->wlen - c->wpos > MAX_REQUEST;
+}
+
+//parses every complete request sitting in a client's receive buffer
+static size_t ParseClient(struct Client *c, struct Pending **pending,
+        size_t *pending_cap, size_t num_pending)
+{
+    while(!c->dead && !Backlogged(c) &&
+            c->rlen - c->rpos >= sizeof(struct MatrixRequestHeader)) {
+        struct MatrixRequestHeader req;
+        int r;
+
+        memcpy(&req, c->rbuf + c->rpos, sizeof(req));
+        if(!ValidHeader(&req)) {
+            c->dead = 1;
+            break;
+        }
+        if(c->rlen - c->rpos - sizeof(req) < req.length) {
+            break;
+        }
+        if(Reserve((char **)pending, pending_cap,
+                (num_pending + 1) * sizeof(**pending)) < 0) {
+            break;
+        }
+        r = ParseRequest(c, &req, c->rpos + sizeof(req),
+                &(*pending)[num_pending]);
+        if(r < 0) {
+            c->dead = 1;
+            break;
+        }
+        num_pending += r;
+        c->rpos += sizeof(req) + req.length;
+    }
+    return num_pending;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : getenv("MML_SOCKET");
+    struct sockaddr_un addr;
+    struct Pending *pending = NULL, *sorted = NULL;
+    size_t pending_cap = 0, sorted_cap = 0;
+    int listen_fd;
+
+    if(path == NULL) {
+        path = MML_SOCKET_PATH;
+    }
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "mml_daemon: socket path too long\n");
+        return 1;
+    }
+
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if(listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr,
+            sizeof(addr)) < 0 || listen(listen_fd, 128) < 0) {
+        perror("mml_daemon");
+        return 1;
+    }
+    printf("mml_daemon listening on %s\n", path);
+    fflush(stdout);
+
+    while(running) {
+        size_t num_pending = 0;
+        size_t start[MML_OP_COUNT + 1];
+
+        pfds[0].fd = listen_fd;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        for(int k = 0; k < num_clients; k++) {
+            pfds[k + 1].fd = clients[k].fd;
+            pfds[k + 1].events = (Backlogged(&clients[k]) ? 0 : POLLIN) |
+                    (clients[k].wlen ? POLLOUT : 0);
+            pfds[k + 1].revents = 0;
+        }
+        if(poll(pfds, num_clients + 1, -1) < 0) {
+            continue;
+        }
+
+        //stage 1: pull in everything every client has sent so far
+        for(int k = 0; k < num_clients; k++) {
+            short ev = pfds[k + 1].revents;
+            if(ev & POLLOUT) {
+                FlushClient(&clients[k]);
+            }
+            if((ev & (POLLIN | POLLHUP | POLLERR)) &&
+                    ReadClient(&clients[k]) < 0) {
+                clients[k].dead = 1;
+            }
+        }
+
+        //stage 2: parse complete requests out of the receive buffers
+        for(int k = 0; k < num_clients; k++) {
+            num_pending = ParseClient(&clients[k], &pending, &pending_cap,
+                    num_pending);
+        }
+
+        //stage 3: group by operation (counting sort) and run each group as
+        //SoA batches.  The replies are already queued as MML_STATUS_OK, so
+        //if there is no room to sort, their clients are dropped rather than
+        //sent results that were never computed
+        if(num_pending > 0 && Reserve((char **)&sorted, &sorted_cap,
+                num_pending * sizeof(*sorted)) < 0) {
+            for(size_t q = 0; q < num_pending; q++) {
+                pending[q].client->dead = 1;
+            }
+        } else if(num_pending > 0) {
+            memset(start, 0, sizeof(start));
+            for(size_t q = 0; q < num_pending; q++) {
+                start[pending[q].req.op + 1]++;
+            }
+            for(int op = 1; op <= MML_OP_COUNT; op++) {
+                start[op] += start[op - 1];
+            }
+            for(size_t q = 0; q < num_pending; q++) {
+                sorted[start[pending[q].req.op]++] = pending[q];
+            }
+            for(size_t q = 0; q < num_pending; ) {
+                size_t end = q + 1;
+                while(end < num_pending &&
+                        sorted[end].req.op == sorted[q].req.op) {
+                    end++;
+                }
+                RunGroup(&sorted[q], end - q);
+                q = end;
+            }
+        }
+
+        //stage 4: reply, compact receive buffers and retire dead clients
+        for(int k = num_clients - 1; k >= 0; k--) {
+            struct Client *c = &clients[k];
+            if(!c->dead && c->wlen > 0) {
+                FlushClient(c);
+            }
+            if(c->dead) {
+                DropClient(k);
+                continue;
+            }
+            if(c->rpos > 0) {
+                memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+                c->rlen -= c->rpos;
+                c->rpos = 0;
+            }
+        }
+        if(pfds[0].revents & POLLIN) {
+            AcceptClients(listen_fd);
+        }
+    }
+
+    for(int k = num_clients - 1; k >= 0; k--) {
+        DropClient(k);
+    }
+    free(pending);
+    free(sorted);
+    close(listen_fd);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file    mml_loadgen.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * Load generator for mml_daemon.  Runs an increasing number of concurrent
+ * clients, each issuing back-to-back requests, and reports throughput next
+ * to the p50/p99 request latency at every concurrency level.
+ *
+ * Usage: mml_loadgen [-s socket] [-n requests per client] [-b batch size]
+ *                    [-c max clients] [-m shm bytes]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "MatrixProtocol.h"
+#include "MatrixClient.h"
+
+struct Worker {
+    pthread_t thread;
+    const char *path;
+    int requests;
+    int batch;
+    size_t shm_size;
+    double *latency_ns;
+    int failed;
+};
+
+static double NowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void *RunWorker(void *arg)
+{
+    struct Worker *w = arg;
+    MatrixClient *client = MatrixClientOpen(w->path, w->shm_size);
+    float (*in)[3][3] = malloc(2 * w->batch * sizeof(*in));
+    float (*out)[3][3] = malloc(w->batch * sizeof(*out));
+
+    if(client == NULL || in == NULL || out == NULL) {
+        w->failed = 1;
+        goto done;
+    }
+    for(int k = 0; k < 2 * w->batch; k++) {
+        for(int i = 0; i < 3; i++) {
+            for(int j = 0; j < 3; j++) {
+                in[k][i][j] = (float)rand() / RAND_MAX;
+            }
+        }
+    }
+    for(int r = 0; r < w->requests; r++) {
+        double t0 = NowNs();
+        if(MatrixClientBatch(client, MML_OP_MULTIPLY, 0, 0, 0, w->batch, in,
+                out) < 0) {
+            w->failed = 1;
+            break;
+        }
+        w->latency_ns[r] = NowNs() - t0;
+    }
+done:
+    MatrixClientClose(client);
+    free(in);
+    free(out);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    int requests = 20000, batch = 1, max_clients = 64;
+    size_t shm_size = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:n:b:c:m:")) != -1) {
+        switch(opt) {
+        case 's': path = optarg; break;
+        case 'n': requests = atoi(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'c': max_clients = atoi(optarg); break;
+        case 'm': shm_size = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [-s socket] [-n requests] [-b batch] "
+                    "[-c max clients] [-m shm bytes]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(requests < 1 || batch < 1 || batch > MML_MAX_ITEMS || max_clients < 1) {
+        fprintf(stderr, "mml_loadgen: bad arguments\n");
+        return 1;
+    }
+
+    printf("MatrixMultiply x%d per request, %d requests per client\n", batch,
+            requests);
+    printf("%8s %14s %12s %12s\n", "clients", "matrices/s", "p50 (us)",
+            "p99 (us)");
+
+    for(int n = 1; n <= max_clients; n *= 2) {
+        struct Worker *workers = calloc(n, sizeof(*workers));
+        double *all = malloc((size_t)n * requests * sizeof(*all));
+        double t0, elapsed;
+        int failed = 0;
+
+        if(workers == NULL || all == NULL) {
+            fprintf(stderr, "mml_loadgen: out of memory\n");
+            return 1;
+        }
+        t0 = NowNs();
+        for(int k = 0; k < n; k++) {
+            workers[k].path = path;
+            workers[k].requests = requests;
+            workers[k].batch = batch;
+            workers[k].shm_size = shm_size;
+            workers[k].latency_ns = all + (size_t)k * requests;
+            pthread_create(&workers[k].thread, NULL, RunWorker, &workers[k]);
+        }
+        for(int k = 0; k < n; k++) {
+            pthread_join(workers[k].thread, NULL);
+            failed |= workers[k].failed;
+        }
+        elapsed = NowNs() - t0;
+        if(failed) {
+            fprintf(stderr, "mml_loadgen: requests failed (is mml_daemon "
+                    "running?)\n");
+            return 1;
+        }
+
+        qsort(all, (size_t)n * requests, sizeof(*all), CompareDouble);
+        printf("%8d %14.0f %12.2f %12.2f\n", n,
+                (double)n * requests * batch / (elapsed * 1e-9),
+                all[(size_t)(0.50 * (n * requests - 1))] * 1e-3,
+                all[(size_t)(0.99 * (n * requests - 1))] * 1e-3);
+        free(workers);
+        free(all);
+    }
+    return 0;
+}
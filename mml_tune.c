@@ -0,0 +1,66 @@
+/**
+ * @file    mml_tune.c
+ * @author  Nicolas Jorgensen (njorgen1@ucsc.edu)
+ *
+ * Tunes the library for this machine.  Runs MatrixTuneRun(), prints every
+ * trial and saves the winners as this CPU model's profile, which every
+ * later program loads on its first tuned call (see MatrixTune.h).
+ *
+ * Usage: mml_tune [seconds]     (tune and save; default 1 second)
+ *        mml_tune --show        (print the profile path and the parameters
+ *                                in effect, with where they came from)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MatrixTune.h"
+
+static void Print(const struct MatrixTuning *t)
+{
+    printf("  strassen_cutoff  %d\n", t->strassen_cutoff);
+    printf("  strassen_block   %d\n", t->strassen_block);
+    printf("  transpose_leaf   %d\n", t->transpose_leaf);
+    printf("  transpose_isa    %s\n", MatrixTuneIsaName(t->transpose_isa));
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *sources[] = {"built-in defaults", "profile", "trials"};
+    struct MatrixTuning t;
+    char model[256], path[512];
+    double seconds = MATRIX_TUNE_SECONDS;
+    int have_path = MatrixTuneProfilePath(path, sizeof(path));
+
+    MatrixTuneCpuModel(model, sizeof(model));
+    printf("cpu:     %s\nprofile: %s\n", model, have_path ? path : "(none)");
+
+    if(argc > 1 && strcmp(argv[1], "--show") == 0) {
+        int source = MatrixTuneInit();
+        MatrixTuneGet(&t);
+        printf("\nin effect (%s, then MML_* overrides):\n", sources[source]);
+        Print(&t);
+        return 0;
+    }
+    if(argc > 1) {
+        seconds = atof(argv[1]);
+        if(seconds <= 0) {
+            fprintf(stderr, "usage: %s [seconds] | --show\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("\ntrials (best time per candidate, < marks the winner):\n");
+    if(!MatrixTuneRun(seconds, stdout, &t)) {
+        fprintf(stderr, "mml_tune: out of memory\n");
+        return 1;
+    }
+    printf("\nwinners:\n");
+    Print(&t);
+    if(!have_path || !MatrixTuneSave(path, &t)) {
+        fprintf(stderr, "mml_tune: could not save the profile\n");
+        return 1;
+    }
+    printf("\nsaved to %s\n", path);
+    return 0;
+}